@@ -26,6 +26,7 @@ SOFTWARE.
 #define STEP_COUNTING_ALGO_H
 #include <stdint.h>
 #include "config.h"
+#include "stepContext.h"
 
 /**
     This function initializes user health information.
@@ -46,6 +47,55 @@ void initUserData(char* userGender, uint8_t userAge, uint8_t userHeight, uint8_t
 */
 void initAlgo(char* gender, uint8_t age, uint8_t height, uint8_t weight);
 
+/**
+    Same as initAlgo but for a sensor running at a rate other than SAMPLE_RATE_HZ.
+    All rate dependent parameters are derived here, streams with the same rate share them.
+    @param gender
+    @param age
+    @param height meters
+    @param weight kg
+    @param sampleRateHz output data rate of the accelerometer
+    @param timeScalingFactor timestamp ticks per ms
+    @return 1 if the algorithm was initialized; 0 if the rate is not supported
+*/
+uint8_t initAlgoWithRate(char* gender, uint8_t age, uint8_t height, uint8_t weight,
+                         uint16_t sampleRateHz, uint16_t timeScalingFactor);
+
+/**
+    Initializes the context of one stream, for running several streams in the same process.
+    The context is selected when this returns.
+    @param ctx the context to initialize
+    @param gender
+    @param age
+    @param height meters
+    @param weight kg
+    @param sampleRateHz output data rate of the accelerometer
+    @param timeScalingFactor timestamp ticks per ms
+    @return 1 if the context was initialized; 0 if the rate is not supported
+*/
+uint8_t initContext(step_context_t *ctx, char* gender, uint8_t age, uint8_t height, uint8_t weight,
+                    uint16_t sampleRateHz, uint16_t timeScalingFactor);
+
+/**
+    Makes a context usable again after its bytes were copied or mapped from a file by an earlier
+    process, e.g. to resume a stream after a restart. The buffers are pointed into the context again,
+    the rate parameters are looked up again, and the stages are chained if no context was initialized
+    in this process yet. The stage tap, the step listener and the shadow branches belonged to the
+    earlier process and are removed. The windows, statistics and totals are kept as they were.
+    The context is selected when this returns.
+    @param ctx the context, initialized with initContext by this build of the library
+    @param gender the same as given to initContext, it must outlive the context like there
+    @return 1 if the context can be used; 0 if its rate is not supported
+*/
+uint8_t relocateContext(step_context_t *ctx, char* gender);
+
+/**
+    Makes all the following calls (processSample, getSteps, resets...) act on the given context.
+    This only rebinds pointers, switch once per batch of samples rather than per sample.
+    @param ctx a context initialized with initContext
+*/
+void selectContext(step_context_t *ctx);
+
 /**
     This function takes the raw accelerometry data and computes the entire algorithm
     @param time, the current time in ms
@@ -55,6 +105,15 @@ void initAlgo(char* gender, uint8_t age, uint8_t height, uint8_t weight);
 */
 void processSample(time_accel_t time, accel_t x, accel_t y, accel_t z);
 
+/**
+    Processes a burst read from the accelerometer FIFO without unpacking it first.
+    @param fifo the raw FIFO content, interleaved little-endian int16 X, Y, Z
+    @param sampleCount number of XYZ samples in the burst
+    @param burstTime time of the newest sample in the burst, in the same unit as processSample
+    @param odrHz output data rate of the accelerometer, used to time the older samples
+*/
+void processFifoBurst(const uint8_t *fifo, uint16_t sampleCount, time_accel_t burstTime, uint16_t odrHz);
+
 /**
     Resets the number of walked steps
 */
@@ -91,9 +150,141 @@ float getStepsPerSec(void);
 
 float getMeanAvg(void);
 
-/* Extern variables */
-extern double kcalories;
-extern float bmr;
-extern float stride;
+/**
+    Returns the number of steps walked in a time range, from the step log.
+    Only the last STEP_LOG_BLOCKS blocks of steps are kept, older steps are not counted.
+    @param from start of the range, in ms
+    @param to end of the range (excluded), in ms
+    @return steps walked in the range
+*/
+steps_t getStepsBetween(time_accel_t from, time_accel_t to);
+
+/**
+    Returns the distance in meters walked in a time range, from the step log.
+    @param from start of the range, in ms
+    @param to end of the range (excluded), in ms
+    @return distance walked in the range
+*/
+float getDistanceBetween(time_accel_t from, time_accel_t to);
+
+/**
+    Copies the logged steps at or after a given time, oldest first, e.g. to sync them to a backend.
+    Call again from the time of the last step + 1 until it returns less than max.
+    @param since time of the first step, in ms
+    @param events where the steps are copied
+    @param max number of steps that fit in events
+    @return number of steps copied
+*/
+uint32_t exportSteps(time_accel_t since, step_event_t *events, uint32_t max);
+
+/**
+    Decimates the samples of the selected context by an integer factor before the motion
+    detection, with a CIC filter, so that the rest of the pipeline runs at sensorRate / factor
+    with the parameters of that rate, to the nearest Hz. Streams faster than MAX_RATE_HZ are
+    decimated by the smallest factor that brings them to it or below by initContext, e.g. 3
+    for a 401 Hz sensor; call this with 8 for a 400 Hz sensor to run the pipeline at 50 Hz.
+    Call it right after the context is initialized.
+    @param factor 1 for no decimation, up to MAX_DECIMATION_FACTOR
+    @return 1 if the factor was set; 0 if the resulting rate is not supported
+*/
+uint8_t changeDecimation(uint8_t factor);
+
+/**
+    Trades accuracy for a shorter delay between a step and its detection.
+    By default the motion detection buffer fills up while idle and every step waits for it,
+    about 1.2 s at 50 Hz. In low latency mode no backlog is kept, the motion detection does not
+    wait for extra samples and the scoring window only looks a quarter of its size ahead instead of half.
+    @param lowLatency 1 for the low latency mode; 0 for the default windows
+*/
+void changeLatencyMode(uint8_t lowLatency);
+
+/**
+    Sets a function called for every accepted step of the selected context, NULL for none.
+    The step is first notified as STEP_PROVISIONAL as soon as it is counted, then as
+    STEP_CONFIRMED once the time threshold has passed and no bigger peak can replace it.
+    @param listener the function to call
+*/
+void setStepListener(void (*listener)(const step_notice_t *notice));
+
+/**
+    Sets a function called with every output of the filter (TAP_FILTERED), the scoring (TAP_SCORE)
+    and the detection (TAP_PEAK) of the selected context, NULL for none.
+    It runs before the next stage reads the output, e.g. to record the stages while tuning.
+    @param tap the function to call
+*/
+void setStageTap(void (*tap)(uint8_t tap, const data_point_t *point));
+
+/**
+    Sets the scoring shared by the shadow branches of the selected context, which scores the
+    window of every branch in one pass over each filtered sample. The branches already added
+    are moved to it. Needed before addShadowBranch().
+    @param scoring memory for the scoring, kept by the caller while the context has branches
+*/
+void initShadowScoring(multi_scoring_t *scoring);
+
+/**
+    Adds a shadow branch to the selected context, e.g. to try new OPT_* values on live streams.
+    The branch gets the output of the filter of the context and runs its own scoring, detection
+    and post-processing with the given parameters. It counts its own steps and tracks how far it
+    gets from the primary, which is not affected by it. The branch starts with the next sample,
+    its first windows hold the filtered samples the other branches already have.
+    @param branch memory for the branch, kept by the caller until it is removed
+    @param params parameters of the branch
+    @return 1 if the branch was added; 0 without a shadow scoring or with MULTI_SCORING_WINDOWS branches already
+*/
+uint8_t addShadowBranch(shadow_branch_t *branch, const shadow_params_t *params);
+
+/**
+    Removes a shadow branch from the selected context.
+    @param branch the branch to remove
+    @return 1 if the branch was removed; 0 if it was not added to the context
+*/
+uint8_t removeShadowBranch(shadow_branch_t *branch);
+
+/**
+    Returns the steps and distance of a shadow branch and its divergence from the primary.
+    @param branch the branch
+    @param stats where the statistics are copied
+*/
+void getShadowStats(const shadow_branch_t *branch, shadow_stats_t *stats);
+
+/**
+    Returns the detection latency of the accepted steps: last, max and total in ms since init.
+    @param stats where the statistics are copied
+*/
+void getLatencyStats(latency_stats_t *stats);
+
+/**
+    Returns the steps, distance and calories of the minute, hour or day holding a given time.
+    The last 60 minutes, 24 hours and 7 days are kept, the buckets start at time 0 of the sensor clock.
+    @param level ROLLUP_MINUTE, ROLLUP_HOUR or ROLLUP_DAY
+    @param time any time within the bucket, in ms
+    @param bucket where the totals are copied
+    @return 1 if the bucket is kept; 0 if it is too old or the level is invalid
+*/
+uint8_t getActivity(uint8_t level, time_accel_t time, activity_bucket_t *bucket);
+
+/**
+    Returns the number of gaps in the input longer than GAP_THRESHOLD.
+    Gaps are not interpolated, the pipeline restarts after them and the gap counts as idle time.
+    @return gaps skipped since the context was initialized
+*/
+uint32_t getGaps(void);
+
+/**
+    Publishes steps, distance, calories, speed and last step time of the selected context
+    for getMetrics(). This is done at the end of processFifoBurst, call it after a batch of
+    processSample calls too. Every accepted step also publishes them, with the calories
+    booked so far, but the calories are only integrated here, not per step.
+*/
+void publishMetrics(void);
+
+/**
+    Returns the last published metrics of a context without blocking the processing thread.
+    Safe to call from any thread, also while the context is being processed.
+    @param ctx the context, NULL for the one used by initAlgo
+    @param metrics where the metrics are copied
+*/
+void getMetrics(step_context_t *ctx, step_metrics_t *metrics);
 
 #endif
\ No newline at end of file
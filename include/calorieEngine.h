@@ -0,0 +1,107 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef CALORIE_ENGINE_H
+#define CALORIE_ENGINE_H
+#include "config.h"
+
+/* MET classes, class 0 is time without motion */
+#define MET_CLASS_IDLE 0
+#define MET_CLASS_COUNT 9
+
+/* Intervals kept before they are integrated */
+#define ACTIVITY_LOG_SIZE 8
+
+/**
+ * A span of time spent in one MET class.
+ * Consecutive spans of the same class are merged, and the two oldest spans when the log is full.
+ */
+typedef struct activity_interval_t activity_interval_t;
+
+struct activity_interval_t
+{
+    time_accel_t start;
+    time_accel_t duration; /* ms */
+    uint64_t metMs;        /* MET * ms, of every span merged into this one */
+    uint8_t metClass;      /* MET_CLASS_COUNT once spans of different classes are merged */
+};
+
+typedef struct calorie_state_t calorie_state_t;
+
+struct calorie_state_t
+{
+    activity_interval_t log[ACTIVITY_LOG_SIZE];
+    uint8_t logCount;
+    uint64_t loggedMetMs; /* MET * ms of the intervals in the log */
+    float bmr;
+    double kcalories; /* integrated intervals, bmr * MET * ms */
+};
+
+/**
+ * Sets the function told about every integrated interval, NULL for none.
+ */
+void initCalorieEngine(void (*pEnergyCallback)(time_accel_t start, time_accel_t duration, double energy));
+void bindCalorieEngine(calorie_state_t *pState);
+void resetCalories(void);
+void changeBmr(float bmr);
+
+/**
+ * Returns the MET class of a peak from its magnitude.
+ */
+uint8_t metClassOf(magnitude_t magnitude);
+
+/**
+ * Returns the MET of a class.
+ */
+met_t metOfClass(uint8_t metClass);
+
+/**
+ * Records time spent without motion. Integer work only, safe on the per-sample path.
+ */
+void bookIdleTime(time_accel_t start, time_accel_t duration);
+
+/**
+ * Records the time spent on a step in the given MET class. Integer work only too.
+ */
+void bookStep(time_accel_t start, time_accel_t duration, uint8_t metClass);
+
+/**
+ * Integrates the recorded intervals.
+ * @return the energy burned so far, in bmr * MET * ms
+ */
+double integrateCalories(void);
+
+/**
+ * Returns the energy of the intervals integrated so far, without integrating the recorded ones.
+ * @return the energy in bmr * MET * ms
+ */
+double integratedCalories(void);
+
+/**
+ * Returns the energy of the intervals integrated so far plus that of the recorded ones, without
+ * integrating them: one multiplication, cheap enough for every step.
+ * @return the energy in bmr * MET * ms
+ */
+double bookedCalories(void);
+
+#endif
@@ -54,14 +54,42 @@ typedef uint8_t height_t;
 // user weight
 typedef uint8_t weight_t; 
 
+// output data rate of the accelerometer in Hz
+// the filter taps, window sizes and warm-up lengths are derived from this, see rateConfig.h
+#define SAMPLE_RATE_HZ 50
+
+// timestamp ticks per ms, use this if the clock has higher precision than ms
+#define TIME_SCALING_FACTOR 1
+
 // skip interpolation
 #define SKIP_INTERPOLATION
 
 // skip filtering step
 // #define SKIP_FILTER
 
+// magnitude estimator, the exact square root unless one of these is defined
+// (cmake -DAPPROX_MAGNITUDE=ON or -DSQUARED_MAGNITUDE=ON)
+// APPROX_MAGNITUDE: 3-D alpha max beta min estimate with shifts and adds only, within 3% of the exact magnitude
+// SQUARED_MAGNITUDE: the stages run on x^2 + y^2 + z^2, a square root is only taken once per step
+// #define APPROX_MAGNITUDE
+// #define SQUARED_MAGNITUDE
+#if defined(APPROX_MAGNITUDE) && defined(SQUARED_MAGNITUDE)
+#error "APPROX_MAGNITUDE and SQUARED_MAGNITUDE cannot be used together"
+#endif
+
+// mean and standard deviation of the scores in the detection, whose squares are taken too
+// squared scores reach 2^30 at full scale, so their squares need 64 bits
+#ifdef SQUARED_MAGNITUDE
+typedef int64_t deviation_t;
+#else
+typedef accumulator_t deviation_t;
+#endif
+
 // use this to allow dumping each stage on file, useful for debugging
+// define NO_DUMP_FILE (cmake -DDUMP_STAGES=OFF) to build without it, e.g. for the tools
+#ifndef NO_DUMP_FILE
 #define DUMP_FILE
+#endif
 #define DUMP_MAGNITUDE_FILE_NAME "magnitude.csv"
 #define DUMP_INTERPOLATED_FILE_NAME "interpolated.csv"
 #define DUMP_FILTERED_FILE_NAME "filtered.csv"
@@ -69,6 +97,20 @@ typedef uint8_t weight_t;
 #define DUMP_DETECTION_FILE_NAME "detection.csv"
 #define DUMP_POSTPROC_FILE_NAME "postproc.csv"
 
+// record a timeline of the stages that can be exported as a Chrome trace, see tracer.h
+// (cmake -DTRACE_STAGES=ON)
+// #define TRACE_PIPELINE
+
+// bind the stages to the selected context per thread, so that several threads can each run their own
+// contexts at the same time (cmake -DTHREAD_LOCAL_CONTEXTS=ON, on for the Python bindings); a thread
+// selects only contexts it initialised and the single stream API stays on one shared context
+// #define THREAD_LOCAL_CONTEXTS
+#ifdef THREAD_LOCAL_CONTEXTS
+#define CONTEXT_LOCAL _Thread_local
+#else
+#define CONTEXT_LOCAL
+#endif
+
 
 /**
  * @brief Experimentally detected variables
@@ -79,3 +121,6 @@ typedef uint8_t weight_t;
 #define OPT_DETECTION_THRESHOLD 1
 #define OPT_DETECTION_THRESHOLD_FRAC 8
 #define OPT_TIME_THRESHOLD 320
+#define IDLE_CONFIRM_MS 2000 /* time without motion before only a cheap motion check runs, 0 to always run the pipeline */
+#define IDLE_CHECK_MS 200    /* time between two motion checks while idle */
+#define GAP_THRESHOLD 2000 /* ms without samples after which the input is treated as a dropout and skipped */
@@ -0,0 +1,54 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef DECIMATION_STAGE_H
+#define DECIMATION_STAGE_H
+#include "ringbuffer.h"
+
+#define CIC_ORDER 3 /* aliases folding onto 0-3 Hz are attenuated by more than 40 dB */
+#define MAX_DECIMATION_FACTOR 16
+
+typedef struct decimation_state_t decimation_state_t;
+
+/**
+ * CIC decimator: the integrators run at the sensor rate and the combs at the output
+ * rate. It is all integer additions, the unsigned types wrap around on purpose since
+ * the differences of the combs are still exact.
+ */
+struct decimation_state_t
+{
+    uint8_t factor;  /* 1 passes the samples through */
+    uint8_t phase;   /* input samples since the last output */
+    uint8_t warmup;  /* outputs left until the combs are filled */
+    int64_t gain;    /* factor ^ CIC_ORDER */
+    uint64_t integrators[CIC_ORDER];
+    uint64_t combs[CIC_ORDER];
+};
+
+void initDecimationStage(ring_buffer_t *inBuff, ring_buffer_t *outBuff, void (*pNextStage)(void));
+void bindDecimationStage(decimation_state_t *pState, ring_buffer_t *inBuff, ring_buffer_t *outBuff);
+void decimationStage(void);
+void resetDecimation(void);
+void changeDecimationFactor(uint8_t factor);
+
+#endif
@@ -25,12 +25,27 @@ SOFTWARE.
 #define DETECTION_STAGE_H
 #include "ringbuffer.h"
 
-extern float rawMagnitudeMean;
+typedef struct detection_state_t detection_state_t;
+
+struct detection_state_t
+{
+    magnitude_t mean;
+    float rawMagnitudeMean;
+    deviation_t std;
+    time_accel_t count;
+    int16_t threshold_int;
+    int16_t threshold_frac;
+    time_accel_t warmup; /* samples to skip while mean and std converge */
+    data_point_t lastDataPoint;
+};
 
 void initDetectionStage(ring_buffer_t *inBuff, ring_buffer_t *outBuff, void (*nextStage)(void));
+void bindDetectionStage(detection_state_t *pState, ring_buffer_t *inBuff, ring_buffer_t *outBuff);
 void detectionStage(void);
 void resetDetection(void);
+void resumeDetection(void);
 void changeDetectionThreshold(int16_t whole, int16_t frac);
+void changeDetectionWarmup(time_accel_t samples);
 magnitude_t getMagAvg(void);
 
 #endif
\ No newline at end of file
@@ -25,7 +25,23 @@ SOFTWARE.
 #define FILTER_STAGE_H
 #include "ringbuffer.h"
 
+typedef struct filter_state_t filter_state_t;
+
+struct filter_state_t
+{
+    const int32_t *filterTaps; /* owned by the shared rate parameters, see rateConfig.c */
+    uint8_t filterTapNum;
+#ifdef SQUARED_MAGNITUDE
+    magnitude_t meanSquare; /* average of the squared magnitudes, which the filter removes */
+#endif
+};
+
 void initFilterStage(ring_buffer_t *inBuf, ring_buffer_t *outBuf, void (*pNextStage)(void));
+void bindFilterStage(filter_state_t *pState, ring_buffer_t *inBuf, ring_buffer_t *outBuf);
 void filterStage(void);
+void changeFilterTaps(const int32_t *taps, uint8_t tapNum);
+#ifdef SQUARED_MAGNITUDE
+magnitude_t getMeanSquare(void);
+#endif
 
 #endif
\ No newline at end of file
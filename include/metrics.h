@@ -0,0 +1,74 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+#include <stdatomic.h>
+#include "config.h"
+
+/**
+ * A consistent view of the results of one stream.
+ */
+typedef struct step_metrics_t step_metrics_t;
+
+struct step_metrics_t
+{
+    steps_t steps;
+    float distance;            /* same as getDistance() */
+    calorie_t calories;        /* same as getCalories() */
+    float stepsPerSec;         /* same as getStepsPerSec() */
+    time_accel_t lastStepTime; /* time of the last accepted step */
+};
+
+/**
+ * Metrics published by the processing thread with a sequence lock.
+ * The writer never waits, readers retry if they overlapped a write.
+ * Fields are atomics so that the concurrent accesses are well defined.
+ */
+typedef struct metrics_snapshot_t metrics_snapshot_t;
+
+struct metrics_snapshot_t
+{
+    _Atomic uint32_t sequence; /* odd while a write is in progress */
+    _Atomic steps_t steps;
+    _Atomic float distance;
+    _Atomic calorie_t calories;
+    _Atomic float stepsPerSec;
+    _Atomic time_accel_t lastStepTime;
+};
+
+/**
+ * Publishes new metrics, only one thread may write a snapshot.
+ * @param snapshot the snapshot to update
+ * @param metrics the values to publish
+ */
+void writeMetricsSnapshot(metrics_snapshot_t *snapshot, const step_metrics_t *metrics);
+
+/**
+ * Reads the last published metrics, can be called from any number of threads.
+ * @param snapshot the snapshot to read
+ * @param metrics where the values are copied
+ */
+void readMetricsSnapshot(metrics_snapshot_t *snapshot, step_metrics_t *metrics);
+
+#endif
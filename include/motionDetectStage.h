@@ -25,8 +25,33 @@ SOFTWARE.
 #define MOTIONDETECT_STAGE_H
 #include "ringbuffer.h"
 
-void initMotionDetectStage(ring_buffer_t *inBuf, ring_buffer_t *outBuf, void (*pNextStage)(void));
+typedef struct motion_detect_state_t motion_detect_state_t;
+
+struct motion_detect_state_t
+{
+    int motionThreshold;
+    ring_buffer_size_t motionWindow;
+    ring_buffer_size_t motionMinItems;
+    ring_buffer_size_t idleBacklog; /* samples kept while there is no motion, they delay the first steps */
+
+    /* Duty cycling: after idleConfirm samples without motion only the range is tracked */
+    uint16_t idleConfirm;     /* 0 disables it */
+    uint16_t idleCheckPeriod; /* samples between two checks of the range */
+    uint16_t stillCount;
+    uint16_t idleCount;
+    uint8_t idle;
+    magnitude_t idleMin;
+    magnitude_t idleMax;
+    time_accel_t idleSince;   /* idle time is booked up to here */
+};
+
+void initMotionDetectStage(ring_buffer_t *inBuf, ring_buffer_t *outBuf, void (*pNextStage)(void), void (*pWakeCallback)(void));
+void bindMotionDetectStage(motion_detect_state_t *pState, ring_buffer_t *inBuf, ring_buffer_t *outBuf);
 void motionDetectStage(void);
+void resetMotionDetect(void);
 void changeMotionThreshold(int16_t threshold);
+void changeMotionWindow(ring_buffer_size_t window, ring_buffer_size_t minItems);
+void changeIdleBacklog(ring_buffer_size_t samples);
+void changeIdleDutyCycle(uint16_t confirm, uint16_t checkPeriod);
 
 #endif
\ No newline at end of file
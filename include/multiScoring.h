@@ -0,0 +1,120 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "config.h"
+#include "ringbuffer.h"
+#include "rateConfig.h"
+
+/**
+ * @file
+ * Peak scores of the filtered signal for several window sizes in one pass.
+ * The recent samples are kept with the running sum of their magnitudes before
+ * each of them, so the sum of any window is one subtraction and the score of the
+ * midpoint, the mean of its differences to the other samples of the window, is
+ * (size * midpoint - sum) / (size - 1). Each window size costs the same whatever
+ * its length, and gives the same scores as scoringStage.
+ */
+
+#ifndef MULTI_SCORING_H
+#define MULTI_SCORING_H
+
+/** Window sizes scored at once. */
+#define MULTI_SCORING_WINDOWS 32
+
+/** Samples kept, a power of two larger than any window. */
+#define MULTI_SCORING_HISTORY 64
+
+_Static_assert((MULTI_SCORING_HISTORY & (MULTI_SCORING_HISTORY - 1)) == 0, "MULTI_SCORING_HISTORY must be a power of two");
+_Static_assert(MULTI_SCORING_HISTORY > MAX_WINDOW_SIZE, "MULTI_SCORING_HISTORY must hold the largest window");
+
+typedef struct multi_scoring_t multi_scoring_t;
+
+struct multi_scoring_t
+{
+  data_point_t points[MULTI_SCORING_HISTORY];
+  /** Sum of the magnitudes of the samples before each one, wraps around on purpose. */
+  uint64_t sums[MULTI_SCORING_HISTORY];
+  /** Samples since the last reset. */
+  uint32_t count;
+  /** Size of each window, 0 for a free slot. */
+  ring_buffer_size_t sizes[MULTI_SCORING_WINDOWS];
+  /** Samples before the midpoint in each window. */
+  ring_buffer_size_t midpoints[MULTI_SCORING_WINDOWS];
+};
+
+/**
+ * Empties the history and frees all windows.
+ * @param scoring The scoring to initialize.
+ */
+void multi_scoring_init(multi_scoring_t *scoring);
+
+/**
+ * Empties the history, the windows are kept. Like the scoring buffer, this is done
+ * when the motion detection restarts the windows.
+ * @param scoring The scoring.
+ */
+void multi_scoring_reset(multi_scoring_t *scoring);
+
+/**
+ * Takes a free window slot.
+ * @param scoring The scoring.
+ * @param size Samples in the window, from 3 to MAX_WINDOW_SIZE.
+ * @param midpoint Samples before the midpoint, below size.
+ * @return The slot; MULTI_SCORING_WINDOWS if they are all taken.
+ */
+uint8_t multi_scoring_add_window(multi_scoring_t *scoring, ring_buffer_size_t size, ring_buffer_size_t midpoint);
+
+/**
+ * Changes a window, its next score uses the samples already kept.
+ * @param scoring The scoring.
+ * @param slot The slot of the window.
+ * @param size Samples in the window, from 3 to MAX_WINDOW_SIZE.
+ * @param midpoint Samples before the midpoint, below size.
+ */
+void multi_scoring_set_window(multi_scoring_t *scoring, uint8_t slot, ring_buffer_size_t size, ring_buffer_size_t midpoint);
+
+/**
+ * Frees a window slot.
+ * @param scoring The scoring.
+ * @param slot The slot of the window.
+ */
+void multi_scoring_remove_window(multi_scoring_t *scoring, uint8_t slot);
+
+/**
+ * Adds the next filtered sample.
+ * @param scoring The scoring.
+ * @param point The sample.
+ */
+void multi_scoring_push(multi_scoring_t *scoring, const data_point_t *point);
+
+/**
+ * Scores the window of a slot ending at the last sample added.
+ * @param scoring The scoring.
+ * @param slot The slot of the window.
+ * @param score Where the score is written, with the time of the midpoint and its magnitude as orig_magnitude.
+ * @return 1 if the window is full; 0 if fewer samples were added since the last reset.
+ */
+uint8_t multi_scoring_score(const multi_scoring_t *scoring, uint8_t slot, data_point_t *score);
+
+#endif /* MULTI_SCORING_H */
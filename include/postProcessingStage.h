@@ -25,11 +25,22 @@ SOFTWARE.
 #define POST_PROCESSING_STAGE_H
 #include "ringbuffer.h"
 
-extern float meanPeakTime;
+typedef struct post_processing_state_t post_processing_state_t;
 
-void initPostProcessingStage(ring_buffer_t *pInBuff, void (*stepCallback)(void));
+struct post_processing_state_t
+{
+    steps_t stepCounter;
+    data_point_t lastDataPoint;
+    int16_t timeThreshold; /* in ms, this discards steps that are too close in time */
+    float meanPeakTime;
+    uint8_t pending; /* the last step can still be replaced by a bigger peak */
+};
+
+void initPostProcessingStage(ring_buffer_t *pInBuff, void (*stepCallback)(void), void (*confirmCallback)(void));
+void bindPostProcessingStage(post_processing_state_t *pState, ring_buffer_t *pInBuff);
 void postProcessingStage(void);
 void resetPostProcess(void);
+void confirmStep(time_accel_t time);
 void changeTimeThreshold(int16_t thresh);
 void increase_distance(int16_t stride);
 data_point_t getLastDataPoint(void);
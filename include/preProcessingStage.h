@@ -26,10 +26,28 @@ SOFTWARE.
 #include "config.h"
 #include "ringbuffer.h"
 
-extern uint32_t currentTime;
+typedef struct pre_process_state_t pre_process_state_t;
 
-void initPreProcessStage(ring_buffer_t *inBuff, ring_buffer_t *outBuff, void (*pNextStage)(void));
+struct pre_process_state_t
+{
+    uint8_t samplingPeriod;      /* in ms, one period of the sensor rate */
+    uint16_t timeScalingFactor;  /* use this for adjusting time to ms, in case the clock has higher precision */
+    time_accel_t lastSampleTime;
+    uint32_t currentTime;
+    time_accel_t gapThreshold;   /* in ms, longer gaps are skipped rather than interpolated */
+#ifdef TRACE_PIPELINE
+    uint32_t sequence;           /* sequence number of the last sample */
+#endif
+};
+
+void initPreProcessStage(ring_buffer_t *inBuff, ring_buffer_t *outBuff, void (*pNextStage)(void),
+                         void (*pGapCallback)(time_accel_t start, time_accel_t length));
+void bindPreProcessStage(pre_process_state_t *pState, ring_buffer_t *inBuff, ring_buffer_t *outBuff);
 void preProcessSample(time_accel_t time, accel_t x, accel_t y, accel_t z);
+void preProcessBurst(const uint8_t *fifo, uint16_t sampleCount, time_accel_t burstTime, uint16_t odrHz);
 void resetPreProcess(void);
+void changeSamplingPeriod(uint8_t period);
+void changeTimeScalingFactor(uint16_t factor);
+void changeGapThreshold(time_accel_t threshold);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef RATE_CONFIG_H
+#define RATE_CONFIG_H
+#include "config.h"
+#include "ringbuffer.h"
+
+/**
+ * Sampling rate at which the FIR taps, the motion window, the detection
+ * warm-up and the OPT_* constants in config.h were tuned.
+ */
+#define REFERENCE_RATE_HZ 50
+
+/* Range of sensor rates for which parameters can be derived */
+#define MIN_RATE_HZ 10
+#define MAX_RATE_HZ 200
+
+/* Faster sensors are decimated to MAX_RATE_HZ or below before the motion detection */
+#define MAX_SENSOR_RATE_HZ 1000
+
+/* Maximum number of FIR taps, the filter input buffer must hold this many points */
+#define MAX_FILTER_TAP_NUM 63
+
+/* Largest scoring window: OPT_WINDOWSIZE scaled to MAX_RATE_HZ, if a buffer can hold it */
+#define SCALED_MAX_WINDOW_SIZE ((OPT_WINDOWSIZE * MAX_RATE_HZ + REFERENCE_RATE_HZ / 2) / REFERENCE_RATE_HZ)
+#define MAX_WINDOW_SIZE (SCALED_MAX_WINDOW_SIZE < RING_BUFFER_MASK ? SCALED_MAX_WINDOW_SIZE : RING_BUFFER_MASK)
+
+/**
+ * All the parameters of the algorithm that depend on the sensor rate.
+ * These are derived once per rate and shared by every stream using that rate.
+ */
+typedef struct rate_params_t rate_params_t;
+
+struct rate_params_t
+{
+    uint16_t sampleRateHz;
+    ring_buffer_size_t motionWindow;    /* samples scanned for min/max by the motion gate */
+    ring_buffer_size_t motionMinItems;  /* samples needed before the motion gate runs */
+    time_accel_t detectionWarmup;       /* samples ignored by detection while mean/std converge */
+    ring_buffer_size_t windowSize;      /* OPT_WINDOWSIZE scaled to this rate */
+    uint16_t idleConfirm;               /* samples without motion before duty cycling */
+    uint16_t idleCheckPeriod;           /* samples between two motion checks while idle */
+    uint8_t filterTapNum;
+    int32_t filterTaps[MAX_FILTER_TAP_NUM];
+};
+
+/**
+ * Returns the parameters for the given rate, deriving them on first use.
+ * There is a slot for every rate from MIN_RATE_HZ to MAX_RATE_HZ, so any number of streams
+ * and rates can be in use, and subsequent calls with the same rate return the same shared instance.
+ * Not thread safe, call it while initialising streams; with THREAD_LOCAL_CONTEXTS
+ * derive the rates in use before the threads start.
+ * @param sampleRateHz the rate after decimation
+ * @return the parameters, NULL if the rate is out of range
+ */
+const rate_params_t *getRateParams(uint16_t sampleRateHz);
+
+#endif
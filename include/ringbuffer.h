@@ -46,12 +46,15 @@ struct data_point_t
   float weight;
   met_t met;
   time_accel_t peak_time; /* time since last peak detected */
+#ifdef TRACE_PIPELINE
+  uint32_t seq; /* sequence number of the sample, see tracer.h */
+#endif
 };
 /**
- * The size of a ring buffer.
- * Due to the design only <tt> RING_BUFFER_SIZE-1 </tt> items
- * can be contained in the buffer.
- * The buffer size must be a power of two.
+ * The largest size of a ring buffer, each buffer is given its own size.
+ * Due to the design only <tt> size-1 </tt> items
+ * can be contained in a buffer.
+ * The buffer sizes must be powers of two.
 */
 #define RING_BUFFER_SIZE 64
 
@@ -67,13 +70,15 @@ struct data_point_t
 typedef uint8_t ring_buffer_size_t;
 
 /**
- * Used as a modulo operator
- * as <tt> a % b = (a & (b − 1)) </tt>
- * where \c a is a positive index in the buffer and
- * \c b is the (power of two) size of the buffer.
+ * The most items a ring buffer can hold.
  */
 #define RING_BUFFER_MASK (RING_BUFFER_SIZE - 1)
 
+/**
+ * Smallest buffer size holding <em>n</em> items, for sizing buffers at compile time.
+ */
+#define RING_BUFFER_SIZE_FOR(n) ((n) < 2 ? 2 : (n) < 4 ? 4 : (n) < 8 ? 8 : (n) < 16 ? 16 : (n) < 32 ? 32 : 64)
+
 /**
  * Simplifies the use of <tt>struct ring_buffer_t</tt>.
  */
@@ -87,13 +92,28 @@ typedef struct ring_buffer_t ring_buffer_t;
 struct ring_buffer_t
 {
   /** Buffer memory. */
-  data_point_t buffer[RING_BUFFER_SIZE];
+  data_point_t *buffer;
+  /**
+   * Used as a modulo operator
+   * as <tt> a % b = (a & (b − 1)) </tt>
+   * where \c a is a positive index in the buffer and
+   * \c b is the (power of two) size of the buffer.
+   */
+  ring_buffer_size_t mask;
   /** Index of tail. */
   ring_buffer_size_t tail_index;
   /** Index of head. */
   ring_buffer_size_t head_index;
 };
 
+/**
+ * Gives a ring buffer its memory and empties it.
+ * @param buffer The ring buffer to set up.
+ * @param storage The memory of the buffer, <em>size</em> items.
+ * @param size The size of the buffer, a power of two up to \c RING_BUFFER_SIZE .
+ */
+void ring_buffer_setup(ring_buffer_t *buffer, data_point_t *storage, ring_buffer_size_t size);
+
 /**
  * Initializes the ring buffer pointed to by <em>buffer</em>.
  * This function can also be used to empty/reset the buffer.
@@ -142,7 +162,7 @@ inline uint8_t ring_buffer_is_empty(ring_buffer_t *buffer)
  */
 inline uint8_t ring_buffer_is_full(ring_buffer_t *buffer)
 {
-  return ((buffer->head_index - buffer->tail_index) & RING_BUFFER_MASK) == RING_BUFFER_MASK;
+  return ((buffer->head_index - buffer->tail_index) & buffer->mask) == buffer->mask;
 }
 
 /**
@@ -152,7 +172,17 @@ inline uint8_t ring_buffer_is_full(ring_buffer_t *buffer)
  */
 inline ring_buffer_size_t ring_buffer_num_items(ring_buffer_t *buffer)
 {
-  return ((buffer->head_index - buffer->tail_index) & RING_BUFFER_MASK);
+  return ((buffer->head_index - buffer->tail_index) & buffer->mask);
+}
+
+/**
+ * Returns the number of items a ring buffer can hold.
+ * @param buffer The buffer for which the capacity should be returned.
+ * @return One less than the size of the buffer.
+ */
+inline ring_buffer_size_t ring_buffer_capacity(ring_buffer_t *buffer)
+{
+  return buffer->mask;
 }
 
 #endif /* RINGBUFFER_H */
\ No newline at end of file
@@ -0,0 +1,103 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "config.h"
+
+/**
+ * @file
+ * Per-minute, per-hour and per-day totals of steps, distance and calories.
+ * Every level is a circular array of buckets indexed by time / period, a bucket
+ * that still holds an older period is cleared when it is reused. Steps and
+ * calories are added to all levels when they happen, so reading a bucket is O(1).
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#define ROLLUP_MINUTE 0
+#define ROLLUP_HOUR 1
+#define ROLLUP_DAY 2
+#define ROLLUP_LEVELS 3
+
+/** Buckets kept per level: the last hour by minute, the last day by hour, the last week by day. */
+#define ROLLUP_MINUTES 60
+#define ROLLUP_HOURS 24
+#define ROLLUP_DAYS 7
+
+typedef struct activity_bucket_t activity_bucket_t;
+
+struct activity_bucket_t
+{
+  /** Time of the bucket divided by the period of its level. */
+  int32_t period;
+  steps_t steps;
+  /** Meters. */
+  double distance;
+  /** kcal. */
+  double calories;
+};
+
+typedef struct rollup_t rollup_t;
+
+struct rollup_t
+{
+  activity_bucket_t minutes[ROLLUP_MINUTES];
+  activity_bucket_t hours[ROLLUP_HOURS];
+  activity_bucket_t days[ROLLUP_DAYS];
+};
+
+/**
+ * Empties all buckets.
+ * @param rollup The rollup to initialize.
+ */
+void rollup_init(rollup_t *rollup);
+
+/**
+ * Adds a step to the buckets of its time.
+ * @param rollup The rollup.
+ * @param time Time of the step in ms.
+ * @param distance Length of the step in meters.
+ */
+void rollup_add_step(rollup_t *rollup, time_accel_t time, double distance);
+
+/**
+ * Adds the calories burned over a time span, split over the buckets it covers.
+ * @param rollup The rollup.
+ * @param start Start of the span in ms.
+ * @param duration Length of the span in ms.
+ * @param calories kcal burned over the span.
+ */
+void rollup_add_calories(rollup_t *rollup, time_accel_t start, time_accel_t duration, double calories);
+
+/**
+ * Reads the bucket holding a given time.
+ * @param rollup The rollup.
+ * @param level ROLLUP_MINUTE, ROLLUP_HOUR or ROLLUP_DAY.
+ * @param time Any time within the bucket, in ms.
+ * @param bucket Where the bucket is copied, zeroed if nothing was recorded in it.
+ * @return 1 if the bucket is still kept; 0 if it is older than the level keeps or the level is invalid.
+ */
+uint8_t rollup_get(const rollup_t *rollup, uint8_t level, time_accel_t time, activity_bucket_t *bucket);
+
+#endif /* ROLLUP_H */
@@ -25,9 +25,19 @@ SOFTWARE.
 #define SCORING_STAGE_H
 #include "ringbuffer.h"
 
+typedef struct scoring_state_t scoring_state_t;
+
+struct scoring_state_t
+{
+    ring_buffer_size_t windowSize;
+    ring_buffer_size_t midpoint; /* half of size */
+};
+
 void initScoringStage(ring_buffer_t *inBuff, ring_buffer_t *outBuff, void (*pNextStage)(void));
+void bindScoringStage(scoring_state_t *pState, ring_buffer_t *inBuff, ring_buffer_t *outBuff);
 void scoringStage(void);
 
 void changeWindowSize(ring_buffer_size_t windowSize);
+void changeScoringLookahead(ring_buffer_size_t samples);
 
 #endif
\ No newline at end of file
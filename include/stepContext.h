@@ -0,0 +1,191 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef STEP_CONTEXT_H
+#define STEP_CONTEXT_H
+#include "config.h"
+#include "ringbuffer.h"
+#include "rateConfig.h"
+#include "metrics.h"
+#include "stepNotice.h"
+#include "calorieEngine.h"
+#include "stepLog.h"
+#include "rollup.h"
+#include "multiScoring.h"
+#include "preProcessingStage.h"
+#include "decimationStage.h"
+#include "motionDetectStage.h"
+#include "filterStage.h"
+#include "scoringStage.h"
+#include "detectionStage.h"
+#include "postProcessingStage.h"
+
+/* Size of each buffer, from the most items its consumer looks at */
+#define RAW_BUF_SIZE RING_BUFFER_SIZE_FOR(2)               /* the interpolation looks at the last 2 samples */
+#define PP_BUF_SIZE RING_BUFFER_SIZE_FOR(1)                /* the decimation takes every sample at once */
+#define DEC_BUF_SIZE RING_BUFFER_SIZE                      /* motion window at MAX_RATE_HZ and the idle backlog */
+#ifdef SKIP_FILTER
+#define MD_BUF_SIZE RING_BUFFER_SIZE_FOR(MAX_WINDOW_SIZE)  /* scoring window */
+#else
+#define MD_BUF_SIZE RING_BUFFER_SIZE_FOR(MAX_FILTER_TAP_NUM) /* FIR taps */
+#define SMOOTH_BUF_SIZE RING_BUFFER_SIZE_FOR(MAX_WINDOW_SIZE) /* scoring window */
+#endif
+#define PEAK_SCORE_BUF_SIZE RING_BUFFER_SIZE_FOR(1)        /* detection takes every score at once */
+#define PEAK_BUF_SIZE RING_BUFFER_SIZE_FOR(1)              /* post-processing takes every peak at once */
+
+/**
+ * Parameters of a shadow branch, in the units of the OPT_* constants in config.h.
+ */
+typedef struct shadow_params_t shadow_params_t;
+
+struct shadow_params_t
+{
+    ring_buffer_size_t windowSize;  /* OPT_WINDOWSIZE, scaled to the rate like it */
+    int16_t detectionThreshold;     /* OPT_DETECTION_THRESHOLD */
+    int16_t detectionThresholdFrac; /* OPT_DETECTION_THRESHOLD_FRAC */
+    int16_t timeThreshold;          /* OPT_TIME_THRESHOLD */
+};
+
+/**
+ * Results of a shadow branch, see addShadowBranch(). The primary steps are
+ * counted over the same samples, from when the branch was added.
+ */
+typedef struct shadow_stats_t shadow_stats_t;
+
+struct shadow_stats_t
+{
+    steps_t steps;
+    float distance;            /* same unit as getDistance() */
+    steps_t primarySteps;      /* steps of the primary pipeline meanwhile */
+    steps_t maxAhead;          /* most steps the branch was ever ahead of the primary */
+    steps_t maxBehind;         /* most steps it was ever behind */
+    time_accel_t lastStepTime; /* time of the last step of the branch */
+};
+
+/**
+ * A window of the shadow scoring, a detection and a post-processing fed with the
+ * same filtered samples as the primary ones of a context, see addShadowBranch().
+ * The buffers point into the branch, do not copy or move it while it is added.
+ */
+typedef struct shadow_branch_t shadow_branch_t;
+
+struct shadow_branch_t
+{
+    ring_buffer_t peakScoreBuf;
+    ring_buffer_t peakBuf;
+    data_point_t peakScoreStore[PEAK_SCORE_BUF_SIZE];
+    data_point_t peakStore[PEAK_BUF_SIZE];
+
+    uint8_t window; /* slot in the shadow scoring of the context */
+    detection_state_t detection;
+    post_processing_state_t postProcess;
+    calorie_state_t calories; /* the detection books its steps here, apart from the primary */
+
+    shadow_params_t params;
+    shadow_stats_t stats;
+    shadow_branch_t *next;
+};
+
+/**
+ * Everything the algorithm keeps for one stream: buffers, the state of each
+ * stage, the totals and the user data.
+ * Allocate one per wearer, initialize it with initContext() and select it
+ * with selectContext() before feeding its samples. The buffers point into the
+ * context, do not copy or move it once initialized.
+ */
+typedef struct step_context_t step_context_t;
+
+struct step_context_t
+{
+    /* Buffers */
+    ring_buffer_t rawBuf;
+    ring_buffer_t ppBuf;
+    ring_buffer_t decBuf;
+    ring_buffer_t mdBuf;
+#ifndef SKIP_FILTER
+    ring_buffer_t smoothBuf;
+#endif
+    ring_buffer_t peakScoreBuf;
+    ring_buffer_t peakBuf;
+
+    /* Buffer memory */
+    data_point_t rawStore[RAW_BUF_SIZE];
+    data_point_t ppStore[PP_BUF_SIZE];
+    data_point_t decStore[DEC_BUF_SIZE];
+    data_point_t mdStore[MD_BUF_SIZE];
+#ifndef SKIP_FILTER
+    data_point_t smoothStore[SMOOTH_BUF_SIZE];
+#endif
+    data_point_t peakScoreStore[PEAK_SCORE_BUF_SIZE];
+    data_point_t peakStore[PEAK_BUF_SIZE];
+
+    /* Stages */
+    pre_process_state_t preProcess;
+    decimation_state_t decimation;
+    motion_detect_state_t motionDetect;
+    filter_state_t filter;
+    scoring_state_t scoring;
+    detection_state_t detection;
+    post_processing_state_t postProcess;
+
+    /* Totals */
+    steps_t steps;
+    float distance;
+    calorie_state_t calories;
+    met_t met;
+    uint32_t gaps;
+    latency_stats_t latency;
+    uint8_t lowLatency;
+#ifdef TRACE_PIPELINE
+    uint16_t traceStream; /* stream of the events in the trace */
+#endif
+    void (*stepListener)(const step_notice_t *notice);
+    void (*stageTap)(uint8_t tap, const data_point_t *point);
+    shadow_branch_t *shadows; /* fed after the filter, see addShadowBranch() */
+    multi_scoring_t *shadowScoring; /* scores every shadow branch at once, see initShadowScoring() */
+
+    /* History of the accepted steps */
+    step_log_t stepLog;
+    rollup_t rollup;
+
+    /* Totals as last published for other threads */
+    metrics_snapshot_t metrics;
+
+    /* User data */
+    gender_t gender;
+    age_t age;
+    height_t height;
+    weight_t weight;
+    float bmr;
+    float bmrPerMinute;
+    float stride;
+
+    /* Rate dependent parameters, shared with other streams at the same rate */
+    uint16_t sensorRateHz;
+    const rate_params_t *rateParams; /* for the rate after decimation */
+};
+
+/* The context the stages are currently bound to, in this thread with THREAD_LOCAL_CONTEXTS */
+extern CONTEXT_LOCAL step_context_t *algoContext;
+
+#endif
@@ -0,0 +1,134 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "config.h"
+
+/**
+ * @file
+ * Append-only log of the accepted steps.
+ * Steps are delta-encoded in fixed size blocks. Every block starts with the
+ * time of its first step and the number of steps and distance before it, so
+ * the blocks double as a sparse time index: range queries binary search the
+ * blocks and decode a single one. When all blocks are used the oldest one is
+ * dropped.
+ */
+
+#ifndef STEP_LOG_H
+#define STEP_LOG_H
+
+/** Number of blocks kept. */
+#define STEP_LOG_BLOCKS 32
+
+/** Encoded bytes per block. */
+#define STEP_LOG_BLOCK_BYTES 256
+
+/** Largest encoded step: time, interval and magnitude varints and the weight byte. */
+#define STEP_LOG_MAX_ENTRY (5 + 5 + 10 + 1)
+
+/** Weights are stored in steps of 1 / STEP_LOG_WEIGHT_SCALE. */
+#define STEP_LOG_WEIGHT_SCALE 4
+
+typedef struct step_event_t step_event_t;
+
+/**
+ * One accepted step.
+ */
+struct step_event_t
+{
+  time_accel_t time;
+  magnitude_t magnitude; /* raw magnitude of the peak */
+  time_accel_t interval; /* time since the previous step */
+  float weight;          /* stride weight, distance is magnitude * weight */
+};
+
+typedef struct step_log_block_t step_log_block_t;
+
+struct step_log_block_t
+{
+  /** Time of the first step in the block. */
+  time_accel_t first_time;
+  /** Steps logged before the block. */
+  uint32_t steps_before;
+  /** Distance logged before the block. */
+  double distance_before;
+  /** Steps in the block. */
+  uint16_t count;
+  /** Bytes of data used. */
+  uint16_t used;
+  /** Encoded steps. */
+  uint8_t data[STEP_LOG_BLOCK_BYTES];
+};
+
+typedef struct step_log_t step_log_t;
+
+struct step_log_t
+{
+  step_log_block_t blocks[STEP_LOG_BLOCKS];
+  /** Index of the oldest block. */
+  uint8_t first_block;
+  /** Number of blocks in use. */
+  uint8_t block_count;
+  /** Steps and distance logged so far, dropped blocks included. */
+  uint32_t steps;
+  double distance;
+  /** Last step of the newest block, the base of the next delta. */
+  step_event_t last;
+};
+
+/**
+ * Empties the log.
+ * @param log The log to initialize.
+ */
+void step_log_init(step_log_t *log);
+
+/**
+ * Appends a step. Steps must be appended in time order.
+ * @param log The log.
+ * @param event The step.
+ */
+void step_log_append(step_log_t *log, const step_event_t *event);
+
+/**
+ * Counts the steps in <tt>[from, to)</tt> in logarithmic time.
+ * Steps in dropped blocks are not counted.
+ * @param log The log.
+ * @param from Start of the range.
+ * @param to End of the range, excluded.
+ * @param distance If not NULL, where the distance walked in the range is written.
+ * @return The number of steps in the range.
+ */
+uint32_t step_log_range(const step_log_t *log, time_accel_t from, time_accel_t to, double *distance);
+
+/**
+ * Decodes the steps at or after a given time, oldest first.
+ * Call again with the time of the last exported step + 1 to continue.
+ * @param log The log.
+ * @param since Time of the first step to export.
+ * @param events Where the steps are written.
+ * @param max Size of <em>events</em>.
+ * @return The number of steps written.
+ */
+uint32_t step_log_export(const step_log_t *log, time_accel_t since, step_event_t *events, uint32_t max);
+
+#endif /* STEP_LOG_H */
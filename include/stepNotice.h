@@ -0,0 +1,68 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef STEP_NOTICE_H
+#define STEP_NOTICE_H
+#include "config.h"
+
+/**
+ * Detection latency of the accepted steps: time from the sample of the peak
+ * to the input sample whose processing accepted the step.
+ */
+typedef struct latency_stats_t latency_stats_t;
+
+struct latency_stats_t
+{
+    time_accel_t lastMs;
+    uint16_t lastSamples;
+    time_accel_t maxMs;
+    uint32_t count;
+    uint64_t totalMs;
+};
+
+/* Kinds of step notices */
+#define STEP_PROVISIONAL 0 /* the step was just accepted */
+#define STEP_CONFIRMED 1   /* no bigger peak can replace it anymore */
+
+/* Outputs handed to the stage tap */
+#define TAP_FILTERED 0 /* filtered magnitude, the motion detection output with SKIP_FILTER */
+#define TAP_SCORE 1    /* peak score */
+#define TAP_PEAK 2     /* peak found by the detection */
+
+/**
+ * Sent to the step listener for every accepted step, first provisional then confirmed.
+ * The confirmed notice has the final time and magnitude of the peak.
+ */
+typedef struct step_notice_t step_notice_t;
+
+struct step_notice_t
+{
+    uint8_t kind;
+    time_accel_t time;       /* time of the peak */
+    magnitude_t magnitude;
+    time_accel_t latencyMs;  /* input time - peak time */
+    uint16_t latencySamples;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include "config.h"
+
+/**
+ * @file
+ * Timeline of the stages for replays and field debugging.
+ * Every sample gets a sequence number in the pre-processing that follows it
+ * through the stages (the decimation and the filter keep the one of the newest
+ * input, the scoring the one of the midpoint). The entry and exit of each stage
+ * and its decisions are recorded in a ring in memory, which is exported in the
+ * Chrome trace format (chrome://tracing, ui.perfetto.dev).
+ * Only built with TRACE_PIPELINE, the hooks compile to nothing otherwise.
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+/** Events kept, the oldest are overwritten. Must be a power of two. */
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 131072
+#endif
+
+/* Kinds of events */
+#define TRACE_BEGIN 0  /* a stage is entered */
+#define TRACE_END 1    /* a stage returns */
+#define TRACE_DECIDE 2 /* a stage decided on a sample */
+
+/* Stages */
+#define TRACE_PRE_PROCESS 0
+#define TRACE_DECIMATION 1
+#define TRACE_MOTION 2
+#define TRACE_FILTER 3
+#define TRACE_SCORING 4
+#define TRACE_DETECTION 5
+#define TRACE_POST_PROCESSING 6
+
+/* Decisions */
+#define TRACE_GAP 0      /* samples missing before this one, the windows start over */
+#define TRACE_GATED 1    /* dropped by the motion detection */
+#define TRACE_IDLE 2     /* no motion for a while, only the range is checked */
+#define TRACE_WAKE 3     /* motion again */
+#define TRACE_PEAK 4     /* peak found by the detection */
+#define TRACE_STEP 5     /* peak accepted as a step */
+#define TRACE_REJECTED 6 /* peak dropped for a bigger one within the time threshold */
+
+typedef struct trace_event_t trace_event_t;
+
+/**
+ * One event. Begin and end events carry the sequence number of the input sample
+ * being processed, decisions the one of the sample decided on.
+ */
+struct trace_event_t
+{
+  uint64_t timestamp; /* ns of the trace clock */
+  uint32_t seq;
+  time_accel_t time;  /* time of the sample decided on */
+  uint16_t stream;    /* context, see trace_select_stream() */
+  uint8_t kind;
+  uint8_t what;       /* stage or decision */
+};
+
+/**
+ * Empties the ring.
+ */
+void trace_reset(void);
+
+/**
+ * Sets the clock of the timestamps, in ns. By default timespec_get() is used.
+ * @param clock The clock, NULL for the default.
+ */
+void trace_set_clock(uint64_t (*clock)(void));
+
+/**
+ * Sets the stream the next events belong to, one per context.
+ * @param stream The stream.
+ */
+void trace_select_stream(uint16_t stream);
+
+/**
+ * Sets the input sample the next begin and end events belong to.
+ * @param seq Sequence number of the sample.
+ */
+void trace_sample(uint32_t seq);
+
+/**
+ * Sends the next events to an observer instead of the ring, e.g. to read counters
+ * around each stage. The observer runs inside the stages, it must be short.
+ * @param observer The observer, NULL to record in the ring again.
+ */
+void trace_set_observer(void (*observer)(uint8_t kind, uint8_t what));
+
+/**
+ * Pauses the recording, e.g. while a service sheds load. Events are dropped
+ * before the clock is read.
+ * @param paused 1 to drop the events, 0 to record them again.
+ */
+void trace_pause(uint8_t paused);
+
+/**
+ * Records an event. Only the processing thread records events, the ring can be
+ * read by another thread at the same time.
+ * @param kind TRACE_BEGIN, TRACE_END or TRACE_DECIDE.
+ * @param what The stage or the decision.
+ * @param seq Sequence number of the sample decided on, ignored for the other kinds.
+ * @param time Time of the sample decided on.
+ */
+void trace_record(uint8_t kind, uint8_t what, uint32_t seq, time_accel_t time);
+
+/**
+ * Copies the events in the ring, oldest first. Events overwritten while copying
+ * are left out.
+ * @param events Where the events are written.
+ * @param max Size of <em>events</em>.
+ * @return The number of events written.
+ */
+uint32_t trace_snapshot(trace_event_t *events, uint32_t max);
+
+/**
+ * Writes the events in the ring as a Chrome trace, starting at the first sample
+ * whose events are all in the ring. Timestamps are relative to the first event.
+ * @param file Where the JSON is written.
+ * @return The number of events written.
+ */
+uint32_t trace_write_chrome(FILE *file);
+
+#ifdef TRACE_PIPELINE
+#define TRACE_STAGE_BEGIN(stage) trace_record(TRACE_BEGIN, stage, 0, 0)
+#define TRACE_STAGE_END(stage) trace_record(TRACE_END, stage, 0, 0)
+#define TRACE_DECISION(decision, dp) trace_record(TRACE_DECIDE, decision, (dp).seq, (dp).time)
+#define TRACE_TAG(to, from) ((to).seq = (from).seq)
+#else
+#define TRACE_STAGE_BEGIN(stage) ((void)0)
+#define TRACE_STAGE_END(stage) ((void)0)
+#define TRACE_DECISION(decision, dp) ((void)0)
+#define TRACE_TAG(to, from) ((void)0)
+#endif
+
+#endif /* TRACER_H */
@@ -0,0 +1,344 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Python extension running whole recordings through the pipeline in one call.
+ * The time, X, Y and Z arrays are read in place through the buffer protocol (NumPy
+ * arrays, array.array, memoryviews...), any integer or float item type, and the GIL
+ * is released while the samples are processed. Every call runs its own context and
+ * the stages are bound per thread (THREAD_LOCAL_CONTEXTS), so calls from several
+ * threads run in parallel. Outputs come back as typed memoryviews that NumPy wraps
+ * without copying, see stepcounter/__init__.py.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+
+#include "StepCountingAlgo.h"
+
+#ifndef THREAD_LOCAL_CONTEXTS
+#error "the calls release the GIL, the stages must be bound per thread"
+#endif
+
+#define TAPS 3
+
+typedef struct series_t series_t;
+
+/* Times and values collected while the GIL is released */
+struct series_t
+{
+    time_accel_t *time;
+    magnitude_t *value;
+    size_t count;
+    size_t capacity;
+    int failed;
+};
+
+typedef struct run_t run_t;
+
+struct run_t
+{
+    Py_buffer inputs[4];
+    series_t steps; /* peak times of the accepted steps */
+    size_t confirmed;
+    series_t taps[TAPS];
+    int tapping;
+};
+
+/* Run of the call the thread is in, for the listeners */
+static _Thread_local run_t *current;
+
+static const char *tapNames[TAPS] = {"filtered", "score", "peaks"};
+
+static void append(series_t *series, time_accel_t time, magnitude_t value)
+{
+    if (series->count == series->capacity)
+    {
+        size_t capacity = series->capacity ? series->capacity * 2 : 1024;
+        time_accel_t *t = realloc(series->time, capacity * sizeof(*t));
+        magnitude_t *v = realloc(series->value, capacity * sizeof(*v));
+        if (t)
+            series->time = t;
+        if (v)
+            series->value = v;
+        if (!t || !v)
+        {
+            series->failed = 1;
+            return;
+        }
+        series->capacity = capacity;
+    }
+    series->time[series->count] = time;
+    series->value[series->count] = value;
+    series->count++;
+}
+
+static void onStep(const step_notice_t *notice)
+{
+    if (notice->kind == STEP_PROVISIONAL)
+        append(&current->steps, notice->time, notice->magnitude);
+    else if (current->confirmed < current->steps.count)
+    {
+        /* the confirmed notice has the final peak */
+        current->steps.time[current->confirmed] = notice->time;
+        current->steps.value[current->confirmed] = notice->magnitude;
+        current->confirmed++;
+    }
+}
+
+static void onTap(uint8_t tap, const data_point_t *point)
+{
+    append(&current->taps[tap], point->time, point->magnitude);
+}
+
+/* Item i of a buffer of any integer or float type, NaN as 0, strided like a column of an (N, 4) array */
+static int64_t item(const Py_buffer *view, Py_ssize_t i)
+{
+    const char *p = (const char *)view->buf + i * (view->ndim ? view->strides[0] : view->itemsize);
+    switch (view->format ? view->format[strspn(view->format, "@=<>!")] : 'B')
+    {
+    case 'b':
+        return *(const signed char *)p;
+    case 'B':
+        return *(const unsigned char *)p;
+    case 'h':
+        return *(const short *)p;
+    case 'H':
+        return *(const unsigned short *)p;
+    case 'i':
+        return *(const int *)p;
+    case 'I':
+        return *(const unsigned int *)p;
+    case 'l':
+        return *(const long *)p;
+    case 'L':
+        return (int64_t) * (const unsigned long *)p;
+    case 'q':
+        return *(const long long *)p;
+    case 'Q':
+        return (int64_t) * (const unsigned long long *)p;
+    case 'f':
+    {
+        float f = *(const float *)p;
+        return f == f ? (int64_t)(f < 0 ? f - 0.5f : f + 0.5f) : 0;
+    }
+    default: /* 'd', checked by supported() */
+    {
+        double d = *(const double *)p;
+        return d == d ? (int64_t)(d < 0 ? d - 0.5 : d + 0.5) : 0;
+    }
+    }
+}
+
+static int supported(const Py_buffer *view)
+{
+    const char *format = view->format ? view->format + strspn(view->format, "@=<>!") : "B";
+    return view->ndim <= 1 && strlen(format) == 1 && strchr("bBhHiIlLqQfd", format[0]) != NULL &&
+           (view->format == NULL || view->format[0] != '<' || PY_LITTLE_ENDIAN) &&
+           (view->format == NULL || (view->format[0] != '>' && view->format[0] != '!') || PY_BIG_ENDIAN);
+}
+
+static accel_t clampAccel(int64_t value)
+{
+    return (accel_t)(value < -32768 ? -32768 : value > 32767 ? 32767 : value);
+}
+
+/* Number of items of a buffer, 1 for a scalar */
+static Py_ssize_t items(const Py_buffer *view)
+{
+    return view->ndim ? view->shape[0] : 1;
+}
+
+/* Bytes of a series as a typed memoryview */
+static PyObject *view(const void *data, size_t count, size_t itemSize, const char *format)
+{
+    PyObject *bytes = PyBytes_FromStringAndSize(data, (Py_ssize_t)(count * itemSize));
+    if (!bytes)
+        return NULL;
+    PyObject *raw = PyMemoryView_FromObject(bytes);
+    Py_DECREF(bytes);
+    if (!raw)
+        return NULL;
+    PyObject *typed = PyObject_CallMethod(raw, "cast", "s", format);
+    Py_DECREF(raw);
+    return typed;
+}
+
+/* {"time": ..., "value": ...} */
+static PyObject *seriesDict(const series_t *series)
+{
+    PyObject *time = view(series->time, series->count, sizeof(time_accel_t), "i");
+    PyObject *value = view(series->value, series->count, sizeof(magnitude_t), "q");
+    PyObject *dict = time && value ? Py_BuildValue("{s:O,s:O}", "time", time, "value", value) : NULL;
+    Py_XDECREF(time);
+    Py_XDECREF(value);
+    return dict;
+}
+
+static void freeRun(run_t *run)
+{
+    for (int i = 0; i < 4; i++)
+        if (run->inputs[i].obj)
+            PyBuffer_Release(&run->inputs[i]);
+    free(run->steps.time);
+    free(run->steps.value);
+    for (int t = 0; t < TAPS; t++)
+    {
+        free(run->taps[t].time);
+        free(run->taps[t].value);
+    }
+}
+
+static PyObject *process(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"time", "x", "y", "z", "rate_hz", "gender", "age", "height", "weight", "stages", NULL};
+    PyObject *arrays[4];
+    PyObject *rate = NULL;
+    Py_ssize_t rateHz = SAMPLE_RATE_HZ;
+    const char *gender = "M";
+    unsigned char age = 30, height = 180, weight = 80;
+    int stages = 0;
+    (void)self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO|$Osbbbp", keywords, &arrays[0], &arrays[1], &arrays[2],
+                                     &arrays[3], &rate, &gender, &age, &height, &weight, &stages))
+        return NULL;
+
+    /* initContext checks the range, but only once the rate fits its argument */
+    if (rate != NULL)
+    {
+        rateHz = PyNumber_AsSsize_t(rate, NULL); /* saturates rather than overflowing */
+        if (rateHz == -1 && PyErr_Occurred())
+            return NULL;
+    }
+    if (rateHz < 0 || rateHz > UINT16_MAX)
+    {
+        PyErr_Format(PyExc_ValueError, "unsupported rate %S Hz", rate);
+        return NULL;
+    }
+
+    run_t run;
+    memset(&run, 0, sizeof(run));
+    run.tapping = stages;
+    for (int i = 0; i < 4; i++)
+    {
+        if (PyObject_GetBuffer(arrays[i], &run.inputs[i], PyBUF_STRIDES | PyBUF_FORMAT) < 0)
+        {
+            freeRun(&run);
+            return NULL;
+        }
+        if (!supported(&run.inputs[i]) || items(&run.inputs[i]) != items(&run.inputs[0]))
+        {
+            PyErr_SetString(PyExc_ValueError, "time, x, y and z must be 1-d arrays of numbers of the same length");
+            freeRun(&run);
+            return NULL;
+        }
+    }
+    Py_ssize_t count = items(&run.inputs[0]);
+
+    step_context_t *context = malloc(sizeof(step_context_t));
+    if (!context)
+    {
+        freeRun(&run);
+        return PyErr_NoMemory();
+    }
+
+    uint8_t initialized;
+    steps_t steps = 0;
+    float distance = 0;
+    calorie_t calories = 0;
+    char genderCopy[2] = {gender[0], 0};
+    Py_BEGIN_ALLOW_THREADS
+    current = &run;
+    initialized = initContext(context, genderCopy, age, height, weight, (uint16_t)rateHz, 1);
+    if (initialized)
+    {
+        setStepListener(onStep);
+        setStageTap(stages ? onTap : NULL);
+        for (Py_ssize_t i = 0; i < count; i++)
+            processSample((time_accel_t)item(&run.inputs[0], i), clampAccel(item(&run.inputs[1], i)),
+                          clampAccel(item(&run.inputs[2], i)), clampAccel(item(&run.inputs[3], i)));
+        setStepListener(NULL);
+        setStageTap(NULL);
+        steps = getSteps();
+        distance = getDistance();
+        calories = getCalories();
+    }
+    current = NULL;
+    Py_END_ALLOW_THREADS
+    free(context);
+
+    if (!initialized)
+    {
+        PyErr_Format(PyExc_ValueError, "unsupported rate %zd Hz", rateHz);
+        freeRun(&run);
+        return NULL;
+    }
+    int failed = run.steps.failed;
+    for (int t = 0; t < TAPS; t++)
+        failed |= run.taps[t].failed;
+    if (failed)
+    {
+        freeRun(&run);
+        return PyErr_NoMemory();
+    }
+
+    PyObject *result = Py_BuildValue("{s:I,s:d,s:d}", "steps", (unsigned int)steps, "distance", (double)distance,
+                                     "calories", (double)calories);
+    PyObject *stepTimes = view(run.steps.time, run.steps.count, sizeof(time_accel_t), "i");
+    if (!result || !stepTimes || PyDict_SetItemString(result, "step_times", stepTimes) < 0)
+        Py_CLEAR(result);
+    Py_XDECREF(stepTimes);
+    for (int t = 0; t < TAPS && result && stages; t++)
+    {
+        PyObject *series = seriesDict(&run.taps[t]);
+        if (!series || PyDict_SetItemString(result, tapNames[t], series) < 0)
+            Py_CLEAR(result);
+        Py_XDECREF(series);
+    }
+    freeRun(&run);
+    return result;
+}
+
+static PyMethodDef methods[] = {
+    {"process", (PyCFunction)(void (*)(void))process, METH_VARARGS | METH_KEYWORDS,
+     "process(time, x, y, z, *, rate_hz=50, gender='M', age=30, height=180, weight=80, stages=False)\n"
+     "Runs a recording through a fresh pipeline and returns a dict with steps, distance, calories\n"
+     "and step_times; with stages=True also the filtered, score and peaks series."},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef module = {PyModuleDef_HEAD_INIT, "_stepcounter", NULL, -1, methods, NULL, NULL, NULL, NULL};
+
+PyMODINIT_FUNC PyInit__stepcounter(void)
+{
+    /* deriving the parameters of a rate on first use is not thread safe */
+    for (uint16_t rateHz = MIN_RATE_HZ; rateHz <= MAX_RATE_HZ; rateHz++)
+        getRateParams(rateHz);
+    PyObject *m = PyModule_Create(&module);
+    if (m)
+        PyModule_AddIntConstant(m, "SAMPLE_RATE_HZ", SAMPLE_RATE_HZ);
+    return m;
+}
@@ -0,0 +1,34 @@
+"""Step counting on whole recordings, see _stepcounter.c.
+
+process() takes the time, x, y and z arrays of a recording (NumPy arrays or anything
+else exposing the buffer protocol) and returns a dict with steps, distance, calories and
+step_times; with stages=True also the filtered, score and peaks series as dicts of
+time and value arrays. The arrays are NumPy arrays when NumPy is installed.
+"""
+
+from . import _stepcounter
+
+try:
+    import numpy as _np
+except ImportError:
+    _np = None
+
+SAMPLE_RATE_HZ = _stepcounter.SAMPLE_RATE_HZ
+
+__all__ = ["process", "SAMPLE_RATE_HZ"]
+
+
+def _arrays(value):
+    if isinstance(value, dict):
+        return {key: _arrays(item) for key, item in value.items()}
+    if isinstance(value, memoryview) and _np is not None:
+        return _np.asarray(value)
+    return value
+
+
+def process(time, x, y, z, **options):
+    """Runs a recording through a fresh pipeline, the GIL is released meanwhile.
+
+    Options: rate_hz, gender ('M' or 'F'), age, height, weight and stages.
+    """
+    return _arrays(_stepcounter.process(time, x, y, z, **options))
@@ -30,47 +30,246 @@ SOFTWARE.
 #include "scoringStage.h"
 #include "detectionStage.h"
 #include "postProcessingStage.h"
+#include "rateConfig.h"
+#include "stepContext.h"
+#include "tracer.h"
 
 #include "string.h"
 #include <stdio.h>
 
 #define STRIDECONST 0.414
 
-/* General data */
-static met_t met;
-static float bmrPerMinute;
-float stride;
-
-static steps_t steps;
-static float distance;
+/* Context used by the single stream API */
+static step_context_t defaultContext;
+
+/* Set once initContext() has chained the stages, the chain is the same for every context */
+static CONTEXT_LOCAL uint8_t stagesChained;
+
+#ifdef TRACE_PIPELINE
+static uint16_t traceStreams; /* streams handed out so far */
+
+/* The stages are chained through these when tracing, the pre-processing traces itself */
+#define TRACED_STAGE(stage, what) \
+    static void traced_##stage(void) \
+    {                                \
+        TRACE_STAGE_BEGIN(what);     \
+        stage();                     \
+        TRACE_STAGE_END(what);       \
+    }
+TRACED_STAGE(decimationStage, TRACE_DECIMATION)
+TRACED_STAGE(motionDetectStage, TRACE_MOTION)
+#ifndef SKIP_FILTER
+TRACED_STAGE(filterStage, TRACE_FILTER)
+#endif
+TRACED_STAGE(scoringStage, TRACE_SCORING)
+TRACED_STAGE(detectionStage, TRACE_DETECTION)
+TRACED_STAGE(postProcessingStage, TRACE_POST_PROCESSING)
+#define STAGE(stage) traced_##stage
+#else
+#define STAGE(stage) stage
+#endif
 
 /* Extern variables */
-float bmr;
-double kcalories;
-
-/* User data */
-static gender_t gender;
-static age_t age;
-static height_t height;
-static weight_t weight;
-
-/* Buffers */
-static ring_buffer_t rawBuf;
-static ring_buffer_t ppBuf;
-static ring_buffer_t mdBuf;
-#ifndef SKIP_FILTER
-static ring_buffer_t smoothBuf;
+CONTEXT_LOCAL step_context_t *algoContext = &defaultContext;
+
+/* Shadow branch the scoring, detection and post-processing are bound to, NULL for the primary ones */
+static CONTEXT_LOCAL shadow_branch_t *runningShadow;
+
+/* Hands the output a stage just queued to the stage tap, before the next stage reads it */
+static void tapNewest(ring_buffer_t *buffer, uint8_t tap)
+{
+    data_point_t point;
+    if (ring_buffer_peek(buffer, &point, ring_buffer_num_items(buffer) - 1))
+        (*algoContext->stageTap)(tap, &point);
+}
+
+#define TAPPED_STAGE(stage, buffer, tap)             \
+    static void tapped_##stage(void)                 \
+    {                                                \
+        if (algoContext->stageTap && !runningShadow) \
+            tapNewest(&algoContext->buffer, tap);    \
+        STAGE(stage)();                              \
+    }
+#ifdef SKIP_FILTER
+TAPPED_STAGE(scoringStage, mdBuf, TAP_FILTERED)
+#else
+TAPPED_STAGE(scoringStage, smoothBuf, TAP_FILTERED)
 #endif
-static ring_buffer_t peakScoreBuf;
-static ring_buffer_t peakBuf;
+TAPPED_STAGE(detectionStage, peakScoreBuf, TAP_SCORE)
+TAPPED_STAGE(postProcessingStage, peakBuf, TAP_PEAK)
 
 static void increaseMET();
 static void increaseDistance();
+static void logStep(void);
+static void notifyStep(uint8_t kind);
+static void countShadowStep(void);
+static void writeMetrics(void);
  
 static void increaseStepCallback(void)
 {
-    steps++;
+    if (runningShadow)
+    {
+        countShadowStep();
+        return;
+    }
+
+    algoContext->steps++;
     increaseDistance();
+    logStep();
+    notifyStep(STEP_PROVISIONAL);
+    writeMetrics();
+
+    for (shadow_branch_t *branch = algoContext->shadows; branch != NULL; branch = branch->next)
+        branch->stats.primarySteps++;
+}
+
+static void confirmStepCallback(void)
+{
+    if (!runningShadow)
+        notifyStep(STEP_CONFIRMED);
+}
+
+/* Input of the scoring: the filtered samples */
+static ring_buffer_t *scoringInput(step_context_t *ctx)
+{
+#ifdef SKIP_FILTER
+    return &ctx->mdBuf;
+#else
+    return &ctx->smoothBuf;
+#endif
+}
+
+/* Chains the detection and post-processing, for the context or a shadow branch */
+static void initBackEnd(ring_buffer_t *peakScoreBuf, ring_buffer_t *peakBuf)
+{
+    initDetectionStage(peakScoreBuf, peakBuf, tapped_postProcessingStage);
+    initPostProcessingStage(peakBuf, &increaseStepCallback, &confirmStepCallback);
+}
+
+static void bindBackEnd(step_context_t *ctx)
+{
+    runningShadow = NULL;
+    bindCalorieEngine(&ctx->calories);
+    bindScoringStage(&ctx->scoring, scoringInput(ctx), &ctx->peakScoreBuf);
+    bindDetectionStage(&ctx->detection, &ctx->peakScoreBuf, &ctx->peakBuf);
+    bindPostProcessingStage(&ctx->postProcess, &ctx->peakBuf);
+}
+
+static void bindShadow(shadow_branch_t *branch)
+{
+    runningShadow = branch;
+    bindCalorieEngine(&branch->calories);
+    bindDetectionStage(&branch->detection, &branch->peakScoreBuf, &branch->peakBuf);
+    bindPostProcessingStage(&branch->postProcess, &branch->peakBuf);
+}
+
+/* Applies the parameters of a bound branch at the rate and latency mode of the context */
+static void configureShadow(step_context_t *ctx, shadow_branch_t *branch)
+{
+    const shadow_params_t *params = &branch->params;
+    uint32_t windowSize = ((uint32_t)params->windowSize * ctx->rateParams->sampleRateHz + REFERENCE_RATE_HZ / 2) / REFERENCE_RATE_HZ;
+
+    if (windowSize < 3)
+        windowSize = 3;
+    if (windowSize > MAX_WINDOW_SIZE)
+        windowSize = MAX_WINDOW_SIZE;
+    /* same midpoint as changeWindowSize() and changeScoringLookahead() give the primary */
+    ring_buffer_size_t midpoint = windowSize / 2;
+    if (ctx->lowLatency)
+        midpoint = windowSize - 1 - windowSize / 4;
+    multi_scoring_set_window(ctx->shadowScoring, branch->window, (ring_buffer_size_t)windowSize, midpoint);
+    changeDetectionWarmup(ctx->rateParams->detectionWarmup);
+    changeDetectionThreshold(params->detectionThreshold, params->detectionThresholdFrac);
+    changeTimeThreshold(params->timeThreshold);
+}
+
+/* Compared once the primary and the branch both had the sample */
+static void trackDivergence(shadow_branch_t *branch)
+{
+    shadow_stats_t *stats = &branch->stats;
+
+    if (stats->steps > stats->primarySteps && stats->steps - stats->primarySteps > stats->maxAhead)
+        stats->maxAhead = stats->steps - stats->primarySteps;
+    if (stats->primarySteps > stats->steps && stats->primarySteps - stats->steps > stats->maxBehind)
+        stats->maxBehind = stats->primarySteps - stats->steps;
+}
+
+/* Hands the newest filtered sample to the primary scoring, then scores it once for every shadow branch */
+static void fanOutScoring(void)
+{
+    step_context_t *ctx = algoContext;
+    ring_buffer_t *window = scoringInput(ctx);
+    data_point_t point;
+
+    if (ctx->shadows == NULL || !ring_buffer_peek(window, &point, ring_buffer_num_items(window) - 1))
+    {
+        tapped_scoringStage();
+        return;
+    }
+
+    tapped_scoringStage();
+    multi_scoring_push(ctx->shadowScoring, &point);
+    for (shadow_branch_t *branch = ctx->shadows; branch != NULL; branch = branch->next)
+    {
+        data_point_t score;
+        if (multi_scoring_score(ctx->shadowScoring, branch->window, &score))
+        {
+            ring_buffer_queue(&branch->peakScoreBuf, score);
+            bindShadow(branch);
+            tapped_detectionStage();
+        }
+        trackDivergence(branch);
+    }
+    bindBackEnd(ctx);
+}
+
+static void countShadowStep(void)
+{
+    shadow_branch_t *branch = runningShadow;
+    data_point_t lastDataPoint = getLastDataPoint();
+
+    branch->stats.steps++;
+    branch->stats.distance += lastDataPoint.orig_magnitude * lastDataPoint.weight / 1000;
+    branch->stats.lastStepTime = lastDataPoint.time;
+}
+
+/* Empties the windows after the motion detection, they fill again from the next sample */
+static void restartWindows(void)
+{
+    step_context_t *ctx = algoContext;
+
+    ring_buffer_init(&ctx->mdBuf);
+#ifndef SKIP_FILTER
+    ring_buffer_init(&ctx->smoothBuf);
+#endif
+    ring_buffer_init(&ctx->peakScoreBuf);
+    resumeDetection();
+
+    if (ctx->shadows == NULL)
+        return;
+    multi_scoring_reset(ctx->shadowScoring);
+    for (shadow_branch_t *branch = ctx->shadows; branch != NULL; branch = branch->next)
+    {
+        ring_buffer_init(&branch->peakScoreBuf);
+        bindShadow(branch);
+        resumeDetection();
+    }
+    bindBackEnd(ctx);
+}
+
+/* Skips a dropout of the input: the windowed stages start over and the gap is booked as idle time */
+static void skipGap(time_accel_t start, time_accel_t length)
+{
+    step_context_t *ctx = algoContext;
+
+    ring_buffer_init(&ctx->ppBuf);
+    ring_buffer_init(&ctx->decBuf);
+    resetDecimation();
+    resetMotionDetect();
+    restartWindows();
+
+    bookIdleTime(start, length);
+    ctx->gaps++;
 }
 
 static void increaseDistance() 
@@ -78,63 +277,224 @@ static void increaseDistance()
     /* compute distance dynamically */
     data_point_t lastDataPoint = getLastDataPoint();
 
-    distance += lastDataPoint.orig_magnitude * lastDataPoint.weight;
+    algoContext->distance += lastDataPoint.orig_magnitude * lastDataPoint.weight;
+}
+
+static void logStep(void)
+{
+    data_point_t lastDataPoint = getLastDataPoint();
+    step_event_t event;
+
+    event.time = lastDataPoint.time;
+    event.magnitude = lastDataPoint.orig_magnitude;
+    event.interval = lastDataPoint.peak_time;
+    event.weight = lastDataPoint.weight;
+    step_log_append(&algoContext->stepLog, &event);
+
+    rollup_add_step(&algoContext->rollup, event.time, (double)event.magnitude * event.weight / 1000);
+}
+
+/* Measures the detection latency of the last step and tells the listener about it */
+static void notifyStep(uint8_t kind)
+{
+    step_context_t *ctx = algoContext;
+    data_point_t lastDataPoint = getLastDataPoint();
+    step_notice_t notice;
+
+    notice.kind = kind;
+    notice.time = lastDataPoint.time;
+    notice.magnitude = lastDataPoint.orig_magnitude;
+    notice.latencyMs = (time_accel_t)ctx->preProcess.currentTime - lastDataPoint.time;
+    notice.latencySamples = (uint16_t)((int64_t)notice.latencyMs * ctx->rateParams->sampleRateHz / 1000);
+
+    if (kind == STEP_PROVISIONAL)
+    {
+        ctx->latency.lastMs = notice.latencyMs;
+        ctx->latency.lastSamples = notice.latencySamples;
+        if (notice.latencyMs > ctx->latency.maxMs)
+            ctx->latency.maxMs = notice.latencyMs;
+        ctx->latency.totalMs += notice.latencyMs;
+        ctx->latency.count++;
+    }
+
+    if (ctx->stepListener)
+        (*ctx->stepListener)(&notice);
+}
+
+/* Adds the calories of each interval integrated by the calorie engine to the rollups, not those of shadow branches */
+static void rollupCalories(time_accel_t start, time_accel_t duration, double energy)
+{
+    if (runningShadow)
+        return;
+    rollup_add_calories(&algoContext->rollup, start, duration, energy / 24 / 60 / 60 / 1000);
 }
 
 void initUserData(char* userGender, uint8_t userAge, uint8_t userHeight, uint8_t userWeight) 
 {
+    step_context_t *ctx = algoContext;
+
     /* init user information */
-    gender = userGender;
-    age = userAge;
-    height = userHeight;
-    weight = userWeight;
-    kcalories = 0;
+    ctx->gender = userGender;
+    ctx->age = userAge;
+    ctx->height = userHeight;
+    ctx->weight = userWeight;
+    resetCalories();
 
     /* init mbr */
-    bmr = strcmp(gender, "F") == 0 ? 
-            (9.56 * weight) + (1.85 * height) - (4.68 * age) + 655 :
-            (13.75 * weight) + (5 * height) - (6.76 * age) + 66;
-    bmrPerMinute = bmr / (24 * 60); /* convert to bmr per min */
+    ctx->bmr = strcmp(ctx->gender, "F") == 0 ? 
+            (9.56 * ctx->weight) + (1.85 * ctx->height) - (4.68 * ctx->age) + 655 :
+            (13.75 * ctx->weight) + (5 * ctx->height) - (6.76 * ctx->age) + 66;
+    ctx->bmrPerMinute = ctx->bmr / (24 * 60); /* convert to bmr per min */
+    changeBmr(ctx->bmr); /* bmr per ms of idle time */
 
     /* init static stride length */
-    float height_float = height;
-    stride = (height_float / 100) * STRIDECONST;
+    float height_float = ctx->height;
+    ctx->stride = (height_float / 100) * STRIDECONST;
 }
 
 void initAlgo(char* gender, uint8_t age, uint8_t height, uint8_t weight)
 {
+    initAlgoWithRate(gender, age, height, weight, SAMPLE_RATE_HZ, TIME_SCALING_FACTOR);
+}
+
+uint8_t initAlgoWithRate(char* gender, uint8_t age, uint8_t height, uint8_t weight,
+                         uint16_t sampleRateHz, uint16_t timeScalingFactor)
+{
+    return initContext(&defaultContext, gender, age, height, weight, sampleRateHz, timeScalingFactor);
+}
+
+/* Rate out of the decimation, to the nearest Hz as the factor need not divide the rate of the sensor */
+static uint16_t decimatedRate(uint16_t sensorRateHz, uint8_t factor)
+{
+    return (sensorRateHz + factor / 2) / factor;
+}
+
+/* Parameters of the stages after the decimation */
+static void applyRateParams(const rate_params_t *rateParams)
+{
+    changeMotionWindow(rateParams->motionWindow, rateParams->motionMinItems);
+    changeFilterTaps(rateParams->filterTaps, rateParams->filterTapNum);
+    changeDetectionWarmup(rateParams->detectionWarmup);
+    changeIdleDutyCycle(IDLE_CONFIRM_MS > 0 ? rateParams->idleConfirm : 0, rateParams->idleCheckPeriod);
+    changeWindowSize(rateParams->windowSize);
+}
+
+uint8_t initContext(step_context_t *ctx, char* gender, uint8_t age, uint8_t height, uint8_t weight,
+                    uint16_t sampleRateHz, uint16_t timeScalingFactor)
+{
+    if (sampleRateHz == 0 || sampleRateHz > MAX_SENSOR_RATE_HZ || timeScalingFactor == 0)
+        return 0;
+
+    /* Sensors faster than MAX_RATE_HZ are decimated by the smallest factor that brings them to it or below */
+    uint16_t factor = (sampleRateHz + MAX_RATE_HZ - 1) / MAX_RATE_HZ;
+    if (factor > MAX_DECIMATION_FACTOR)
+        return 0;
+
+    const rate_params_t *rateParams = getRateParams(decimatedRate(sampleRateHz, factor));
+    if (rateParams == NULL)
+        return 0;
+
+    memset(ctx, 0, sizeof(step_context_t));
+    ctx->sensorRateHz = sampleRateHz;
+    ctx->rateParams = rateParams;
+#ifdef TRACE_PIPELINE
+    ctx->traceStream = traceStreams++;
+#endif
+    selectContext(ctx);
+
     /* Set user data */
     initUserData(gender, age, height, weight);
 
     /* Init buffers */
-    ring_buffer_init(&rawBuf);
-    ring_buffer_init(&ppBuf);
-    ring_buffer_init(&mdBuf);
+    ring_buffer_setup(&ctx->rawBuf, ctx->rawStore, RAW_BUF_SIZE);
+    ring_buffer_setup(&ctx->ppBuf, ctx->ppStore, PP_BUF_SIZE);
+    ring_buffer_setup(&ctx->decBuf, ctx->decStore, DEC_BUF_SIZE);
+    ring_buffer_setup(&ctx->mdBuf, ctx->mdStore, MD_BUF_SIZE);
 #ifndef SKIP_FILTER
-    ring_buffer_init(&smoothBuf);
+    ring_buffer_setup(&ctx->smoothBuf, ctx->smoothStore, SMOOTH_BUF_SIZE);
 #endif
-    ring_buffer_init(&peakScoreBuf);
-    ring_buffer_init(&peakBuf);
+    ring_buffer_setup(&ctx->peakScoreBuf, ctx->peakScoreStore, PEAK_SCORE_BUF_SIZE);
+    ring_buffer_setup(&ctx->peakBuf, ctx->peakStore, PEAK_BUF_SIZE);
+    step_log_init(&ctx->stepLog);
+    rollup_init(&ctx->rollup);
 
-    initPreProcessStage(&rawBuf, &ppBuf, motionDetectStage);
+    initPreProcessStage(&ctx->rawBuf, &ctx->ppBuf, STAGE(decimationStage), skipGap);
+    initDecimationStage(&ctx->ppBuf, &ctx->decBuf, STAGE(motionDetectStage));
 #ifdef SKIP_FILTER
-    initMotionDetectStage(&ppBuf, &mdBuf, scoringStage);
-    initScoringStage(&mdBuf, &peakScoreBuf, detectionStage);
+    initMotionDetectStage(&ctx->decBuf, &ctx->mdBuf, fanOutScoring, restartWindows);
 #else
-    initMotionDetectStage(&ppBuf, &mdBuf, filterStage);
-    initFilterStage(&mdBuf, &smoothBuf, scoringStage);
-    initScoringStage(&smoothBuf, &peakScoreBuf, detectionStage);
+    initMotionDetectStage(&ctx->decBuf, &ctx->mdBuf, STAGE(filterStage), restartWindows);
+    initFilterStage(&ctx->mdBuf, &ctx->smoothBuf, fanOutScoring);
 #endif
-    initDetectionStage(&peakScoreBuf, &peakBuf, postProcessingStage);
-    initPostProcessingStage(&peakBuf, &increaseStepCallback);
+    initScoringStage(scoringInput(ctx), &ctx->peakScoreBuf, tapped_detectionStage);
+    initBackEnd(&ctx->peakScoreBuf, &ctx->peakBuf);
+    initCalorieEngine(rollupCalories);
+    stagesChained = 1;
+
+    /* Set rate dependent parameters, the interpolation runs at the sensor rate */
+    changeTimeScalingFactor(timeScalingFactor);
+    changeSamplingPeriod(1000 / sampleRateHz);
+    changeDecimationFactor(factor);
+    applyRateParams(rateParams);
 
     /* Set parameters */
-    changeWindowSize(OPT_WINDOWSIZE);
     changeDetectionThreshold(OPT_DETECTION_THRESHOLD, OPT_DETECTION_THRESHOLD_FRAC);
     changeTimeThreshold(OPT_TIME_THRESHOLD);
     changeMotionThreshold(MOTION_THRESHOLD);
 
-    currentTime = 0;
+    publishMetrics();
+    return 1;
+}
+
+void selectContext(step_context_t *ctx)
+{
+    algoContext = ctx;
+#ifdef TRACE_PIPELINE
+    trace_select_stream(ctx->traceStream);
+#endif
+
+    bindPreProcessStage(&ctx->preProcess, &ctx->rawBuf, &ctx->ppBuf);
+    bindDecimationStage(&ctx->decimation, &ctx->ppBuf, &ctx->decBuf);
+    bindMotionDetectStage(&ctx->motionDetect, &ctx->decBuf, &ctx->mdBuf);
+#ifndef SKIP_FILTER
+    bindFilterStage(&ctx->filter, &ctx->mdBuf, &ctx->smoothBuf);
+#endif
+    bindBackEnd(ctx);
+}
+
+uint8_t relocateContext(step_context_t *ctx, char* gender)
+{
+    if (ctx->decimation.factor == 0)
+        return 0;
+    const rate_params_t *rateParams = getRateParams(decimatedRate(ctx->sensorRateHz, ctx->decimation.factor));
+    if (rateParams == NULL)
+        return 0;
+    if (!stagesChained)
+        initContext(&defaultContext, gender, ctx->age, ctx->height, ctx->weight, SAMPLE_RATE_HZ, TIME_SCALING_FACTOR);
+
+    /* Pointers into the context, to the rate parameters and to the earlier process */
+    ctx->rawBuf.buffer = ctx->rawStore;
+    ctx->ppBuf.buffer = ctx->ppStore;
+    ctx->decBuf.buffer = ctx->decStore;
+    ctx->mdBuf.buffer = ctx->mdStore;
+#ifndef SKIP_FILTER
+    ctx->smoothBuf.buffer = ctx->smoothStore;
+#endif
+    ctx->peakScoreBuf.buffer = ctx->peakScoreStore;
+    ctx->peakBuf.buffer = ctx->peakStore;
+    ctx->rateParams = rateParams;
+    ctx->filter.filterTaps = rateParams->filterTaps;
+    ctx->gender = gender;
+    ctx->stepListener = NULL;
+    ctx->stageTap = NULL;
+    ctx->shadows = NULL;
+    ctx->shadowScoring = NULL;
+#ifdef TRACE_PIPELINE
+    ctx->traceStream = traceStreams++;
+#endif
+
+    selectContext(ctx);
+    return 1;
 }
 
 void processSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
@@ -142,59 +502,274 @@ void processSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
     preProcessSample(time, x, y, z);
 }
 
+void processFifoBurst(const uint8_t *fifo, uint16_t sampleCount, time_accel_t burstTime, uint16_t odrHz)
+{
+    preProcessBurst(fifo, sampleCount, burstTime, odrHz);
+    publishMetrics();
+}
+
 void resetSteps(void)
 {
-    steps = 0;
-    distance = 0;
-    met = 0;
-    kcalories = 0;
+    algoContext->steps = 0;
+    algoContext->distance = 0;
+    algoContext->met = 0;
+    resetCalories();
+    publishMetrics();
+
+    for (shadow_branch_t *branch = algoContext->shadows; branch != NULL; branch = branch->next)
+        memset(&branch->stats, 0, sizeof(branch->stats));
 }
 
 void resetAlgo(void)
 {
+    step_context_t *ctx = algoContext;
+
     resetPreProcess();
+    resetDecimation();
+    resetMotionDetect();
     resetDetection();
     resetPostProcess();
-    ring_buffer_init(&rawBuf);
-    ring_buffer_init(&ppBuf);
-    ring_buffer_init(&mdBuf);
+    ring_buffer_init(&ctx->rawBuf);
+    ring_buffer_init(&ctx->ppBuf);
+    ring_buffer_init(&ctx->decBuf);
+    ring_buffer_init(&ctx->mdBuf);
 #ifndef SKIP_FILTER
-    ring_buffer_init(&smoothBuf);
+    ring_buffer_init(&ctx->smoothBuf);
 #endif
-    ring_buffer_init(&peakScoreBuf);
-    ring_buffer_init(&peakBuf);
-
-    kcalories = 0;
-    met = 0;
-    distance = 0;
+    ring_buffer_init(&ctx->peakScoreBuf);
+    ring_buffer_init(&ctx->peakBuf);
+
+    if (ctx->shadowScoring)
+        multi_scoring_reset(ctx->shadowScoring);
+    for (shadow_branch_t *branch = ctx->shadows; branch != NULL; branch = branch->next)
+    {
+        ring_buffer_init(&branch->peakScoreBuf);
+        ring_buffer_init(&branch->peakBuf);
+        bindShadow(branch);
+        resetDetection();
+        resetPostProcess();
+        resetCalories();
+    }
+    bindBackEnd(ctx);
+
+    resetCalories();
+    ctx->met = 0;
+    ctx->distance = 0;
+    publishMetrics();
 }
 
 steps_t getSteps(void)
 {
-    return steps;
+    return algoContext->steps;
 }
 
 float getDistance(void) {
     /* constant stride length distance computation */
     // float static_dist = steps * stride;
 
-    float total_dist = distance / 1000;
+    float total_dist = algoContext->distance / 1000;
     
     return total_dist;
 }
 
 float getStepsPerSec(void) {
     data_point_t lastDataPoint = getLastDataPoint();
-    float stepsPerSec = (float)steps / ((float)lastDataPoint.time / 1000);
+    float stepsPerSec = (float)algoContext->steps / ((float)lastDataPoint.time / 1000);
 
     return stepsPerSec;
 }
 
+/* Converts bmr * MET * ms to calories, the bmr is per day */
+static calorie_t toCalories(double energy)
+{
+    return energy / 24 / 60 / 60 / 1000;
+}
+
 calorie_t getCalories(void) 
 {
-    return (kcalories / 24 / 60 / 60 / 1000); /* convert to calories from calorie per day to ms of activity */
+    return toCalories(integrateCalories());
+}
+
+steps_t getStepsBetween(time_accel_t from, time_accel_t to)
+{
+    return step_log_range(&algoContext->stepLog, from, to, NULL);
+}
+
+float getDistanceBetween(time_accel_t from, time_accel_t to)
+{
+    double distance;
+    step_log_range(&algoContext->stepLog, from, to, &distance);
+    return distance / 1000;
+}
+
+uint32_t exportSteps(time_accel_t since, step_event_t *events, uint32_t max)
+{
+    return step_log_export(&algoContext->stepLog, since, events, max);
+}
+
+uint8_t changeDecimation(uint8_t factor)
+{
+    step_context_t *ctx = algoContext;
+
+    if (factor == 0 || factor > MAX_DECIMATION_FACTOR)
+        return 0;
+    const rate_params_t *rateParams = getRateParams(decimatedRate(ctx->sensorRateHz, factor));
+    if (rateParams == NULL)
+        return 0;
+
+    ctx->rateParams = rateParams;
+    changeDecimationFactor(factor);
+    applyRateParams(rateParams);
+    changeLatencyMode(ctx->lowLatency);
+
+    ring_buffer_init(&ctx->decBuf);
+    resetMotionDetect();
+    restartWindows();
+    return 1;
+}
+
+void changeLatencyMode(uint8_t lowLatency)
+{
+    step_context_t *ctx = algoContext;
+    const rate_params_t *rateParams = ctx->rateParams;
+
+    ctx->lowLatency = lowLatency;
+    if (lowLatency)
+    {
+        /* Keep no backlog while idle, decide on motion as soon as one window is there
+           and look ahead a quarter of the scoring window */
+        changeMotionWindow(rateParams->motionWindow, rateParams->motionWindow);
+        changeIdleBacklog(rateParams->motionWindow);
+        changeScoringLookahead(ctx->scoring.windowSize / 4);
+    }
+    else
+    {
+        changeMotionWindow(rateParams->motionWindow, rateParams->motionMinItems);
+        changeIdleBacklog(ring_buffer_capacity(&ctx->decBuf));
+        changeWindowSize(ctx->scoring.windowSize);
+    }
+
+    for (shadow_branch_t *branch = ctx->shadows; branch != NULL; branch = branch->next)
+    {
+        bindShadow(branch);
+        configureShadow(ctx, branch);
+    }
+    bindBackEnd(ctx);
+}
+
+void setStepListener(void (*listener)(const step_notice_t *notice))
+{
+    algoContext->stepListener = listener;
+}
+
+void setStageTap(void (*tap)(uint8_t tap, const data_point_t *point))
+{
+    algoContext->stageTap = tap;
+}
+
+void initShadowScoring(multi_scoring_t *scoring)
+{
+    step_context_t *ctx = algoContext;
+
+    multi_scoring_init(scoring);
+    ctx->shadowScoring = scoring;
+    for (shadow_branch_t *branch = ctx->shadows; branch != NULL; branch = branch->next)
+    {
+        branch->window = multi_scoring_add_window(scoring, 3, 1);
+        bindShadow(branch);
+        configureShadow(ctx, branch);
+    }
+    bindBackEnd(ctx);
+}
+
+uint8_t addShadowBranch(shadow_branch_t *branch, const shadow_params_t *params)
+{
+    step_context_t *ctx = algoContext;
+
+    if (ctx->shadowScoring == NULL)
+        return 0;
+    uint8_t window = multi_scoring_add_window(ctx->shadowScoring, 3, 1);
+    if (window == MULTI_SCORING_WINDOWS)
+        return 0;
+    if (ctx->shadows == NULL)
+        multi_scoring_reset(ctx->shadowScoring); /* not fed since the last branch was removed */
+
+    memset(branch, 0, sizeof(shadow_branch_t));
+    branch->params = *params;
+    branch->window = window;
+    ring_buffer_setup(&branch->peakScoreBuf, branch->peakScoreStore, PEAK_SCORE_BUF_SIZE);
+    ring_buffer_setup(&branch->peakBuf, branch->peakStore, PEAK_BUF_SIZE);
+
+    bindShadow(branch);
+    changeBmr(ctx->bmr);
+    initBackEnd(&branch->peakScoreBuf, &branch->peakBuf);
+    configureShadow(ctx, branch);
+    bindBackEnd(ctx);
+
+    branch->next = ctx->shadows;
+    ctx->shadows = branch;
+    return 1;
+}
+
+uint8_t removeShadowBranch(shadow_branch_t *branch)
+{
+    for (shadow_branch_t **link = &algoContext->shadows; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == branch)
+        {
+            multi_scoring_remove_window(algoContext->shadowScoring, branch->window);
+            *link = branch->next;
+            branch->next = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void getShadowStats(const shadow_branch_t *branch, shadow_stats_t *stats)
+{
+    *stats = branch->stats;
+}
+
+void getLatencyStats(latency_stats_t *stats)
+{
+    *stats = algoContext->latency;
+}
+
+uint8_t getActivity(uint8_t level, time_accel_t time, activity_bucket_t *bucket)
+{
+    integrateCalories();
+    return rollup_get(&algoContext->rollup, level, time, bucket);
+}
+
+uint32_t getGaps(void)
+{
+    return algoContext->gaps;
 }
 
 float getMeanAvg(void) {
-    return meanPeakTime;
+    return algoContext->postProcess.meanPeakTime;
+}
+
+/* Publishes the calories booked so far, their intervals are integrated at the end of the batch */
+static void writeMetrics(void)
+{
+    step_metrics_t metrics;
+    metrics.steps = getSteps();
+    metrics.distance = getDistance();
+    metrics.calories = toCalories(bookedCalories());
+    metrics.stepsPerSec = getStepsPerSec();
+    metrics.lastStepTime = getLastDataPoint().time;
+    writeMetricsSnapshot(&algoContext->metrics, &metrics);
+}
+
+void publishMetrics(void)
+{
+    integrateCalories();
+    writeMetrics();
+}
+
+void getMetrics(step_context_t *ctx, step_metrics_t *metrics)
+{
+    readMetricsSnapshot(ctx != NULL ? &ctx->metrics : &defaultContext.metrics, metrics);
 }
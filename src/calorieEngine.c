@@ -0,0 +1,131 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <string.h>
+#include "calorieEngine.h"
+
+/* Upper magnitude bound of each step MET class, the last class has no bound */
+static const magnitude_t metClassBounds[MET_CLASS_COUNT - 2] = {200, 500, 800, 1000, 1500, 2000, 2500};
+static const met_t metTable[MET_CLASS_COUNT] = {1, 1, 2, 5, 10, 13, 15, 17, 23};
+
+static CONTEXT_LOCAL calorie_state_t *state;
+static CONTEXT_LOCAL void (*energyCallback)(time_accel_t start, time_accel_t duration, double energy);
+
+void initCalorieEngine(void (*pEnergyCallback)(time_accel_t start, time_accel_t duration, double energy))
+{
+    energyCallback = pEnergyCallback;
+}
+
+void bindCalorieEngine(calorie_state_t *pState)
+{
+    state = pState;
+}
+
+void resetCalories(void)
+{
+    state->logCount = 0;
+    state->loggedMetMs = 0;
+    state->kcalories = 0;
+}
+
+void changeBmr(float bmr)
+{
+    integrateCalories();
+    state->bmr = bmr;
+}
+
+uint8_t metClassOf(magnitude_t magnitude)
+{
+    uint8_t metClass = 1;
+    for (uint8_t i = 0; i < MET_CLASS_COUNT - 2; i++)
+        metClass += magnitude >= metClassBounds[i];
+    return metClass;
+}
+
+met_t metOfClass(uint8_t metClass)
+{
+    return metTable[metClass];
+}
+
+static void book(time_accel_t start, time_accel_t duration, uint8_t metClass)
+{
+    state->loggedMetMs += (uint64_t)metTable[metClass] * duration;
+    if (state->logCount > 0 && state->log[state->logCount - 1].metClass == metClass)
+    {
+        state->log[state->logCount - 1].duration += duration;
+        state->log[state->logCount - 1].metMs += (uint64_t)metTable[metClass] * duration;
+        return;
+    }
+
+    if (state->logCount == ACTIVITY_LOG_SIZE)
+    {
+        /* integer work only, the energy is kept and only its spread over time is lost */
+        activity_interval_t *oldest = &state->log[0];
+        oldest->duration = state->log[1].start + state->log[1].duration - oldest->start;
+        oldest->metMs += state->log[1].metMs;
+        oldest->metClass = MET_CLASS_COUNT;
+        memmove(&state->log[1], &state->log[2], (ACTIVITY_LOG_SIZE - 2) * sizeof(activity_interval_t));
+        state->logCount--;
+    }
+
+    activity_interval_t *interval = &state->log[state->logCount++];
+    interval->start = start;
+    interval->duration = duration;
+    interval->metMs = (uint64_t)metTable[metClass] * duration;
+    interval->metClass = metClass;
+}
+
+void bookIdleTime(time_accel_t start, time_accel_t duration)
+{
+    book(start, duration, MET_CLASS_IDLE);
+}
+
+void bookStep(time_accel_t start, time_accel_t duration, uint8_t metClass)
+{
+    book(start, duration, metClass);
+}
+
+double integrateCalories(void)
+{
+    for (uint8_t i = 0; i < state->logCount; i++)
+    {
+        activity_interval_t *interval = &state->log[i];
+        double energy = (double)state->bmr * interval->metMs;
+        state->kcalories += energy;
+        if (energyCallback)
+            (*energyCallback)(interval->start, interval->duration, energy);
+    }
+    state->logCount = 0;
+    state->loggedMetMs = 0;
+    return state->kcalories;
+}
+
+double integratedCalories(void)
+{
+    return state->kcalories;
+}
+
+double bookedCalories(void)
+{
+    return state->kcalories + (double)state->bmr * state->loggedMetMs;
+}
@@ -0,0 +1,113 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "decimationStage.h"
+
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
+
+static CONTEXT_LOCAL decimation_state_t *state;
+
+void initDecimationStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void))
+{
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+    nextStage = pNextStage;
+    changeDecimationFactor(1);
+}
+
+void bindDecimationStage(decimation_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
+void decimationStage(void)
+{
+    data_point_t dataPoint;
+    ring_buffer_dequeue(inBuff, &dataPoint);
+
+    if (state->factor == 1)
+    {
+        ring_buffer_queue(outBuff, dataPoint);
+        (*nextStage)();
+        return;
+    }
+
+    uint64_t value = (uint64_t)dataPoint.magnitude;
+    for (uint8_t i = 0; i < CIC_ORDER; i++)
+    {
+        state->integrators[i] += value;
+        value = state->integrators[i];
+    }
+
+    if (++state->phase < state->factor)
+        return;
+    state->phase = 0;
+
+    for (uint8_t i = 0; i < CIC_ORDER; i++)
+    {
+        uint64_t difference = value - state->combs[i];
+        state->combs[i] = value;
+        value = difference;
+    }
+
+    if (state->warmup > 0)
+    {
+        state->warmup--;
+        return;
+    }
+
+    /* the time of the newest input, like the FIR output */
+    dataPoint.magnitude = (int64_t)value / state->gain;
+    dataPoint.orig_magnitude = dataPoint.magnitude;
+    ring_buffer_queue(outBuff, dataPoint);
+    (*nextStage)();
+}
+
+void resetDecimation(void)
+{
+    state->phase = 0;
+    state->warmup = CIC_ORDER;
+    for (uint8_t i = 0; i < CIC_ORDER; i++)
+    {
+        state->integrators[i] = 0;
+        state->combs[i] = 0;
+    }
+}
+
+void changeDecimationFactor(uint8_t factor)
+{
+    if (factor < 1)
+        factor = 1;
+    if (factor > MAX_DECIMATION_FACTOR)
+        factor = MAX_DECIMATION_FACTOR;
+
+    state->factor = factor;
+    state->gain = 1;
+    for (uint8_t i = 0; i < CIC_ORDER; i++)
+        state->gain *= factor;
+    resetDecimation();
+}
@@ -25,6 +25,10 @@ SOFTWARE.
 #include "detectionStage.h"
 #include "postProcessingStage.h"
 #include "StepCountingAlgo.h"
+#include "stepContext.h"
+#include "calorieEngine.h"
+#include "filterStage.h"
+#include "tracer.h"
 #include "config.h"
 
 #ifdef DUMP_FILE
@@ -34,133 +38,154 @@ static FILE
 static FILE *detectionFile;
 #endif
 
-static ring_buffer_t *inBuff;
-static ring_buffer_t *outBuff;
-static void (*nextStage)(void);
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
 
-static double kcal = 0;
-data_point_t lastDataPoint;
-
-static magnitude_t mean = 0;
-float rawMagnitudeMean = 0;
-static accumulator_t std = 0;
-static time_accel_t count = 0;
-static int16_t threshold_int = 0;
-static int16_t threshold_frac = 6;
+static CONTEXT_LOCAL detection_state_t *state;
 
 void initDetectionStage(ring_buffer_t *pInBuff, ring_buffer_t *peakBufIn, void (*pNextStage)(void))
 {
     inBuff = pInBuff;
     outBuff = peakBufIn;
     nextStage = pNextStage;
-    rawMagnitudeMean = 0;
-    mean = 0;
-    std = 0;
+    state->rawMagnitudeMean = 0;
+    state->mean = 0;
+    state->std = 0;
 
 #ifdef DUMP_FILE
-    detectionFile = fopen(DUMP_DETECTION_FILE_NAME, "w+");
+    if (!detectionFile)
+        detectionFile = fopen(DUMP_DETECTION_FILE_NAME, "w+");
+#endif
+}
+
+void bindDetectionStage(detection_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
+#ifdef SQUARED_MAGNITUDE
+/*
+Back to plain magnitudes, once per peak. Around a magnitude m a difference of squares
+is about 2 m times the difference of magnitudes, which scales the score. Without the
+filter the peak is a square, else the filter removed the average magnitude m and
+scaled the rest by 2 m as well.
+*/
+static void unsquarePeak(data_point_t *dataPoint)
+{
+#ifdef SKIP_FILTER
+    magnitude_t root = (magnitude_t)sqrt((double)dataPoint->orig_magnitude);
+    dataPoint->orig_magnitude = root;
+#else
+    magnitude_t root = (magnitude_t)sqrt((double)getMeanSquare());
+    if (root > 0)
+        dataPoint->orig_magnitude /= 2 * root;
 #endif
+    if (root > 0)
+        dataPoint->magnitude /= 2 * root;
 }
+#endif
 
 void detectionStage(void)
 {
     if (!ring_buffer_is_empty(inBuff))
     {
-        accumulator_t oMean = mean;
+        deviation_t oMean = state->mean;
         data_point_t dataPoint;
         ring_buffer_dequeue(inBuff, &dataPoint);
-        count++;
-        if (count == 1)
+        state->count++;
+        if (state->count == 1)
         {
-            mean = dataPoint.magnitude;
-            std = 0;
-            lastDataPoint = dataPoint;
-            rawMagnitudeMean = (float)dataPoint.orig_magnitude;
+            state->mean = dataPoint.magnitude;
+            state->std = 0;
+            state->lastDataPoint = dataPoint;
+            state->rawMagnitudeMean = (float)dataPoint.orig_magnitude;
         }
-        else if (count == 2)
+        else if (state->count == 2)
         {
-            mean = (mean + dataPoint.magnitude) / 2;
-            rawMagnitudeMean = (float) (rawMagnitudeMean + (float)dataPoint.orig_magnitude) / 2.0;
-            std = sqrt(((dataPoint.magnitude - mean) * (dataPoint.magnitude - mean)) + ((oMean - mean) * (oMean - mean))) / 2;
+            state->mean = (state->mean + dataPoint.magnitude) / 2;
+            state->rawMagnitudeMean = (float) (state->rawMagnitudeMean + (float)dataPoint.orig_magnitude) / 2.0;
+            state->std = sqrt(((dataPoint.magnitude - state->mean) * (dataPoint.magnitude - state->mean)) + ((oMean - state->mean) * (oMean - state->mean))) / 2;
         }
         else
         {
-            mean = (dataPoint.magnitude + ((count - 1) * mean)) / count;
-            rawMagnitudeMean = (float)(dataPoint.orig_magnitude + (float)((count - 1) * rawMagnitudeMean)) / (float)count;
-            accumulator_t part1 = ((std * std) / (count - 1)) * (count - 2);
-            accumulator_t part2 = ((oMean - mean) * (oMean - mean));
-            accumulator_t part3 = ((dataPoint.magnitude - mean) * (dataPoint.magnitude - mean)) / count;
-            std = (accumulator_t)sqrt(part1 + part2 + part3);
+            state->mean = (dataPoint.magnitude + ((state->count - 1) * state->mean)) / state->count;
+            state->rawMagnitudeMean = (float)(dataPoint.orig_magnitude + (float)((state->count - 1) * state->rawMagnitudeMean)) / (float)state->count;
+            deviation_t part1 = ((state->std * state->std) / (state->count - 1)) * (state->count - 2);
+            deviation_t part2 = ((oMean - state->mean) * (oMean - state->mean));
+            deviation_t part3 = ((dataPoint.magnitude - state->mean) * (dataPoint.magnitude - state->mean)) / state->count;
+            state->std = (deviation_t)sqrt(part1 + part2 + part3);
         }
-        if (count > 15)
+        if (state->count > state->warmup)
         {
-            if ((dataPoint.magnitude - mean) > (std * threshold_int + (std / threshold_frac)))
+            if ((dataPoint.magnitude - state->mean) > (state->std * state->threshold_int + (state->std / state->threshold_frac)))
             {
                 // This is a peak
+                TRACE_DECISION(TRACE_PEAK, dataPoint);
+#ifdef SQUARED_MAGNITUDE
+                unsquarePeak(&dataPoint);
+#endif
                 ring_buffer_queue(outBuff, dataPoint);
 
                 /* Peak time interval */
-                dataPoint.peak_time = dataPoint.time - lastDataPoint.time;
+                dataPoint.peak_time = dataPoint.time - state->lastDataPoint.time;
 
-                if (lastDataPoint.time == 0)
+                if (state->lastDataPoint.time == 0)
                     dataPoint.peak_time = 0;
 
-                /* Compute MET constant */
-                if (dataPoint.magnitude < 200) {
-                    dataPoint.met = 1;
-                } else if (dataPoint.magnitude < 500) {
-                    dataPoint.met = 2;
-                } else if (dataPoint.magnitude < 800) {
-                    dataPoint.met = 5;
-                } else if (dataPoint.magnitude < 1000) {
-                    dataPoint.met = 10;
-                } else if (dataPoint.magnitude < 1500) {
-                    dataPoint.met = 13;
-                } else if (dataPoint.magnitude < 2000) {
-                    dataPoint.met = 15;
-                } else if (dataPoint.magnitude < 2500) {
-                    dataPoint.met = 17;
-                } else if (dataPoint.magnitude > 2500) {
-                    dataPoint.met = 23;
-                }
-
-                /* Increase calories burned */
-                kcalories += (bmr * dataPoint.met * dataPoint.peak_time);
+                /* Book the step interval, integrated lazily by the calorie engine */
+                uint8_t metClass = metClassOf(dataPoint.magnitude);
+                dataPoint.met = metOfClass(metClass);
+                bookStep(state->lastDataPoint.time, dataPoint.peak_time, metClass);
 
 #ifdef DUMP_FILE
                 if (detectionFile)
                 {
                     if (!fprintf(detectionFile, "%lld, %lld, %lld, %lld, %f, %lld, %0.12f, %f\n",
-                         dataPoint.time, dataPoint.magnitude, dataPoint.orig_magnitude, dataPoint.met, bmr, dataPoint.peak_time, kcalories, rawMagnitudeMean))
+                         dataPoint.time, dataPoint.magnitude, dataPoint.orig_magnitude, dataPoint.met, algoContext->bmr, dataPoint.peak_time, integratedCalories(), state->rawMagnitudeMean))
                          puts("error writing file");
                     // if (!fprintf(detectionFile, "mean=%lld, std=%lld, threshold_int=%lld threshold_frac=%lld\n",
-                    //     mean, std, threshold_int, threshold_frac))
+                    //     state->mean, state->std, state->threshold_int, state->threshold_frac))
                     //     puts("error writing file");
                     fflush(detectionFile);
                 }
 #endif
                 (*nextStage)();
 
-                lastDataPoint = dataPoint;
+                state->lastDataPoint = dataPoint;
             }
         }
+        confirmStep(dataPoint.time);
     }
 }
 
 void resetDetection(void)
 {
-    std = 0;
-    mean = 0;
-    count = 0;
-    rawMagnitudeMean = 0;
+    state->std = 0;
+    state->mean = 0;
+    state->count = 0;
+    state->rawMagnitudeMean = 0;
+}
+
+/* Forgets the last peak, so that the time of a skipped gap is not booked as a step */
+void resumeDetection(void)
+{
+    state->lastDataPoint.time = 0;
 }
 
 void changeDetectionThreshold(int16_t whole, int16_t frac)
 {
-    threshold_int = whole;
-    threshold_frac = frac;
+    state->threshold_int = whole;
+    state->threshold_frac = frac;
+}
+
+void changeDetectionWarmup(time_accel_t samples)
+{
+    state->warmup = samples;
 }
 
 magnitude_t getMagAvg(void) {
-    return rawMagnitudeMean;
+    return state->rawMagnitudeMean;
 }
@@ -24,6 +24,7 @@ SOFTWARE.
 
 #include "filterStage.h"
 #include "scoringStage.h"
+#include "tracer.h"
 
 #ifdef DUMP_FILE
 #include <stdio.h>
@@ -32,78 +33,64 @@ static FILE
 static FILE *filteredFile;
 #endif
 
-static ring_buffer_t *inBuff;
-static ring_buffer_t *outBuff;
-static void (*nextStage)(void);
-
-/*
-
-FIR filter designed with
-http://t-filter.appspot.com
-
-sampling frequency: 50 Hz
-
-fixed point precision: 16 bits
-
-* 0 Hz - 3 Hz
-  gain = 1
-  desired ripple = 5 dB
-  actual ripple = n/a
-
-* 4 Hz - 12.5 Hz
-  gain = 0
-  desired attenuation = -10 dB
-  actual attenuation = n/a
-
-*/
+#ifdef SQUARED_MAGNITUDE
+typedef magnitude_t filter_sum_t; /* squares need more headroom */
+#define MEAN_SQUARE_SHIFT 5       /* the average follows about 32 samples */
+#else
+typedef accumulator_t filter_sum_t;
+#endif
 
-#define FILTER_TAP_NUM 13
-
-static int filter_taps[FILTER_TAP_NUM] = {
-  -260015,
-  1609572,
-  -5275953,
-  11986707,
-  -20646348,
-  28240923,
-  -31270090,
-  28240923,
-  -20646348,
-  11986707,
-  -5275953,
-  1609572,
-  -260015
-};
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
 
+static CONTEXT_LOCAL filter_state_t *state;
 
 void initFilterStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void))
 {
     inBuff = pInBuff;
     outBuff = pOutBuff;
     nextStage = pNextStage;
+#ifdef SQUARED_MAGNITUDE
+    state->meanSquare = 0;
+#endif
 
 #ifdef DUMP_FILE
-    filteredFile = fopen(DUMP_FILTERED_FILE_NAME, "w+");
+    if (!filteredFile)
+        filteredFile = fopen(DUMP_FILTERED_FILE_NAME, "w+");
 #endif
 }
 
+void bindFilterStage(filter_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
 void filterStage(void)
 {
-    if (ring_buffer_num_items(inBuff) == FILTER_TAP_NUM)
+    if (ring_buffer_num_items(inBuff) == state->filterTapNum)
     {
-        accumulator_t sum = 0;
+        filter_sum_t sum = 0;
         data_point_t dataPoint;
         data_point_t out;
 
-        for (int8_t i = 0; i < FILTER_TAP_NUM; i++)
+        for (int8_t i = 0; i < state->filterTapNum; i++)
         {
             ring_buffer_peek(inBuff, &dataPoint, i);
-            if (i == FILTER_TAP_NUM - 1)
+            if (i == state->filterTapNum - 1)
                 out.time = dataPoint.time;
-            sum += dataPoint.magnitude * filter_taps[i];
+            sum += dataPoint.magnitude * state->filterTaps[i];
         }
         out.magnitude = sum >> 16;
         out.orig_magnitude = dataPoint.orig_magnitude;
+        TRACE_TAG(out, dataPoint);
+#ifdef SQUARED_MAGNITUDE
+        if (state->meanSquare == 0)
+            state->meanSquare = dataPoint.magnitude;
+        state->meanSquare += (dataPoint.magnitude - state->meanSquare) / (1 << MEAN_SQUARE_SHIFT);
+#endif
 
         ring_buffer_dequeue(inBuff, &dataPoint);
         ring_buffer_queue(outBuff, out);
@@ -120,3 +107,19 @@ void filterStage(void)
         (*nextStage)();
     }
 }
+
+void changeFilterTaps(const int32_t *taps, uint8_t tapNum)
+{
+    /* the filter runs once its buffer holds tapNum items */
+    if (tapNum > ring_buffer_capacity(inBuff))
+        tapNum = ring_buffer_capacity(inBuff);
+    state->filterTaps = taps;
+    state->filterTapNum = tapNum;
+}
+
+#ifdef SQUARED_MAGNITUDE
+magnitude_t getMeanSquare(void)
+{
+    return state->meanSquare;
+}
+#endif
\ No newline at end of file
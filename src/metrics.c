@@ -0,0 +1,60 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "metrics.h"
+
+void writeMetricsSnapshot(metrics_snapshot_t *snapshot, const step_metrics_t *metrics)
+{
+    uint32_t sequence = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&snapshot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&snapshot->steps, metrics->steps, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->distance, metrics->distance, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->calories, metrics->calories, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->stepsPerSec, metrics->stepsPerSec, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->lastStepTime, metrics->lastStepTime, memory_order_relaxed);
+
+    atomic_store_explicit(&snapshot->sequence, sequence + 2, memory_order_release);
+}
+
+void readMetricsSnapshot(metrics_snapshot_t *snapshot, step_metrics_t *metrics)
+{
+    uint32_t before;
+    uint32_t after;
+
+    do
+    {
+        before = atomic_load_explicit(&snapshot->sequence, memory_order_acquire);
+
+        metrics->steps = atomic_load_explicit(&snapshot->steps, memory_order_relaxed);
+        metrics->distance = atomic_load_explicit(&snapshot->distance, memory_order_relaxed);
+        metrics->calories = atomic_load_explicit(&snapshot->calories, memory_order_relaxed);
+        metrics->stepsPerSec = atomic_load_explicit(&snapshot->stepsPerSec, memory_order_relaxed);
+        metrics->lastStepTime = atomic_load_explicit(&snapshot->lastStepTime, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
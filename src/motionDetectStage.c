@@ -23,6 +23,9 @@ SOFTWARE.
 */
 #include "motionDetectStage.h"
 #include "StepCountingAlgo.h"
+#include "stepContext.h"
+#include "calorieEngine.h"
+#include "tracer.h"
 
 #define issigned(t) (((t)(-1)) < ((t)0))
 
@@ -34,33 +37,167 @@ SOFTWARE.
 
 #define maxof(t) ((unsigned long long)(issigned(t) ? smaxof(t) : umaxof(t)))
 
-static ring_buffer_t *inBuff;
-static ring_buffer_t *outBuff;
-static void (*nextStage)(void);
-static int motionThreshold = 150;
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
+static CONTEXT_LOCAL void (*wakeCallback)(void);
+static CONTEXT_LOCAL motion_detect_state_t *state;
 
-void initMotionDetectStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void))
+void initMotionDetectStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void), void (*pWakeCallback)(void))
 {
     inBuff = pInBuff;
     outBuff = pOutBuff;
     nextStage = pNextStage;
+    wakeCallback = pWakeCallback;
+    state->idleConfirm = 0;
+    state->idleCheckPeriod = 1;
+    state->stillCount = 0;
+    state->idle = 0;
+    state->motionThreshold = 150;
+    state->motionWindow = 12;
+    state->motionMinItems = 15;
+    state->idleBacklog = ring_buffer_capacity(inBuff);
+}
+
+void bindMotionDetectStage(motion_detect_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
+void resetMotionDetect(void)
+{
+    state->idle = 0;
+    state->stillCount = 0;
 }
 
 void changeMotionThreshold(int16_t threshold)
 {
-    motionThreshold = threshold;
+    state->motionThreshold = threshold;
+}
+
+void changeMotionWindow(ring_buffer_size_t window, ring_buffer_size_t minItems)
+{
+    /* the gate never runs if its buffer cannot hold enough items */
+    if (minItems > ring_buffer_capacity(inBuff))
+        minItems = ring_buffer_capacity(inBuff);
+    if (window > minItems)
+        window = minItems;
+    state->motionWindow = window;
+    state->motionMinItems = minItems;
+}
+
+/* By default the buffer fills up while idle, fewer samples shorten the delay once walking starts */
+void changeIdleBacklog(ring_buffer_size_t samples)
+{
+    if (samples > ring_buffer_capacity(inBuff))
+        samples = ring_buffer_capacity(inBuff);
+    state->idleBacklog = samples < state->motionMinItems ? state->motionMinItems : samples;
+}
+
+void changeIdleDutyCycle(uint16_t confirm, uint16_t checkPeriod)
+{
+    state->idleConfirm = confirm;
+    state->idleCheckPeriod = checkPeriod > 0 ? checkPeriod : 1;
+}
+
+/* Stillness is confirmed: the backlog beyond one window is dropped and booked as idle time */
+static void enterIdle(void)
+{
+    data_point_t oldest;
+    data_point_t newest;
+    data_point_t dp;
+    ring_buffer_peek(inBuff, &oldest, 0);
+    ring_buffer_peek(inBuff, &newest, ring_buffer_num_items(inBuff) - 1);
+    while (ring_buffer_num_items(inBuff) > state->motionMinItems)
+    {
+        ring_buffer_dequeue(inBuff, &dp);
+        TRACE_DECISION(TRACE_GATED, dp);
+    }
+    ring_buffer_peek(inBuff, &dp, 0);
+    bookIdleTime(oldest.time, dp.time - oldest.time);
+    TRACE_DECISION(TRACE_IDLE, newest);
+
+    state->idle = 1;
+    state->idleCount = 0;
+    state->idleMin = newest.magnitude;
+    state->idleMax = newest.magnitude;
+    state->idleSince = dp.time;
+}
+
+/*
+Range of the magnitudes above the threshold. On squared magnitudes
+sqrt(max) - sqrt(min) > t is tested as max - min - t^2 > 2 t sqrt(min), squared.
+*/
+static inline int aboveThreshold(magnitude_t max, magnitude_t min)
+{
+#ifdef SQUARED_MAGNITUDE
+    magnitude_t t = state->motionThreshold;
+    magnitude_t d = max - min - t * t;
+    return d > 0 && d * d > 4 * t * t * min;
+#else
+    return max - min > state->motionThreshold;
+#endif
+}
+
+/*
+While idle every sample only updates the range, which is compared to the threshold
+once per check period. Only the last window is kept so that the gate can resume
+at once, nothing is queued downstream until there is motion again.
+*/
+static void idleStage(void)
+{
+    data_point_t dp;
+    data_point_t dropped;
+    ring_buffer_peek(inBuff, &dp, ring_buffer_num_items(inBuff) - 1);
+    if (ring_buffer_num_items(inBuff) > state->motionMinItems)
+    {
+        ring_buffer_dequeue(inBuff, &dropped);
+        TRACE_DECISION(TRACE_GATED, dropped);
+    }
+    if (dp.magnitude < state->idleMin)
+        state->idleMin = dp.magnitude;
+    if (dp.magnitude > state->idleMax)
+        state->idleMax = dp.magnitude;
+    if (++state->idleCount < state->idleCheckPeriod)
+        return;
+
+    /* the time of the window kept is booked when it is dropped or leaves through the gate */
+    ring_buffer_peek(inBuff, &dropped, 0);
+    bookIdleTime(state->idleSince, dropped.time - state->idleSince);
+    state->idleSince = dropped.time;
+    state->idleCount = 0;
+
+    if (aboveThreshold(state->idleMax, state->idleMin))
+    {
+        /* Wake up: the windows downstream start over from the window kept */
+        state->idle = 0;
+        state->stillCount = 0;
+        TRACE_DECISION(TRACE_WAKE, dp);
+        (*wakeCallback)();
+        return;
+    }
+    state->idleMin = dp.magnitude;
+    state->idleMax = dp.magnitude;
 }
 
 void motionDetectStage(void)
 {
-    if (ring_buffer_num_items(inBuff) >= 15)
+    if (state->idle)
+    {
+        idleStage();
+        return;
+    }
+
+    if (ring_buffer_num_items(inBuff) >= state->motionMinItems)
     {
         magnitude_t min = maxof(magnitude_t);
         magnitude_t max = 0;
 
         data_point_t dp;
         data_point_t prev_dp;
-        for (int i = 0; i < 12; i++)
+        for (int i = 0; i < state->motionWindow; i++)
         {
             ring_buffer_peek(inBuff, &dp, i);
             if (dp.magnitude > max)
@@ -69,9 +206,10 @@ void motionDetectStage(void)
                 min = dp.magnitude;
         }
 
-        if (max - min > motionThreshold)
+        if (aboveThreshold(max, min))
         {
             data_point_t dataPoint;
+            state->stillCount = 0;
             ring_buffer_dequeue(inBuff, &dataPoint);
             ring_buffer_queue(outBuff, dataPoint);
             (*nextStage)();
@@ -79,10 +217,18 @@ void motionDetectStage(void)
             ring_buffer_peek(inBuff, &dp, 1);
             ring_buffer_peek(inBuff, &prev_dp, 0);
 
-            /* Add bmr calorie usage when there is no motion */
-            if (ring_buffer_is_full(inBuff)) {
-                float motionlessTime = dp.time - prev_dp.time;
-                kcalories += bmr * motionlessTime; /* bmr per ms */
+            /* Book bmr calorie usage when there is no motion, for the oldest sample that is dropped */
+            if (ring_buffer_num_items(inBuff) >= state->idleBacklog)
+            {
+                bookIdleTime(prev_dp.time, dp.time - prev_dp.time);
+                TRACE_DECISION(TRACE_GATED, prev_dp);
+                /* a full buffer drops it on the next queue */
+                if (state->idleBacklog < ring_buffer_capacity(inBuff))
+                    ring_buffer_dequeue(inBuff, &prev_dp);
+
+                /* only windows that move on count, until the backlog is full the same window is scanned again */
+                if (state->idleConfirm > 0 && ++state->stillCount >= state->idleConfirm)
+                    enterIdle();
             }
         }
     }
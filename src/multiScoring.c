@@ -0,0 +1,108 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <string.h>
+#include "multiScoring.h"
+#include "tracer.h"
+
+/**
+ * @file
+ * Implementation of the multi-window scoring.
+ */
+
+#define HISTORY_MASK (MULTI_SCORING_HISTORY - 1)
+
+void multi_scoring_init(multi_scoring_t *scoring)
+{
+  memset(scoring->sizes, 0, sizeof(scoring->sizes));
+  memset(scoring->midpoints, 0, sizeof(scoring->midpoints));
+  multi_scoring_reset(scoring);
+}
+
+void multi_scoring_reset(multi_scoring_t *scoring)
+{
+  scoring->count = 0;
+  scoring->sums[0] = 0;
+}
+
+uint8_t multi_scoring_add_window(multi_scoring_t *scoring, ring_buffer_size_t size, ring_buffer_size_t midpoint)
+{
+  for (uint8_t slot = 0; slot < MULTI_SCORING_WINDOWS; slot++)
+  {
+    if (scoring->sizes[slot] == 0)
+    {
+      multi_scoring_set_window(scoring, slot, size, midpoint);
+      return slot;
+    }
+  }
+  return MULTI_SCORING_WINDOWS;
+}
+
+void multi_scoring_set_window(multi_scoring_t *scoring, uint8_t slot, ring_buffer_size_t size, ring_buffer_size_t midpoint)
+{
+  if (size < 3)
+    size = 3;
+  if (size > MAX_WINDOW_SIZE)
+    size = MAX_WINDOW_SIZE;
+  scoring->sizes[slot] = size;
+  scoring->midpoints[slot] = midpoint < size ? midpoint : size - 1;
+}
+
+void multi_scoring_remove_window(multi_scoring_t *scoring, uint8_t slot)
+{
+  scoring->sizes[slot] = 0;
+}
+
+void multi_scoring_push(multi_scoring_t *scoring, const data_point_t *point)
+{
+  uint32_t index = scoring->count & HISTORY_MASK;
+  scoring->points[index] = *point;
+  scoring->sums[(scoring->count + 1) & HISTORY_MASK] = scoring->sums[index] + (uint64_t)point->magnitude;
+  scoring->count++;
+}
+
+uint8_t multi_scoring_score(const multi_scoring_t *scoring, uint8_t slot, data_point_t *score)
+{
+  ring_buffer_size_t size = scoring->sizes[slot];
+  if (scoring->count < size)
+    return 0;
+
+  uint32_t first = scoring->count - size;
+  const data_point_t *midpoint = &scoring->points[(first + scoring->midpoints[slot]) & HISTORY_MASK];
+  int64_t sum = (int64_t)(scoring->sums[scoring->count & HISTORY_MASK] - scoring->sums[first & HISTORY_MASK]);
+
+  /* the differences to the midpoint, saturated to 32 bits like scoringStage does */
+  int64_t diffs = size * midpoint->magnitude - sum;
+  if (diffs > INT32_MAX)
+    diffs = INT32_MAX;
+  if (diffs < INT32_MIN)
+    diffs = INT32_MIN;
+
+  memset(score, 0, sizeof(data_point_t));
+  score->time = midpoint->time;
+  score->magnitude = diffs / (size - 1);
+  score->orig_magnitude = midpoint->magnitude;
+  TRACE_TAG(*score, *midpoint);
+  return 1;
+}
@@ -24,6 +24,8 @@ SOFTWARE.
 #include "detectionStage.h"
 #include "postProcessingStage.h"
 #include "StepCountingAlgo.h"
+#include "stepContext.h"
+#include "tracer.h"
 
 #ifdef DUMP_FILE
 #include <stdio.h>
@@ -32,30 +34,38 @@ static FILE
 static FILE *postProcFile;
 #endif
 
-float meanPeakTime;
-float dist;
+CONTEXT_LOCAL float dist;
 
-static steps_t stepCounter;
-static ring_buffer_t *inBuff;
-static data_point_t lastDataPoint;
-static int16_t timeThreshold = 300; // in ms, this discards steps that are too close in time, 3 steps /s is a reasonable maximum
-static void (*stepCallback)(void);
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL void (*stepCallback)(void);
+static CONTEXT_LOCAL void (*confirmCallback)(void);
+static CONTEXT_LOCAL post_processing_state_t *state;
 
-void initPostProcessingStage(ring_buffer_t *pInBuff, void (*stepCallbackIn)(void))
+void initPostProcessingStage(ring_buffer_t *pInBuff, void (*stepCallbackIn)(void), void (*confirmCallbackIn)(void))
 {
     inBuff = pInBuff;
     stepCallback = stepCallbackIn;
-    stepCounter = 0;
-    lastDataPoint.time = 0;
-    lastDataPoint.magnitude = 0;
-    meanPeakTime = 0;
+    confirmCallback = confirmCallbackIn;
+    state->pending = 0;
+    state->stepCounter = 0;
+    state->timeThreshold = 300; // 3 steps /s is a reasonable maximum
+    state->lastDataPoint.time = 0;
+    state->lastDataPoint.magnitude = 0;
+    state->meanPeakTime = 0;
     dist = 0;
 
 #ifdef DUMP_FILE
-    postProcFile = fopen(DUMP_POSTPROC_FILE_NAME, "w+");
+    if (!postProcFile)
+        postProcFile = fopen(DUMP_POSTPROC_FILE_NAME, "w+");
 #endif
 }
 
+void bindPostProcessingStage(post_processing_state_t *pState, ring_buffer_t *pInBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+}
+
 void postProcessingStage(void)
 {
     if (!ring_buffer_is_empty(inBuff))
@@ -63,26 +73,26 @@ void postProcessingStage(void)
         data_point_t dataPoint;
         ring_buffer_dequeue(inBuff, &dataPoint);
 
-        if (lastDataPoint.time == 0)
+        if (state->lastDataPoint.time == 0)
         {
-            lastDataPoint = dataPoint;
+            state->lastDataPoint = dataPoint;
         }
         else
         {
-            if ((dataPoint.time - lastDataPoint.time) > timeThreshold)
+            if ((dataPoint.time - state->lastDataPoint.time) > state->timeThreshold)
             {
-                stepCounter++;
+                state->stepCounter++;
 
                 /* Peak time interval */
-                dataPoint.peak_time = dataPoint.time - lastDataPoint.time;
+                dataPoint.peak_time = dataPoint.time - state->lastDataPoint.time;
 
                 /* compute mean step length */
-                meanPeakTime = (dataPoint.peak_time + ((stepCounter - 1) * meanPeakTime)) / stepCounter;
+                state->meanPeakTime = (dataPoint.peak_time + ((state->stepCounter - 1) * state->meanPeakTime)) / state->stepCounter;
 
                 /* Weighted step stripe */
-                float stepsPerSec = (float)stepCounter / ((float)dataPoint.time / 1000);
+                float stepsPerSec = (float)state->stepCounter / ((float)dataPoint.time / 1000);
 
-                float magAvg = stride / 2; /* needs to be calibrated */
+                float magAvg = algoContext->stride / 2; /* needs to be calibrated */
                 float dynamicStepLen = (float) (dataPoint.peak_time);
 
                 if (dynamicStepLen < magAvg) {
@@ -95,14 +105,16 @@ void postProcessingStage(void)
 
                 float rawMean = getMagAvg();
 
-                lastDataPoint = dataPoint;
+                state->lastDataPoint = dataPoint;
+                state->pending = 1;
+                TRACE_DECISION(TRACE_STEP, dataPoint);
                 (*stepCallback)();
 
 #ifdef DUMP_FILE
                 if (postProcFile)
                 {
                     if (!fprintf(postProcFile, "%lld, %lld, %lld, %lld, %f, %f, %f, %f\n", 
-                        dataPoint.time, dataPoint.magnitude, dataPoint.orig_magnitude, (int64_t)rawMagnitudeMean, dataPoint.met, dynamicStepLen, magAvg, dataPoint.weight))
+                        dataPoint.time, dataPoint.magnitude, dataPoint.orig_magnitude, (int64_t)getMagAvg(), dataPoint.met, dynamicStepLen, magAvg, dataPoint.weight))
                         puts("error writing file");
                     fflush(postProcFile);
                 }
@@ -110,9 +122,14 @@ void postProcessingStage(void)
             }
             else
             {
-                if (dataPoint.magnitude > lastDataPoint.magnitude)
+                if (dataPoint.magnitude > state->lastDataPoint.magnitude)
+                {
+                    TRACE_DECISION(TRACE_REJECTED, state->lastDataPoint);
+                    state->lastDataPoint = dataPoint;
+                }
+                else
                 {
-                    lastDataPoint = dataPoint;
+                    TRACE_DECISION(TRACE_REJECTED, dataPoint);
                 }
             }
         }
@@ -121,17 +138,28 @@ void postProcessingStage(void)
 
 void resetPostProcess(void)
 {
-    lastDataPoint.magnitude = 0;
-    lastDataPoint.time = 0;
-    stepCounter = 0;
+    state->lastDataPoint.magnitude = 0;
+    state->lastDataPoint.time = 0;
+    state->stepCounter = 0;
+    state->pending = 0;
+}
+
+/* Called with the time of every scored sample, a step is final once no peak within the time threshold is left */
+void confirmStep(time_accel_t time)
+{
+    if (state->pending && time - state->lastDataPoint.time > state->timeThreshold)
+    {
+        state->pending = 0;
+        (*confirmCallback)();
+    }
 }
 
 void changeTimeThreshold(int16_t thresh)
 {
-    timeThreshold = thresh;
+    state->timeThreshold = thresh;
 }
 
 data_point_t getLastDataPoint(void) {
-    return lastDataPoint;
+    return state->lastDataPoint;
 }
 
@@ -22,6 +22,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 #include "preProcessingStage.h"
+#include "tracer.h"
 #include "config.h"
 
 #ifdef DUMP_FILE
@@ -31,38 +32,56 @@ static FILE
 static FILE *interpolatedFile;
 #endif
 
-static ring_buffer_t *inBuff;
-static ring_buffer_t *outBuff;
-static void (*nextStage)(void);
-static uint8_t samplingPeriod = 80;    //in ms, this can be smaller than the actual sampling frequency, but it will result in more computations
-static uint16_t timeScalingFactor = 1; //use this for adjusting time to ms, in case the clock has higher precision
-static time_accel_t lastSampleTime = -1;
-uint32_t currentTime = 0;
+#define MAGNITUDE_DIVISOR 100 /* raw accelerometer units per unit of magnitude */
+#define BURST_CHUNK 32        /* magnitudes computed at once from a FIFO burst */
 
-void initPreProcessStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void))
+_Static_assert(sizeof(accel_t) <= sizeof(int16_t), "the magnitude is computed on 32 bits");
+
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
+static CONTEXT_LOCAL void (*gapCallback)(time_accel_t start, time_accel_t length);
+static CONTEXT_LOCAL pre_process_state_t *state;
+
+void initPreProcessStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void),
+                         void (*pGapCallback)(time_accel_t start, time_accel_t length))
 {
     inBuff = pInBuff;
     outBuff = pOutBuff;
     nextStage = pNextStage;
+    gapCallback = pGapCallback;
+    state->lastSampleTime = -1;
+    state->currentTime = 0;
+    state->gapThreshold = GAP_THRESHOLD;
 
 #ifdef DUMP_FILE
-    magnitudeFile = fopen(DUMP_MAGNITUDE_FILE_NAME, "w+");
-    interpolatedFile = fopen(DUMP_INTERPOLATED_FILE_NAME, "w+");
+    if (!magnitudeFile)
+        magnitudeFile = fopen(DUMP_MAGNITUDE_FILE_NAME, "w+");
+    if (!interpolatedFile)
+        interpolatedFile = fopen(DUMP_INTERPOLATED_FILE_NAME, "w+");
 #endif
 }
 
+void bindPreProcessStage(pre_process_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
 static data_point_t linearInterpolate(data_point_t dp1, data_point_t dp2, int64_t interpTime)
 {
     magnitude_t mag = (dp1.magnitude + ((dp2.magnitude - dp1.magnitude) / (dp2.time - dp1.time)) * (interpTime - dp1.time));
     data_point_t interp;
     interp.time = interpTime;
     interp.magnitude = mag;
+    TRACE_TAG(interp, dp2);
     return interp;
 }
 
 static void outPutDataPoint(data_point_t dp)
 {
-    lastSampleTime = dp.time;
+    state->lastSampleTime = dp.time;
     ring_buffer_queue(outBuff, dp);
     (*nextStage)();
 
@@ -76,28 +95,117 @@ static void outPutDataPoint(data_point_t dp)
 #endif
 }
 
+#if defined(APPROX_MAGNITUDE)
+/*
+3-D alpha max beta min: with the absolute components sorted hi >= mid >= lo the
+magnitude is max(hi + 6/32 mid, 25/32 hi + 19/32 mid + 10/32 lo) within +-3.0%.
+Shifts, adds, min and max only, so it has no branches either.
+*/
+static inline int32_t computeMagnitude(int32_t x, int32_t y, int32_t z)
+{
+    int32_t ax = x < 0 ? -x : x;
+    int32_t ay = y < 0 ? -y : y;
+    int32_t az = z < 0 ? -z : z;
+    int32_t hi = ax > ay ? ax : ay;
+    int32_t lo = ax < ay ? ax : ay;
+    hi = hi > az ? hi : az;
+    lo = lo < az ? lo : az;
+    int32_t mid = ax + ay + az - hi - lo;
+
+    /* both estimates are scaled by 32 */
+    int32_t first = (hi << 5) + (mid << 2) + (mid << 1);
+    int32_t second = (hi << 4) + (hi << 3) + hi + (mid << 4) + (mid << 1) + mid + (lo << 3) + (lo << 1);
+    int32_t estimate = first > second ? first : second;
+    return estimate / (32 * MAGNITUDE_DIVISOR);
+}
+#elif defined(SQUARED_MAGNITUDE)
+/* Squared magnitude divided by MAGNITUDE_DIVISOR^2, the stages compare squares */
+static inline int32_t computeMagnitude(int32_t x, int32_t y, int32_t z)
+{
+    uint32_t sumOfSquares = (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+    return (int32_t)(sumOfSquares / (MAGNITUDE_DIVISOR * MAGNITUDE_DIVISOR));
+}
+#else
+#ifdef STEP_COUNTING_ALGO_UTILS_H
+/* integer square root from sqrt.h */
+#define magnitudeSqrt(v) sqrt(v)
+#else
+/* exact here: the argument is below 2^24 and no non-square root rounds to an integer */
+#define magnitudeSqrt(v) sqrtf((float)(v))
+#endif
+
+/*
+Magnitude of the acceleration divided by MAGNITUDE_DIVISOR, rounded down.
+floor(sqrt(floor(s))) == floor(sqrt(s)) so this is exact in integers, and it has
+no branches so that loops over many samples vectorize.
+*/
+static inline int32_t computeMagnitude(int32_t x, int32_t y, int32_t z)
+{
+    uint32_t sumOfSquares = (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+    return (int32_t)magnitudeSqrt((accumulator_t)(sumOfSquares / (MAGNITUDE_DIVISOR * MAGNITUDE_DIVISOR)));
+}
+#endif
+
+static void preProcessMagnitude(time_accel_t time, magnitude_t magnitude);
+
 void preProcessSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
 {
-    time = time / timeScalingFactor;
+    preProcessMagnitude(time, computeMagnitude(x, y, z));
+}
 
-    /* Update current time */
-    currentTime = time;
+void preProcessBurst(const uint8_t *fifo, uint16_t sampleCount, time_accel_t burstTime, uint16_t odrHz)
+{
+    int16_t x[BURST_CHUNK];
+    int16_t y[BURST_CHUNK];
+    int16_t z[BURST_CHUNK];
+    int32_t magnitudes[BURST_CHUNK];
+    int64_t ticksPerSecond = 1000 * (int64_t)state->timeScalingFactor;
 
-    /* convert acc data to float */
-    float acc_x = (float)x / 100;
-    float acc_y = (float)y / 100;
-    float acc_z = (float)z / 100;
+    for (uint16_t start = 0; start < sampleCount; start += BURST_CHUNK)
+    {
+        uint16_t n = sampleCount - start < BURST_CHUNK ? sampleCount - start : BURST_CHUNK;
+        const uint8_t *p = fifo + 6 * start;
 
-    // accel_t acc_x = x;
-    // accel_t acc_y = y;
-    // accel_t acc_z = z; 
+        /* deinterleave first, so that the magnitude loop runs on contiguous lanes */
+        for (uint16_t i = 0; i < n; i++)
+        {
+            x[i] = (int16_t)(p[6 * i] | (p[6 * i + 1] << 8));
+            y[i] = (int16_t)(p[6 * i + 2] | (p[6 * i + 3] << 8));
+            z[i] = (int16_t)(p[6 * i + 4] | (p[6 * i + 5] << 8));
+        }
+        /* a fixed trip count lets the compiler vectorize without a scalar epilogue */
+        for (uint16_t i = n; i < BURST_CHUNK; i++)
+            x[i] = y[i] = z[i] = 0;
+        for (uint16_t i = 0; i < BURST_CHUNK; i++)
+            magnitudes[i] = computeMagnitude(x[i], y[i], z[i]);
+
+        for (uint16_t i = 0; i < n; i++)
+        {
+            /* the burst time stamps the newest sample, the others are one ODR period apart */
+            uint16_t age = sampleCount - 1 - (start + i);
+            time_accel_t time = burstTime - (time_accel_t)(age * ticksPerSecond / odrHz);
+            preProcessMagnitude(time, magnitudes[i]);
+        }
+    }
+}
+
+static void preProcessMagnitude(time_accel_t time, magnitude_t magnitude)
+{
+    time = time / state->timeScalingFactor;
+
+    /* Update current time */
+    state->currentTime = time;
 
-    magnitude_t magnitude = (magnitude_t)sqrt((accumulator_t)(acc_x * acc_x + acc_y * acc_y + acc_z * acc_z));
     data_point_t dataPoint;
     dataPoint.time = time;
     dataPoint.magnitude = magnitude;
     dataPoint.orig_magnitude = magnitude;
     dataPoint.met = 0;
+#ifdef TRACE_PIPELINE
+    dataPoint.seq = ++state->sequence;
+    trace_sample(dataPoint.seq);
+#endif
+    TRACE_STAGE_BEGIN(TRACE_PRE_PROCESS);
 
 #ifdef DUMP_FILE
     if (magnitudeFile)
@@ -107,6 +215,15 @@ void preProcessSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
     }
 #endif
 
+    /* Dropout: restart from this sample instead of filling the gap */
+    if (state->lastSampleTime != -1 && time - state->lastSampleTime > state->gapThreshold)
+    {
+        TRACE_DECISION(TRACE_GAP, dataPoint);
+        (*gapCallback)(state->lastSampleTime, time - state->lastSampleTime);
+        state->lastSampleTime = -1;
+        ring_buffer_init(inBuff);
+    }
+
 #ifdef SKIP_INTERPOLATION
     outPutDataPoint(dataPoint);
 #else
@@ -118,21 +235,21 @@ void preProcessSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
         // take last 2 elements
         ring_buffer_peek(inBuff, &dp1, 0);
         ring_buffer_peek(inBuff, &dp2, 1);
-        if (lastSampleTime == -1)
-            lastSampleTime = dp1.time;
+        if (state->lastSampleTime == -1)
+            state->lastSampleTime = dp1.time;
 
-        if (dp2.time - lastSampleTime == samplingPeriod)
+        if (dp2.time - state->lastSampleTime == state->samplingPeriod)
         {
             // no need to interpolate!
             outPutDataPoint(dp2);
         }
-        else if (dp2.time - lastSampleTime > samplingPeriod)
+        else if (dp2.time - state->lastSampleTime > state->samplingPeriod)
         {
-            int8_t numberOfPoints = 1 + ((((dp2.time - lastSampleTime)) - 1) / samplingPeriod); //number of points to be generated, ceiled
+            time_accel_t numberOfPoints = 1 + ((((dp2.time - state->lastSampleTime)) - 1) / state->samplingPeriod); //number of points to be generated, ceiled
 
-            for (int8_t i = 1; i < numberOfPoints; i++)
+            for (time_accel_t i = 1; i < numberOfPoints; i++)
             {
-                time_accel_t interpTime = lastSampleTime + samplingPeriod;
+                time_accel_t interpTime = state->lastSampleTime + state->samplingPeriod;
 
                 if (dp1.time <= interpTime && interpTime <= dp2.time)
                 {
@@ -146,11 +263,27 @@ void preProcessSample(time_accel_t time, accel_t x, accel_t y, accel_t z)
         ring_buffer_dequeue(inBuff, &dataPoint);
     }
 #endif
+    TRACE_STAGE_END(TRACE_PRE_PROCESS);
+}
+
+void changeSamplingPeriod(uint8_t period)
+{
+    state->samplingPeriod = period;
+}
+
+void changeTimeScalingFactor(uint16_t factor)
+{
+    state->timeScalingFactor = factor;
+}
+
+void changeGapThreshold(time_accel_t threshold)
+{
+    state->gapThreshold = threshold;
 }
 
 void resetPreProcess(void)
 {
-    lastSampleTime = -1;
+    state->lastSampleTime = -1;
 
 #ifdef DUMP_FILE
     if (magnitudeFile)
@@ -0,0 +1,163 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stddef.h>
+#include "rateConfig.h"
+
+#define REFERENCE_TAP_NUM 13
+#define LANCZOS_LOBES 2 /* of the kernel resampling the low pass of the reference taps */
+#define PI 3.14159265358979323846
+
+/*
+FIR filter designed with
+http://t-filter.appspot.com
+
+sampling frequency: 50 Hz
+
+fixed point precision: 16 bits
+
+* 0 Hz - 3 Hz
+  gain = 1
+  desired ripple = 5 dB
+  actual ripple = n/a
+
+* 4 Hz - 12.5 Hz
+  gain = 0
+  desired attenuation = -10 dB
+  actual attenuation = n/a
+
+*/
+static const int32_t referenceTaps[REFERENCE_TAP_NUM] = {
+  -260015,
+  1609572,
+  -5275953,
+  11986707,
+  -20646348,
+  28240923,
+  -31270090,
+  28240923,
+  -20646348,
+  11986707,
+  -5275953,
+  1609572,
+  -260015
+};
+
+/* One slot per rate, a sampleRateHz of 0 until it is derived */
+static rate_params_t rates[MAX_RATE_HZ - MIN_RATE_HZ + 1];
+
+/* scales a number of samples tuned at REFERENCE_RATE_HZ to the given rate, rounded */
+static uint16_t scaleToRate(uint16_t samples, uint16_t sampleRateHz)
+{
+    uint16_t scaled = (samples * sampleRateHz + REFERENCE_RATE_HZ / 2) / REFERENCE_RATE_HZ;
+    return scaled > 0 ? scaled : 1;
+}
+
+static double sinc(double x)
+{
+    return x == 0 ? 1 : sin(PI * x) / (PI * x);
+}
+
+/*
+The reference taps are a low pass up to 3 Hz, plus a band around the Nyquist frequency
+with far more gain, which sets the scale of the filtered magnitudes on real, noisy,
+samples. Both parts are kept at any rate: the low pass below REFERENCE_RATE_HZ / 4 is
+resampled to the rate, Lanczos interpolated and band limited to the lower of the two
+Nyquist frequencies, so its gain is the same in Hz; what is left of the reference taps,
+the band around the Nyquist frequency, stays at the Nyquist frequency of the rate with
+the same taps, so the noise there is amplified as much as at REFERENCE_RATE_HZ.
+*/
+static void designFilter(rate_params_t *params)
+{
+    double ratio = (double)params->sampleRateHz / REFERENCE_RATE_HZ;
+    double band = ratio > 1 ? 1 / ratio : 1; /* pass band of the low pass, relative to the Nyquist frequency of the rate */
+    double lowPass[REFERENCE_TAP_NUM];
+    const int8_t half = REFERENCE_TAP_NUM / 2;
+
+    for (int8_t n = 0; n < REFERENCE_TAP_NUM; n++)
+    {
+        lowPass[n] = 0;
+        for (int8_t m = 0; m < REFERENCE_TAP_NUM; m++)
+            lowPass[n] += referenceTaps[m] * sinc((n - m) / 2.0) / 2;
+    }
+
+    int tapNum = ((int)ceil((REFERENCE_TAP_NUM - 1) * ratio + 2 * LANCZOS_LOBES / band)) | 1;
+    if (tapNum < REFERENCE_TAP_NUM)
+        tapNum = REFERENCE_TAP_NUM;
+    if (tapNum > MAX_FILTER_TAP_NUM)
+        tapNum = MAX_FILTER_TAP_NUM;
+    const int center = tapNum / 2;
+
+    for (int k = 0; k < tapNum; k++)
+    {
+        double tap = 0;
+        for (int8_t n = 0; n < REFERENCE_TAP_NUM; n++)
+        {
+            double x = band * (k - center - (n - half) * ratio);
+            if (fabs(x) < LANCZOS_LOBES)
+                tap += lowPass[n] * band * sinc(x) * sinc(x / LANCZOS_LOBES);
+        }
+        int n = k - center + half;
+        if (n >= 0 && n < REFERENCE_TAP_NUM)
+            tap += referenceTaps[n] - lowPass[n];
+        params->filterTaps[k] = (int32_t)lround(tap);
+    }
+    params->filterTapNum = (uint8_t)tapNum;
+}
+
+static void deriveParams(rate_params_t *params, uint16_t sampleRateHz)
+{
+    params->sampleRateHz = sampleRateHz;
+    params->motionWindow = scaleToRate(12, sampleRateHz);
+    params->motionMinItems = scaleToRate(15, sampleRateHz);
+    params->detectionWarmup = scaleToRate(15, sampleRateHz);
+    params->windowSize = scaleToRate(OPT_WINDOWSIZE, sampleRateHz);
+    params->idleConfirm = scaleToRate(IDLE_CONFIRM_MS * REFERENCE_RATE_HZ / 1000, sampleRateHz);
+    params->idleCheckPeriod = scaleToRate(IDLE_CHECK_MS * REFERENCE_RATE_HZ / 1000, sampleRateHz);
+    if (params->windowSize < 3)
+        params->windowSize = 3;
+    if (params->windowSize > MAX_WINDOW_SIZE)
+        params->windowSize = MAX_WINDOW_SIZE;
+
+    if (sampleRateHz == REFERENCE_RATE_HZ)
+    {
+        for (uint8_t i = 0; i < REFERENCE_TAP_NUM; i++)
+            params->filterTaps[i] = referenceTaps[i];
+        params->filterTapNum = REFERENCE_TAP_NUM;
+    }
+    else
+    {
+        designFilter(params);
+    }
+}
+
+const rate_params_t *getRateParams(uint16_t sampleRateHz)
+{
+    if (sampleRateHz < MIN_RATE_HZ || sampleRateHz > MAX_RATE_HZ)
+        return NULL;
+
+    rate_params_t *params = &rates[sampleRateHz - MIN_RATE_HZ];
+    if (params->sampleRateHz == 0)
+        deriveParams(params, sampleRateHz);
+    return params;
+}
@@ -29,6 +29,13 @@ SOFTWARE.
  * Implementation of ring buffer functions.
  */
 
+void ring_buffer_setup(ring_buffer_t *buffer, data_point_t *storage, ring_buffer_size_t size)
+{
+  buffer->buffer = storage;
+  buffer->mask = size - 1;
+  ring_buffer_init(buffer);
+}
+
 void ring_buffer_init(ring_buffer_t *buffer)
 {
   buffer->tail_index = 0;
@@ -42,12 +49,12 @@ void ring_buffer_queue(ring_buffer_t *buffer, data_point_t data)
   {
     /* Is going to overwrite the oldest byte */
     /* Increase tail index */
-    buffer->tail_index = ((buffer->tail_index + 1) & RING_BUFFER_MASK);
+    buffer->tail_index = ((buffer->tail_index + 1) & buffer->mask);
   }
 
   /* Place data in buffer */
   buffer->buffer[buffer->head_index] = data;
-  buffer->head_index = ((buffer->head_index + 1) & RING_BUFFER_MASK);
+  buffer->head_index = ((buffer->head_index + 1) & buffer->mask);
 }
 
 ring_buffer_size_t ring_buffer_dequeue(ring_buffer_t *buffer, data_point_t *data)
@@ -59,7 +66,7 @@ ring_buffer_size_t ring_buffer_dequeue(ring_buffer_t *buffer, data_point_t *data
   }
 
   *data = buffer->buffer[buffer->tail_index];
-  buffer->tail_index = ((buffer->tail_index + 1) & RING_BUFFER_MASK);
+  buffer->tail_index = ((buffer->tail_index + 1) & buffer->mask);
   return 1;
 }
 
@@ -72,7 +79,7 @@ ring_buffer_size_t ring_buffer_peek(ring_buffer_t *buffer, data_point_t *data, r
   }
 
   /* Add index to pointer */
-  ring_buffer_size_t data_index = ((buffer->tail_index + index) & RING_BUFFER_MASK);
+  ring_buffer_size_t data_index = ((buffer->tail_index + index) & buffer->mask);
   *data = buffer->buffer[data_index];
   return 1;
 }
@@ -80,3 +87,4 @@ ring_buffer_size_t ring_buffer_peek(ring_buffer_t *buffer, data_point_t *data, r
 extern inline uint8_t ring_buffer_is_empty(ring_buffer_t *buffer);
 extern inline uint8_t ring_buffer_is_full(ring_buffer_t *buffer);
 extern inline uint8_t ring_buffer_num_items(ring_buffer_t *buffer);
+extern inline uint8_t ring_buffer_capacity(ring_buffer_t *buffer);
@@ -0,0 +1,162 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stddef.h>
+#include "rollup.h"
+
+/**
+ * @file
+ * Implementation of the activity rollups.
+ */
+
+static const int32_t periods[ROLLUP_LEVELS] = {60 * 1000, 60 * 60 * 1000, 24 * 60 * 60 * 1000};
+static const uint8_t sizes[ROLLUP_LEVELS] = {ROLLUP_MINUTES, ROLLUP_HOURS, ROLLUP_DAYS};
+
+static activity_bucket_t *level_buckets(rollup_t *rollup, uint8_t level)
+{
+  switch (level)
+  {
+  case ROLLUP_MINUTE:
+    return rollup->minutes;
+  case ROLLUP_HOUR:
+    return rollup->hours;
+  default:
+    return rollup->days;
+  }
+}
+
+/**
+ * Floor division, so that times before 0 fall in negative periods.
+ */
+static int32_t period_of(time_accel_t time, uint8_t level)
+{
+  int32_t period = time / periods[level];
+  return (time % periods[level] < 0) ? period - 1 : period;
+}
+
+/**
+ * Index of the bucket of a period, periods before 0 included.
+ */
+static uint8_t slot_of(uint8_t level, int32_t period)
+{
+  int32_t size = sizes[level];
+  return (uint8_t)(((period % size) + size) % size);
+}
+
+/**
+ * Returns the bucket of a period, cleared if it held an older one;
+ * NULL if it already holds a newer period.
+ */
+static activity_bucket_t *bucket_for(rollup_t *rollup, uint8_t level, int32_t period)
+{
+  activity_bucket_t *bucket = &level_buckets(rollup, level)[slot_of(level, period)];
+  if (bucket->period > period)
+    return NULL;
+  if (bucket->period < period)
+  {
+    bucket->period = period;
+    bucket->steps = 0;
+    bucket->distance = 0;
+    bucket->calories = 0;
+  }
+  return bucket;
+}
+
+void rollup_init(rollup_t *rollup)
+{
+  for (uint8_t level = 0; level < ROLLUP_LEVELS; level++)
+  {
+    activity_bucket_t *buckets = level_buckets(rollup, level);
+    for (uint8_t i = 0; i < sizes[level]; i++)
+    {
+      buckets[i].period = INT32_MIN;
+      buckets[i].steps = 0;
+      buckets[i].distance = 0;
+      buckets[i].calories = 0;
+    }
+  }
+}
+
+void rollup_add_step(rollup_t *rollup, time_accel_t time, double distance)
+{
+  for (uint8_t level = 0; level < ROLLUP_LEVELS; level++)
+  {
+    activity_bucket_t *bucket = bucket_for(rollup, level, period_of(time, level));
+    if (bucket)
+    {
+      bucket->steps++;
+      bucket->distance += distance;
+    }
+  }
+}
+
+void rollup_add_calories(rollup_t *rollup, time_accel_t start, time_accel_t duration, double calories)
+{
+  if (duration <= 0)
+    return;
+
+  int64_t end = (int64_t)start + duration;
+  for (uint8_t level = 0; level < ROLLUP_LEVELS; level++)
+  {
+    int32_t first = period_of(start, level);
+    int32_t last = period_of((time_accel_t)(end - 1), level);
+
+    /* Periods the level does not keep would be overwritten anyway */
+    if (last - first >= sizes[level])
+      first = last - sizes[level] + 1;
+
+    for (int32_t period = first; period <= last; period++)
+    {
+      int64_t from = (int64_t)period * periods[level];
+      int64_t to = from + periods[level];
+      if (from < start)
+        from = start;
+      if (to > end)
+        to = end;
+
+      activity_bucket_t *bucket = bucket_for(rollup, level, period);
+      if (bucket)
+        bucket->calories += calories * (double)(to - from) / duration;
+    }
+  }
+}
+
+uint8_t rollup_get(const rollup_t *rollup, uint8_t level, time_accel_t time, activity_bucket_t *bucket)
+{
+  if (level >= ROLLUP_LEVELS)
+    return 0;
+
+  int32_t period = period_of(time, level);
+  const activity_bucket_t *stored = &level_buckets((rollup_t *)rollup, level)[slot_of(level, period)];
+  bucket->period = period;
+  bucket->steps = 0;
+  bucket->distance = 0;
+  bucket->calories = 0;
+  if (stored->period == period)
+  {
+    *bucket = *stored;
+    return 1;
+  }
+  return stored->period < period;
+}
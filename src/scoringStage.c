@@ -23,6 +23,7 @@ SOFTWARE.
 */
 #include "scoringStage.h"
 #include "detectionStage.h"
+#include "tracer.h"
 
 #ifdef DUMP_FILE
 #include <stdio.h>
@@ -45,26 +46,37 @@ int32_t safe_add(int64_t a, int64_t b) {
     return a + b;
 }
 
-static ring_buffer_t *inBuff;
-static ring_buffer_t *outBuff;
-static void (*nextStage)(void);
+static CONTEXT_LOCAL ring_buffer_t *inBuff;
+static CONTEXT_LOCAL ring_buffer_t *outBuff;
+static CONTEXT_LOCAL void (*nextStage)(void);
 
-static ring_buffer_size_t windowSize = 10;
-static ring_buffer_size_t midpoint = 5; //half of size
+static CONTEXT_LOCAL scoring_state_t *state;
 
 void initScoringStage(ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff, void (*pNextStage)(void))
 {
     inBuff = pInBuff;
     outBuff = pOutBuff;
     nextStage = pNextStage;
+    state->windowSize = 10;
+    state->midpoint = 5;
 
 #ifdef DUMP_FILE
-    scoringFile = fopen(DUMP_SCORING_FILE_NAME, "w+");
+    if (!scoringFile)
+        scoringFile = fopen(DUMP_SCORING_FILE_NAME, "w+");
 #endif
 }
 
+void bindScoringStage(scoring_state_t *pState, ring_buffer_t *pInBuff, ring_buffer_t *pOutBuff)
+{
+    state = pState;
+    inBuff = pInBuff;
+    outBuff = pOutBuff;
+}
+
 void scoringStage(void)
 {
+    ring_buffer_size_t windowSize = state->windowSize;
+    ring_buffer_size_t midpoint = state->midpoint;
     if (ring_buffer_num_items(inBuff) == windowSize)
     {
         magnitude_t diffLeft = 0;
@@ -89,6 +101,7 @@ void scoringStage(void)
         out.time = midpointData.time;
         out.magnitude = scorePeak;
         out.orig_magnitude = midpointData.magnitude;
+        TRACE_TAG(out, midpointData);
         ring_buffer_queue(outBuff, out);
         ring_buffer_dequeue(inBuff, &midpointData);
         (*nextStage)();
@@ -106,6 +119,17 @@ void scoringStage(void)
 
 void changeWindowSize(ring_buffer_size_t windowsize)
 {
-    windowSize = windowsize;
-    midpoint = windowsize / 2;
+    /* the window is scored once its buffer holds windowsize items */
+    if (windowsize > ring_buffer_capacity(inBuff))
+        windowsize = ring_buffer_capacity(inBuff);
+    state->windowSize = windowsize;
+    state->midpoint = windowsize / 2;
+}
+
+/* Samples after the midpoint, fewer than half the window skews it to the past and scores sooner */
+void changeScoringLookahead(ring_buffer_size_t samples)
+{
+    if (samples > state->windowSize - 1)
+        samples = state->windowSize - 1;
+    state->midpoint = state->windowSize - 1 - samples;
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <math.h>
+#include "stepLog.h"
+
+/**
+ * @file
+ * Implementation of the step log.
+ * A step is encoded as the varint time since the previous step of the block,
+ * the zigzag varint difference between its interval and that time (0 for
+ * regular walking), the zigzag varint difference with the previous magnitude
+ * and the weight in one byte. The first step of a block has no previous step,
+ * so it is encoded against 0.
+ */
+
+static uint16_t put_varint(uint8_t *p, uint64_t v)
+{
+  uint16_t n = 0;
+  while (v >= 0x80)
+  {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static uint16_t get_varint(const uint8_t *p, uint64_t *v)
+{
+  uint16_t n = 0;
+  uint8_t shift = 0;
+  *v = 0;
+  do
+  {
+    *v |= (uint64_t)(p[n] & 0x7F) << shift;
+    shift += 7;
+  } while (p[n++] & 0x80);
+  return n;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static const step_log_block_t *block_at(const step_log_t *log, uint8_t i)
+{
+  return &log->blocks[(log->first_block + i) % STEP_LOG_BLOCKS];
+}
+
+/**
+ * Decodes the step at <em>offset</em> of a block, <em>event</em> holds the previous step.
+ */
+static uint16_t decode(const step_log_block_t *block, uint16_t offset, step_event_t *event)
+{
+  const uint8_t *p = block->data + offset;
+  uint64_t v;
+  uint16_t n = get_varint(p, &v);
+  time_accel_t delta = (time_accel_t)v;
+  event->time += delta;
+  n += get_varint(p + n, &v);
+  event->interval = delta + (time_accel_t)unzigzag(v);
+  n += get_varint(p + n, &v);
+  event->magnitude += unzigzag(v);
+  event->weight = (float)p[n++] / STEP_LOG_WEIGHT_SCALE;
+  return n;
+}
+
+void step_log_init(step_log_t *log)
+{
+  log->first_block = 0;
+  log->block_count = 0;
+  log->steps = 0;
+  log->distance = 0;
+}
+
+void step_log_append(step_log_t *log, const step_event_t *event)
+{
+  step_log_block_t *block = NULL;
+  if (log->block_count > 0)
+  {
+    block = &log->blocks[(log->first_block + log->block_count - 1) % STEP_LOG_BLOCKS];
+    if (block->used + STEP_LOG_MAX_ENTRY > STEP_LOG_BLOCK_BYTES)
+      block = NULL;
+  }
+
+  step_event_t previous = log->last;
+  if (block == NULL)
+  {
+    /* Start a new block, dropping the oldest one when all are used */
+    if (log->block_count == STEP_LOG_BLOCKS)
+    {
+      log->first_block = (log->first_block + 1) % STEP_LOG_BLOCKS;
+      log->block_count--;
+    }
+    block = &log->blocks[(log->first_block + log->block_count) % STEP_LOG_BLOCKS];
+    log->block_count++;
+    block->first_time = event->time;
+    block->steps_before = log->steps;
+    block->distance_before = log->distance;
+    block->count = 0;
+    block->used = 0;
+    previous.time = event->time;
+    previous.magnitude = 0;
+  }
+
+  time_accel_t delta = event->time - previous.time;
+  long weight = lroundf(event->weight * STEP_LOG_WEIGHT_SCALE);
+  uint8_t *p = block->data + block->used;
+  uint16_t n = put_varint(p, (uint64_t)delta);
+  n += put_varint(p + n, zigzag((int64_t)event->interval - delta));
+  n += put_varint(p + n, zigzag(event->magnitude - previous.magnitude));
+  p[n++] = (uint8_t)(weight < 0 ? 0 : weight > 0xFF ? 0xFF : weight);
+  block->used += n;
+  block->count++;
+
+  log->last = *event;
+  log->steps++;
+  log->distance += (double)event->magnitude * ((float)p[n - 1] / STEP_LOG_WEIGHT_SCALE);
+}
+
+/**
+ * Steps and distance logged before <em>time</em>: the block is found by binary
+ * search on the first times, then only that block is decoded.
+ */
+static uint32_t prefix(const step_log_t *log, time_accel_t time, double *distance)
+{
+  if (log->block_count == 0)
+  {
+    *distance = 0;
+    return 0;
+  }
+
+  /* Last block starting before time */
+  uint8_t lo = 0;
+  uint8_t hi = log->block_count;
+  while (lo < hi)
+  {
+    uint8_t mid = (lo + hi) / 2;
+    if (block_at(log, mid)->first_time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+  {
+    *distance = block_at(log, 0)->distance_before;
+    return block_at(log, 0)->steps_before;
+  }
+
+  const step_log_block_t *block = block_at(log, lo - 1);
+  uint32_t steps = block->steps_before;
+  *distance = block->distance_before;
+
+  step_event_t event = {block->first_time, 0, 0, 0};
+  uint16_t offset = 0;
+  for (uint16_t i = 0; i < block->count; i++)
+  {
+    offset += decode(block, offset, &event);
+    if (event.time >= time)
+      break;
+    steps++;
+    *distance += (double)event.magnitude * event.weight;
+  }
+  return steps;
+}
+
+uint32_t step_log_range(const step_log_t *log, time_accel_t from, time_accel_t to, double *distance)
+{
+  if (to <= from)
+  {
+    if (distance)
+      *distance = 0;
+    return 0;
+  }
+
+  double fromDistance;
+  double toDistance;
+  uint32_t fromSteps = prefix(log, from, &fromDistance);
+  uint32_t toSteps = prefix(log, to, &toDistance);
+  if (distance)
+    *distance = toDistance - fromDistance;
+  return toSteps - fromSteps;
+}
+
+uint32_t step_log_export(const step_log_t *log, time_accel_t since, step_event_t *events, uint32_t max)
+{
+  /* Last block starting at or before since, the earlier ones are all older */
+  uint8_t lo = 0;
+  uint8_t hi = log->block_count;
+  while (lo < hi)
+  {
+    uint8_t mid = (lo + hi) / 2;
+    if (block_at(log, mid)->first_time <= since)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  uint32_t written = 0;
+  for (uint8_t b = lo == 0 ? 0 : lo - 1; b < log->block_count && written < max; b++)
+  {
+    const step_log_block_t *block = block_at(log, b);
+    step_event_t event = {block->first_time, 0, 0, 0};
+    uint16_t offset = 0;
+    for (uint16_t i = 0; i < block->count && written < max; i++)
+    {
+      offset += decode(block, offset, &event);
+      if (event.time >= since)
+        events[written++] = event;
+    }
+  }
+  return written;
+}
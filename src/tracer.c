@@ -0,0 +1,179 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tracer.h"
+
+/**
+ * @file
+ * Implementation of the tracer.
+ * The ring is written as a sequence lock: the writer claims an index before
+ * overwriting its slot and commits it afterwards. A reader copies the committed
+ * events and then drops the ones whose slot was claimed again in the meantime,
+ * so neither side ever waits.
+ */
+
+#ifdef TRACE_PIPELINE
+
+_Static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of two");
+
+static const char *stage_names[] = {"pre-processing", "decimation", "motion detection", "filter",
+                                    "scoring", "detection", "post-processing"};
+static const char *decision_names[] = {"gap", "gated", "idle", "wake", "peak", "step", "rejected"};
+
+static trace_event_t events[TRACE_EVENTS];
+static atomic_uint_fast32_t claimed;
+static atomic_uint_fast32_t committed;
+
+static CONTEXT_LOCAL uint16_t current_stream;
+static CONTEXT_LOCAL uint32_t current_seq;
+
+static uint64_t default_clock(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t (*trace_clock)(void) = default_clock;
+static void (*trace_observer)(uint8_t kind, uint8_t what);
+static uint8_t trace_paused;
+
+void trace_reset(void)
+{
+  atomic_store(&claimed, 0);
+  atomic_store(&committed, 0);
+}
+
+void trace_set_clock(uint64_t (*clock)(void))
+{
+  trace_clock = clock ? clock : default_clock;
+}
+
+void trace_select_stream(uint16_t stream)
+{
+  current_stream = stream;
+}
+
+void trace_sample(uint32_t seq)
+{
+  current_seq = seq;
+}
+
+void trace_set_observer(void (*observer)(uint8_t kind, uint8_t what))
+{
+  trace_observer = observer;
+}
+
+void trace_pause(uint8_t paused)
+{
+  trace_paused = paused;
+}
+
+void trace_record(uint8_t kind, uint8_t what, uint32_t seq, time_accel_t time)
+{
+  if (trace_paused)
+    return;
+  if (trace_observer)
+  {
+    trace_observer(kind, what);
+    return;
+  }
+
+  uint_fast32_t index = atomic_load_explicit(&committed, memory_order_relaxed);
+  atomic_store_explicit(&claimed, index + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  trace_event_t *event = &events[index & (TRACE_EVENTS - 1)];
+  event->timestamp = trace_clock();
+  event->seq = kind == TRACE_DECIDE ? seq : current_seq;
+  event->time = time;
+  event->stream = current_stream;
+  event->kind = kind;
+  event->what = what;
+
+  atomic_store_explicit(&committed, index + 1, memory_order_release);
+}
+
+uint32_t trace_snapshot(trace_event_t *out, uint32_t max)
+{
+  uint_fast32_t end = atomic_load_explicit(&committed, memory_order_acquire);
+  uint_fast32_t start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+  if (end - start > max)
+    start = end - max;
+
+  for (uint_fast32_t i = start; i < end; i++)
+    out[i - start] = events[i & (TRACE_EVENTS - 1)];
+
+  /* the slots claimed since the copy started may be torn */
+  atomic_thread_fence(memory_order_acquire);
+  uint_fast32_t reused = atomic_load_explicit(&claimed, memory_order_relaxed);
+  uint_fast32_t first = reused > TRACE_EVENTS ? reused - TRACE_EVENTS : 0;
+  if (first <= start)
+    return (uint32_t)(end - start);
+  if (first >= end)
+    return 0;
+  for (uint_fast32_t i = first; i < end; i++)
+    out[i - first] = out[i - start];
+  return (uint32_t)(end - first);
+}
+
+uint32_t trace_write_chrome(FILE *file)
+{
+  trace_event_t *copy = malloc(TRACE_EVENTS * sizeof(trace_event_t));
+  if (copy == NULL)
+    return 0;
+  uint32_t count = trace_snapshot(copy, TRACE_EVENTS);
+
+  /* the oldest sample may have lost its first events */
+  uint32_t first = 0;
+  while (first < count && !(copy[first].kind == TRACE_BEGIN && copy[first].what == TRACE_PRE_PROCESS))
+    first++;
+
+  uint32_t written = 0;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (uint32_t i = first; i < count; i++)
+  {
+    const trace_event_t *event = &copy[i];
+    uint64_t ts = event->timestamp - copy[first].timestamp;
+
+    fprintf(file, "%s\n{\"ts\":%llu.%03llu,\"pid\":1,\"tid\":%u,", written ? "," : "",
+            (unsigned long long)(ts / 1000), (unsigned long long)(ts % 1000), event->stream);
+    if (event->kind == TRACE_DECIDE)
+      fprintf(file, "\"name\":\"%s\",\"cat\":\"decision\",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"seq\":%u,\"time\":%lld}}",
+              decision_names[event->what], event->seq, (long long)event->time);
+    else
+      fprintf(file, "\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"%s\",\"args\":{\"seq\":%u}}",
+              stage_names[event->what], event->kind == TRACE_BEGIN ? "B" : "E", event->seq);
+    written++;
+  }
+  fprintf(file, "\n]}\n");
+
+  free(copy);
+  return written;
+}
+
+#endif
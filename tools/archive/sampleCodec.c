@@ -0,0 +1,292 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "sampleCodec.h"
+
+#define TIME_WIDTH_MAX 32
+#define AXIS_WIDTH_MAX 17
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LITTLE16(v) __builtin_bswap16(v)
+#define LITTLE32(v) __builtin_bswap32(v)
+#define LITTLE64(v) __builtin_bswap64(v)
+#else
+#define LITTLE16(v) (v)
+#define LITTLE32(v) (v)
+#define LITTLE64(v) (v)
+#endif
+
+static inline void store16(uint8_t *out, uint16_t value)
+{
+  value = LITTLE16(value);
+  memcpy(out, &value, sizeof(value));
+}
+
+static inline void store32(uint8_t *out, uint32_t value)
+{
+  value = LITTLE32(value);
+  memcpy(out, &value, sizeof(value));
+}
+
+static inline uint16_t load16(const uint8_t *in)
+{
+  uint16_t value;
+  memcpy(&value, in, sizeof(value));
+  return LITTLE16(value);
+}
+
+static inline uint32_t load32(const uint8_t *in)
+{
+  uint32_t value;
+  memcpy(&value, in, sizeof(value));
+  return LITTLE32(value);
+}
+
+static inline uint64_t load64(const uint8_t *in)
+{
+  uint64_t value;
+  memcpy(&value, in, sizeof(value));
+  return LITTLE64(value);
+}
+
+static inline uint32_t zigzag(uint32_t value)
+{
+  return (value << 1) ^ (uint32_t)-(int32_t)(value >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value)
+{
+  return (value >> 1) ^ (uint32_t)-(int32_t)(value & 1);
+}
+
+static uint8_t bitWidth(const uint32_t *values)
+{
+  uint32_t all = 0;
+  for (unsigned i = 0; i < SAMPLE_CODEC_BLOCK; i++)
+    all |= values[i];
+  uint8_t width = 0;
+  while (all)
+  {
+    width++;
+    all >>= 1;
+  }
+  return width;
+}
+
+/* Bytes of a packed stream */
+static inline size_t packedBytes(uint8_t width)
+{
+  return (size_t)SAMPLE_CODEC_BLOCK * width / 8;
+}
+
+static size_t pack(const uint32_t *values, uint8_t width, uint8_t *out)
+{
+  uint64_t bits = 0;
+  unsigned used = 0;
+  uint8_t *start = out;
+  for (unsigned i = 0; i < SAMPLE_CODEC_BLOCK; i++)
+  {
+    bits |= (uint64_t)values[i] << used;
+    used += width;
+    while (used >= 8)
+    {
+      *out++ = (uint8_t)bits;
+      bits >>= 8;
+      used -= 8;
+    }
+  }
+  return (size_t)(out - start);
+}
+
+/*
+ * Unpacks a stream that is followed by 8 readable bytes, in groups of 8 values
+ * that take width bytes. There is one function per width so that the shifts and
+ * offsets are constants.
+ */
+#define UNPACK_ONE(in, i, width, mask) ((uint32_t)((load64((in) + ((i) * (width) >> 3)) >> ((i) * (width) & 7)) & (mask)))
+#define UNPACK(width)                                                                         \
+  static void unpack##width(const uint8_t *in, uint32_t *out)                                 \
+  {                                                                                           \
+    const uint64_t mask = ((uint64_t)1 << width) - 1;                                         \
+    for (unsigned group = 0; group < SAMPLE_CODEC_BLOCK / 8; group++, in += width, out += 8)  \
+    {                                                                                         \
+      out[0] = UNPACK_ONE(in, 0, width, mask);                                                \
+      out[1] = UNPACK_ONE(in, 1, width, mask);                                                \
+      out[2] = UNPACK_ONE(in, 2, width, mask);                                                \
+      out[3] = UNPACK_ONE(in, 3, width, mask);                                                \
+      out[4] = UNPACK_ONE(in, 4, width, mask);                                                \
+      out[5] = UNPACK_ONE(in, 5, width, mask);                                                \
+      out[6] = UNPACK_ONE(in, 6, width, mask);                                                \
+      out[7] = UNPACK_ONE(in, 7, width, mask);                                                \
+    }                                                                                         \
+  }
+UNPACK(1) UNPACK(2) UNPACK(3) UNPACK(4) UNPACK(5) UNPACK(6) UNPACK(7) UNPACK(8)
+UNPACK(9) UNPACK(10) UNPACK(11) UNPACK(12) UNPACK(13) UNPACK(14) UNPACK(15) UNPACK(16)
+UNPACK(17) UNPACK(18) UNPACK(19) UNPACK(20) UNPACK(21) UNPACK(22) UNPACK(23) UNPACK(24)
+UNPACK(25) UNPACK(26) UNPACK(27) UNPACK(28) UNPACK(29) UNPACK(30) UNPACK(31) UNPACK(32)
+
+static void (*const unpackers[33])(const uint8_t *in, uint32_t *out) = {
+    NULL, unpack1, unpack2, unpack3, unpack4, unpack5, unpack6, unpack7, unpack8,
+    unpack9, unpack10, unpack11, unpack12, unpack13, unpack14, unpack15, unpack16,
+    unpack17, unpack18, unpack19, unpack20, unpack21, unpack22, unpack23, unpack24,
+    unpack25, unpack26, unpack27, unpack28, unpack29, unpack30, unpack31, unpack32};
+
+static void unpack(const uint8_t *in, uint8_t width, uint32_t *out)
+{
+  if (width)
+    unpackers[width](in, out);
+  else
+    memset(out, 0, SAMPLE_CODEC_BLOCK * sizeof(*out));
+}
+
+size_t sample_codec_header(uint8_t *out)
+{
+  store32(out, SAMPLE_CODEC_MAGIC);
+  store16(out + 4, SAMPLE_CODEC_VERSION);
+  store16(out + 6, SAMPLE_CODEC_BLOCK);
+  return SAMPLE_CODEC_HEADER_BYTES;
+}
+
+size_t sample_codec_encode_block(const time_accel_t *time, const accel_t *x, const accel_t *y, const accel_t *z,
+                                 uint16_t count, uint8_t *out)
+{
+  uint32_t residuals[4][SAMPLE_CODEC_BLOCK] = {{0}};
+  const accel_t *axes[3] = {x, y, z};
+  uint32_t first = count > 1 ? (uint32_t)time[1] - (uint32_t)time[0] : 0;
+
+  /* delta of delta of the times from the first delta, wrapping so that any time goes through */
+  uint32_t previous = first;
+  for (uint16_t i = 1; i < count; i++)
+  {
+    uint32_t delta = (uint32_t)time[i] - (uint32_t)time[i - 1];
+    residuals[0][i] = zigzag(delta - previous);
+    previous = delta;
+  }
+  for (int a = 0; a < 3; a++)
+    for (uint16_t i = 1; i < count; i++)
+      residuals[a + 1][i] = zigzag((uint32_t)((int32_t)axes[a][i] - axes[a][i - 1]));
+
+  store16(out, count);
+  for (int s = 0; s < 4; s++)
+    out[2 + s] = bitWidth(residuals[s]);
+  store32(out + 6, (uint32_t)time[0]);
+  store32(out + 10, first);
+  for (int a = 0; a < 3; a++)
+    store16(out + 14 + 2 * a, (uint16_t)axes[a][0]);
+
+  size_t size = SAMPLE_CODEC_BLOCK_HEADER_BYTES;
+  for (int s = 0; s < 4; s++)
+    size += pack(residuals[s], out[2 + s], out + size);
+  return size;
+}
+
+size_t sample_codec_end(uint8_t *out)
+{
+  memset(out, 0, SAMPLE_CODEC_END_BYTES);
+  return SAMPLE_CODEC_END_BYTES;
+}
+
+/* Decodes a block known to be followed by 8 readable bytes */
+static void decodeStreams(const uint8_t *in, uint16_t count, sample_block_t *block)
+{
+  uint32_t residuals[4][SAMPLE_CODEC_BLOCK];
+  const uint8_t *packed = in + SAMPLE_CODEC_BLOCK_HEADER_BYTES;
+
+  for (int s = 0; s < 4; s++)
+  {
+    unpack(packed, in[2 + s], residuals[s]);
+    packed += packedBytes(in[2 + s]);
+  }
+
+  /* the four running sums in one loop, so that each waits less on its previous value */
+  uint32_t delta = load32(in + 10);
+  uint32_t time = load32(in + 6) - delta;
+  uint16_t x = load16(in + 14);
+  uint16_t y = load16(in + 16);
+  uint16_t z = load16(in + 18);
+  for (uint16_t i = 0; i < count; i++)
+  {
+    delta += unzigzag(residuals[0][i]);
+    block->time[i] = (time_accel_t)(time += delta);
+    block->x[i] = (accel_t)(x += (uint16_t)unzigzag(residuals[1][i]));
+    block->y[i] = (accel_t)(y += (uint16_t)unzigzag(residuals[2][i]));
+    block->z[i] = (accel_t)(z += (uint16_t)unzigzag(residuals[3][i]));
+  }
+  block->count = count;
+}
+
+size_t sample_codec_decode_block(const uint8_t *in, size_t size, sample_block_t *block)
+{
+  block->count = 0;
+  if (size < 2)
+    return 0;
+  uint16_t count = load16(in);
+  if (count == 0)
+    return size >= SAMPLE_CODEC_END_BYTES ? SAMPLE_CODEC_END_BYTES : 0;
+  if (count > SAMPLE_CODEC_BLOCK || size < SAMPLE_CODEC_BLOCK_HEADER_BYTES)
+    return 0;
+  if (in[2] > TIME_WIDTH_MAX || in[3] > AXIS_WIDTH_MAX || in[4] > AXIS_WIDTH_MAX || in[5] > AXIS_WIDTH_MAX)
+    return 0;
+
+  size_t needed = SAMPLE_CODEC_BLOCK_HEADER_BYTES;
+  for (int s = 0; s < 4; s++)
+    needed += packedBytes(in[2 + s]);
+  if (size < needed)
+    return 0;
+
+  if (size - needed >= 8)
+    decodeStreams(in, count, block);
+  else
+  {
+    /* the last block of a buffer, copied so that the loads past its end stay in bounds */
+    uint8_t padded[SAMPLE_CODEC_MAX_BLOCK_BYTES + 8] = {0};
+    memcpy(padded, in, needed);
+    decodeStreams(padded, count, block);
+  }
+  return needed;
+}
+
+int sample_decoder_init(sample_decoder_t *decoder, const uint8_t *data, size_t size)
+{
+  int valid = size >= SAMPLE_CODEC_HEADER_BYTES && load32(data) == SAMPLE_CODEC_MAGIC &&
+              load16(data + 4) == SAMPLE_CODEC_VERSION && load16(data + 6) <= SAMPLE_CODEC_BLOCK;
+  decoder->next = valid ? data + SAMPLE_CODEC_HEADER_BYTES : NULL;
+  decoder->end = data + size;
+  decoder->error = !valid;
+  return valid;
+}
+
+uint16_t sample_decoder_next(sample_decoder_t *decoder, sample_block_t *block)
+{
+  block->count = 0;
+  if (decoder->next == NULL)
+    return 0;
+  size_t size = sample_codec_decode_block(decoder->next, (size_t)(decoder->end - decoder->next), block);
+  if (size == 0)
+    decoder->error = 1; /* corrupt, or truncated before the closing block */
+  decoder->next = block->count ? decoder->next + size : NULL;
+  return block->count;
+}
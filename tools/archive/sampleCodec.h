@@ -0,0 +1,128 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Lossless codec for archives of accelerometer samples (time, X, Y, Z).
+ * Samples are coded in blocks of up to SAMPLE_CODEC_BLOCK that decode on their own.
+ * A block keeps its first sample and the first time delta as is, then the delta of
+ * delta of the times and the delta of every axis, zigzag coded so that small values
+ * of either sign take few bits. Each of the four streams is bit-packed with the
+ * width of its largest value in the block, always SAMPLE_CODEC_BLOCK values padded
+ * with zeros, so that they unpack in groups of 8 with one unaligned 64 bit load per
+ * value and no branches. An archive is a header followed by blocks and an empty
+ * block closing it, all little endian.
+ */
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+#include <stddef.h>
+#include "config.h"
+
+#define SAMPLE_CODEC_MAGIC 0x41505453u /* "STPA" */
+#define SAMPLE_CODEC_VERSION 1
+#define SAMPLE_CODEC_BLOCK 128 /* samples per block, a multiple of 8 */
+#define SAMPLE_CODEC_HEADER_BYTES 8
+#define SAMPLE_CODEC_BLOCK_HEADER_BYTES 20
+/* Largest coded block: 32 bits per time and 17 per axis */
+#define SAMPLE_CODEC_MAX_BLOCK_BYTES (SAMPLE_CODEC_BLOCK_HEADER_BYTES + SAMPLE_CODEC_BLOCK * (32 + 3 * 17) / 8)
+#define SAMPLE_CODEC_END_BYTES 8 /* the empty block, padded */
+
+typedef struct sample_block_t sample_block_t;
+
+struct sample_block_t
+{
+  time_accel_t time[SAMPLE_CODEC_BLOCK];
+  accel_t x[SAMPLE_CODEC_BLOCK];
+  accel_t y[SAMPLE_CODEC_BLOCK];
+  accel_t z[SAMPLE_CODEC_BLOCK];
+  uint16_t count;
+};
+
+/**
+ * Reads the blocks of an archive in memory, e.g. a mapped file, one at a time.
+ */
+typedef struct sample_decoder_t sample_decoder_t;
+
+struct sample_decoder_t
+{
+  const uint8_t *next; /* NULL once closed */
+  const uint8_t *end;
+  int error; /* set when the archive is corrupt or truncated */
+};
+
+/**
+ * Writes the header of an archive.
+ * @param out At least SAMPLE_CODEC_HEADER_BYTES.
+ * @return The bytes written.
+ */
+size_t sample_codec_header(uint8_t *out);
+
+/**
+ * Codes a block of samples.
+ * @param time The times, in ms.
+ * @param x The X axis.
+ * @param y The Y axis.
+ * @param z The Z axis.
+ * @param count Samples, from 1 to SAMPLE_CODEC_BLOCK.
+ * @param out At least SAMPLE_CODEC_MAX_BLOCK_BYTES.
+ * @return The bytes written.
+ */
+size_t sample_codec_encode_block(const time_accel_t *time, const accel_t *x, const accel_t *y, const accel_t *z,
+                                 uint16_t count, uint8_t *out);
+
+/**
+ * Writes the empty block that closes an archive.
+ * @param out At least SAMPLE_CODEC_END_BYTES.
+ * @return The bytes written.
+ */
+size_t sample_codec_end(uint8_t *out);
+
+/**
+ * Decodes one block.
+ * @param in The block.
+ * @param size Bytes available from in.
+ * @param block Where the samples are written, count is 0 for the closing block.
+ * @return The bytes of the block; 0 if it is corrupt or truncated.
+ */
+size_t sample_codec_decode_block(const uint8_t *in, size_t size, sample_block_t *block);
+
+/**
+ * Starts reading an archive.
+ * @param decoder The decoder.
+ * @param data The archive, kept by the caller while it is read.
+ * @param size Its size in bytes.
+ * @return 1 if it starts with the header of a supported version; 0 otherwise.
+ */
+int sample_decoder_init(sample_decoder_t *decoder, const uint8_t *data, size_t size);
+
+/**
+ * Decodes the next block.
+ * @param decoder The decoder.
+ * @param block Where the samples are written.
+ * @return The samples decoded; 0 at the end of the archive or on error, see error.
+ */
+uint16_t sample_decoder_next(sample_decoder_t *decoder, sample_block_t *block);
+
+#endif
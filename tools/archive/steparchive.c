@@ -0,0 +1,291 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Archives recordings of time(ms), X, Y, Z with the codec of sampleCodec.h.
+ * -c codes a CSV into an archive and -x writes an archive back as CSV, both
+ * streaming a block at a time. -s reports the compression ratio of CSVs against
+ * the text and the raw samples (10 bytes each), checks that they decode to the
+ * same samples and measures the coding and decoding speed in memory.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sampleCodec.h"
+#include "recording.h"
+
+#define RAW_SAMPLE_BYTES (sizeof(time_accel_t) + 3 * sizeof(accel_t))
+#define MIN_TIMING_NS 200000000LL /* each speed is measured over at least this long */
+
+static volatile uint64_t sink; /* keeps the timed decoding from being optimized out */
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int writeAll(FILE *out, const uint8_t *data, size_t size)
+{
+    return fwrite(data, 1, size, out) == size;
+}
+
+/* CSV to archive, lines that are not samples are skipped */
+static int compress(FILE *in, FILE *out)
+{
+    uint8_t coded[SAMPLE_CODEC_MAX_BLOCK_BYTES];
+    sample_block_t block;
+    char line[256];
+    int ok = writeAll(out, coded, sample_codec_header(coded));
+
+    block.count = 0;
+    while (ok && fgets(line, sizeof(line), in))
+    {
+        long t;
+        int x, y, z;
+        if (sscanf(line, "%ld , %d , %d , %d", &t, &x, &y, &z) != 4)
+            continue;
+        block.time[block.count] = (time_accel_t)t;
+        block.x[block.count] = (accel_t)x;
+        block.y[block.count] = (accel_t)y;
+        block.z[block.count] = (accel_t)z;
+        if (++block.count == SAMPLE_CODEC_BLOCK)
+        {
+            ok = writeAll(out, coded, sample_codec_encode_block(block.time, block.x, block.y, block.z, block.count, coded));
+            block.count = 0;
+        }
+    }
+    if (ok && block.count)
+        ok = writeAll(out, coded, sample_codec_encode_block(block.time, block.x, block.y, block.z, block.count, coded));
+    return ok && writeAll(out, coded, sample_codec_end(coded));
+}
+
+static uint8_t *readFile(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    struct stat st;
+    if (!file || fstat(fileno(file), &st) < 0)
+    {
+        perror(path);
+        if (file)
+            fclose(file);
+        return NULL;
+    }
+    uint8_t *data = malloc((size_t)st.st_size + 1);
+    *size = fread(data, 1, (size_t)st.st_size, file);
+    fclose(file);
+    return data;
+}
+
+/* Archive to CSV */
+static int extract(const char *path, FILE *out)
+{
+    size_t size;
+    uint8_t *data = readFile(path, &size);
+    if (!data)
+        return 0;
+
+    sample_decoder_t decoder;
+    sample_block_t block;
+    if (!sample_decoder_init(&decoder, data, size))
+        fprintf(stderr, "%s: not an archive\n", path);
+    while (sample_decoder_next(&decoder, &block))
+        for (uint16_t i = 0; i < block.count; i++)
+            fprintf(out, "%d, %d, %d, %d\n", block.time[i], block.x[i], block.y[i], block.z[i]);
+    if (decoder.error)
+        fprintf(stderr, "%s: corrupt or truncated archive\n", path);
+    free(data);
+    return !decoder.error;
+}
+
+/* Codes a recording in memory, returns the bytes of the archive */
+static size_t encodeRecording(const recording_t *rec, uint8_t *out)
+{
+    size_t size = sample_codec_header(out);
+    for (size_t i = 0; i < rec->count; i += SAMPLE_CODEC_BLOCK)
+    {
+        uint16_t count = rec->count - i < SAMPLE_CODEC_BLOCK ? (uint16_t)(rec->count - i) : SAMPLE_CODEC_BLOCK;
+        size += sample_codec_encode_block(rec->time + i, rec->x + i, rec->y + i, rec->z + i, count, out + size);
+    }
+    return size + sample_codec_end(out + size);
+}
+
+/* Decodes an archive in memory, comparing it to the recording when given. Returns the samples, -1 on error */
+static long decodeArchive(const uint8_t *data, size_t size, const recording_t *rec, uint64_t *checksum)
+{
+    sample_decoder_t decoder;
+    sample_block_t block;
+    long samples = 0;
+
+    sample_decoder_init(&decoder, data, size);
+    while (sample_decoder_next(&decoder, &block))
+    {
+        if (rec && ((size_t)samples + block.count > rec->count ||
+                    memcmp(block.time, rec->time + samples, block.count * sizeof(time_accel_t)) ||
+                    memcmp(block.x, rec->x + samples, block.count * sizeof(accel_t)) ||
+                    memcmp(block.y, rec->y + samples, block.count * sizeof(accel_t)) ||
+                    memcmp(block.z, rec->z + samples, block.count * sizeof(accel_t))))
+            return -1;
+        *checksum += (uint32_t)block.time[block.count - 1] + (uint16_t)block.z[block.count - 1];
+        samples += block.count;
+    }
+    return decoder.error ? -1 : samples;
+}
+
+static int report(char **files, int count)
+{
+    uint64_t totalSamples = 0, totalText = 0, totalArchive = 0;
+    double encodeNs = 0, decodeNs = 0;
+    uint64_t checksum = 0;
+    int failed = 0;
+
+    printf("%-24s %9s %10s %10s %9s %9s %10s %10s\n", "file", "samples", "csv bytes", "archived", "vs csv", "vs raw",
+           "code MB/s", "decode GB/s");
+    for (int f = 0; f < count; f++)
+    {
+        recording_t rec;
+        struct stat st;
+        if (stat(files[f], &st) < 0 || !loadRecording(files[f], &rec))
+        {
+            failed++;
+            continue;
+        }
+        size_t blocks = (rec.count + SAMPLE_CODEC_BLOCK - 1) / SAMPLE_CODEC_BLOCK;
+        uint8_t *archive = malloc(SAMPLE_CODEC_HEADER_BYTES + blocks * SAMPLE_CODEC_MAX_BLOCK_BYTES + SAMPLE_CODEC_END_BYTES);
+        size_t size = encodeRecording(&rec, archive);
+        if (decodeArchive(archive, size, &rec, &checksum) != (long)rec.count)
+        {
+            fprintf(stderr, "%s: does not decode to the same samples\n", files[f]);
+            failed++;
+        }
+
+        /* repeat until the timings are long enough to mean something */
+        long rounds = 0;
+        int64_t start = nowNs(), ns;
+        do
+        {
+            encodeRecording(&rec, archive);
+            rounds++;
+        } while ((ns = nowNs() - start) < MIN_TIMING_NS && rec.count);
+        double fileEncodeNs = (double)ns / rounds;
+
+        rounds = 0;
+        start = nowNs();
+        do
+        {
+            decodeArchive(archive, size, NULL, &checksum);
+            rounds++;
+        } while ((ns = nowNs() - start) < MIN_TIMING_NS && rec.count);
+        double fileDecodeNs = (double)ns / rounds;
+
+        double raw = (double)rec.count * RAW_SAMPLE_BYTES;
+        printf("%-24s %9zu %10lld %10zu %8.2fx %8.2fx %10.0f %10.2f\n", files[f], rec.count, (long long)st.st_size, size,
+               (double)st.st_size / size, raw / size, raw / fileEncodeNs * 1000, raw / fileDecodeNs);
+        totalSamples += rec.count;
+        totalText += (uint64_t)st.st_size;
+        totalArchive += size;
+        encodeNs += fileEncodeNs;
+        decodeNs += fileDecodeNs;
+        free(archive);
+        freeRecording(&rec);
+    }
+
+    double raw = (double)totalSamples * RAW_SAMPLE_BYTES;
+    if (totalArchive)
+        printf("%-24s %9llu %10llu %10llu %8.2fx %8.2fx %10.0f %10.2f\n", "all", (unsigned long long)totalSamples,
+               (unsigned long long)totalText, (unsigned long long)totalArchive, (double)totalText / totalArchive,
+               raw / totalArchive, encodeNs ? raw / encodeNs * 1000 : 0, decodeNs ? raw / decodeNs : 0);
+    sink = checksum;
+    return failed ? 1 : 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s -c [walk.csv] > walk.sca\n"
+            "       %s -x walk.sca > walk.csv\n"
+            "       %s -s walk.csv...\n"
+            "  -c codes a CSV of time(ms), X, Y, Z, stdin by default, lines that are not samples are skipped\n"
+            "  -x writes an archive back as CSV\n"
+            "  -s reports the compression ratio against the CSV and the raw samples (%zu bytes each)\n"
+            "     and the speed of the codec in memory, in bytes of raw samples\n",
+            name, name, name, RAW_SAMPLE_BYTES);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int mode = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "cxsh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+        case 'x':
+        case 's':
+            mode = opt;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    switch (mode)
+    {
+    case 'c':
+    {
+        FILE *in = optind < argc ? fopen(argv[optind], "r") : stdin;
+        if (!in)
+        {
+            perror(argv[optind]);
+            return 1;
+        }
+        int ok = compress(in, stdout) && fflush(stdout) == 0;
+        if (!ok)
+            perror("steparchive");
+        return ok ? 0 : 1;
+    }
+    case 'x':
+        if (optind != argc - 1)
+            usage(argv[0]);
+        return extract(argv[optind], stdout) ? 0 : 1;
+    case 's':
+        if (optind >= argc)
+            usage(argv[0]);
+        return report(argv + optind, argc - optind);
+    default:
+        usage(argv[0]);
+    }
+    return 1;
+}
@@ -0,0 +1,139 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perfCounters.h"
+
+static const char *names[PERF_COUNTERS] = {"instructions", "cycles", "branch-misses", "L1d-misses", "LLC-misses",
+                                           "task-clock ns"};
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define CACHE_READ_MISSES(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const uint32_t types[PERF_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                              PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_SOFTWARE};
+static const uint64_t configs[PERF_COUNTERS] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+                                                PERF_COUNT_HW_BRANCH_MISSES, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D),
+                                                CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL), PERF_COUNT_SW_TASK_CLOCK};
+
+int perf_counters_open(perf_counters_t *counters)
+{
+  counters->leader = -1;
+  counters->opened = 0;
+  counters->error = 0;
+
+  for (int i = 0; i < PERF_COUNTERS; i++)
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[i];
+    attr.config = configs[i];
+    attr.disabled = counters->leader == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    counters->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, counters->leader, 0);
+    if (counters->fds[i] == -1)
+    {
+      if (counters->error == 0 && types[i] != PERF_TYPE_SOFTWARE)
+        counters->error = errno;
+      continue;
+    }
+    if (counters->leader == -1)
+      counters->leader = counters->fds[i];
+    counters->slot[i] = counters->opened++;
+  }
+
+  if (counters->leader != -1)
+  {
+    ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  return counters->opened;
+}
+
+void perf_counters_read(const perf_counters_t *counters, uint64_t values[PERF_COUNTERS])
+{
+  uint64_t group[1 + PERF_COUNTERS] = {0};
+
+  if (counters->leader == -1 || read(counters->leader, group, sizeof(group)) <= 0)
+    group[0] = 0;
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    values[i] = counters->fds[i] != -1 && counters->slot[i] < group[0] ? group[1 + counters->slot[i]] : 0;
+}
+
+void perf_counters_close(perf_counters_t *counters)
+{
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    if (counters->fds[i] != -1)
+      close(counters->fds[i]);
+  counters->leader = -1;
+  counters->opened = 0;
+}
+
+#else
+
+int perf_counters_open(perf_counters_t *counters)
+{
+  counters->leader = -1;
+  counters->opened = 0;
+  counters->error = ENOSYS;
+  for (int i = 0; i < PERF_COUNTERS; i++)
+    counters->fds[i] = -1;
+  return 0;
+}
+
+void perf_counters_read(const perf_counters_t *counters, uint64_t values[PERF_COUNTERS])
+{
+  (void)counters;
+  memset(values, 0, PERF_COUNTERS * sizeof(uint64_t));
+}
+
+void perf_counters_close(perf_counters_t *counters)
+{
+  counters->opened = 0;
+}
+
+#endif
+
+int perf_counters_available(const perf_counters_t *counters, int counter)
+{
+  return counters->fds[counter] != -1;
+}
+
+const char *perf_counters_name(int counter)
+{
+  return names[counter];
+}
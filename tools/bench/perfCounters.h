@@ -0,0 +1,90 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+/**
+ * @file
+ * Hardware performance counters of the calling thread, read with perf_event_open.
+ * The counters are opened as one group so that a single read returns all of them
+ * for the same instructions. Counters that cannot be opened, e.g. the hardware
+ * ones in a container or a VM, are left out and the CPU time of the task is
+ * always counted, so the callers still get a profile.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <stdint.h>
+
+/* Counters, in the order of the values */
+#define PERF_INSTRUCTIONS 0
+#define PERF_CYCLES 1
+#define PERF_BRANCH_MISSES 2
+#define PERF_L1D_MISSES 3 /* L1 data cache read misses */
+#define PERF_LLC_MISSES 4 /* last level cache read misses */
+#define PERF_TASK_CLOCK 5 /* ns of CPU time */
+#define PERF_COUNTERS 6
+
+typedef struct perf_counters_t perf_counters_t;
+
+struct perf_counters_t
+{
+  int leader;                  /* fd read for the whole group, -1 if nothing could be opened */
+  int fds[PERF_COUNTERS];      /* -1 for the counters left out */
+  uint8_t slot[PERF_COUNTERS]; /* position of each counter in a group read */
+  uint8_t opened;
+  int error;                   /* errno of the first hardware counter that failed, 0 if none */
+};
+
+/**
+ * Opens and starts the counters of the calling thread, user space only.
+ * @param counters The counters.
+ * @return The number of counters opened.
+ */
+int perf_counters_open(perf_counters_t *counters);
+
+/**
+ * @param counters The counters.
+ * @param counter One of the PERF_ counters.
+ * @return 1 if the counter is counted.
+ */
+int perf_counters_available(const perf_counters_t *counters, int counter);
+
+/**
+ * Reads all the counters at once, the ones left out read 0.
+ * @param counters The counters.
+ * @param values Where the PERF_COUNTERS values are written.
+ */
+void perf_counters_read(const perf_counters_t *counters, uint64_t values[PERF_COUNTERS]);
+
+/**
+ * Closes the counters.
+ * @param counters The counters.
+ */
+void perf_counters_close(perf_counters_t *counters);
+
+/**
+ * @param counter One of the PERF_ counters.
+ * @return Its name.
+ */
+const char *perf_counters_name(int counter);
+
+#endif
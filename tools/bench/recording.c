@@ -0,0 +1,76 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "recording.h"
+
+int loadRecording(const char *path, recording_t *rec)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return 0;
+    }
+
+    size_t capacity = 4096;
+    rec->count = 0;
+    rec->time = malloc(capacity * sizeof(*rec->time));
+    rec->x = malloc(capacity * sizeof(*rec->x));
+    rec->y = malloc(capacity * sizeof(*rec->y));
+    rec->z = malloc(capacity * sizeof(*rec->z));
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        long t;
+        int x, y, z;
+        if (sscanf(line, "%ld , %d , %d , %d", &t, &x, &y, &z) != 4)
+            continue; /* header or blank line */
+        if (rec->count == capacity)
+        {
+            capacity *= 2;
+            rec->time = realloc(rec->time, capacity * sizeof(*rec->time));
+            rec->x = realloc(rec->x, capacity * sizeof(*rec->x));
+            rec->y = realloc(rec->y, capacity * sizeof(*rec->y));
+            rec->z = realloc(rec->z, capacity * sizeof(*rec->z));
+        }
+        rec->time[rec->count] = (time_accel_t)t;
+        rec->x[rec->count] = (accel_t)x;
+        rec->y[rec->count] = (accel_t)y;
+        rec->z[rec->count] = (accel_t)z;
+        rec->count++;
+    }
+    fclose(file);
+    return 1;
+}
+
+void freeRecording(recording_t *rec)
+{
+    free(rec->time);
+    free(rec->x);
+    free(rec->y);
+    free(rec->z);
+}
@@ -0,0 +1,51 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef BENCH_RECORDING_H
+#define BENCH_RECORDING_H
+#include <stddef.h>
+#include "config.h"
+
+/**
+ * @file
+ * Recorded walks for the benchmark tools.
+ * A recording is a CSV of time(ms), X, Y, Z as in the tuning procedure of the
+ * readme, loaded in memory so that replaying it does no I/O.
+ */
+
+typedef struct recording_t recording_t;
+
+struct recording_t
+{
+    time_accel_t *time;
+    accel_t *x;
+    accel_t *y;
+    accel_t *z;
+    size_t count;
+};
+
+/* Loads a CSV, lines that are not samples are skipped. Returns 0 if the file cannot be read */
+int loadRecording(const char *path, recording_t *rec);
+void freeRecording(recording_t *rec);
+
+#endif
@@ -0,0 +1,678 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Benchmark runner over a corpus of recorded walks.
+ * Every file is a CSV of time(ms), X, Y, Z as in the tuning procedure of the readme.
+ * Each file is replayed in the default and in the low latency mode and the steps,
+ * the error against the counted steps and the detection latency of every accepted
+ * step (provisional and confirmed) are reported, so that the accuracy/latency
+ * trade-off can be compared on the same recordings.
+ * With -g synthetic walks (gaitGen.h) are replayed too, scored against the steps
+ * they were generated with.
+ * With -i the CPU time spent on a still wearer is measured instead, with and
+ * without the idle duty cycling.
+ * With -t every replay is also written as a Chrome trace, if the library was
+ * built with TRACE_STAGES.
+ * With -p the perf_event_open counters (instructions, cycles, branch and cache
+ * misses) are read around the replays and reported per sample, for each stage too
+ * if the library was built with TRACE_STAGES. Where the hardware counters cannot
+ * be opened, e.g. in a container, only the CPU time is reported.
+ * With -w a range of scoring window sizes is compared instead, all of them in a
+ * single replay per mode as shadow branches of the default pipeline.
+ * With -c the same synthetic walks are replayed at several sensor rates instead and
+ * the distance and the kcal per step are checked against those at REFERENCE_RATE_HZ,
+ * the exit status is 1 if a rate is out of tolerance.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "StepCountingAlgo.h"
+#include "tracer.h"
+#include "recording.h"
+#include "perfCounters.h"
+#include "gaitGen.h"
+
+#define MODES 2
+#define GAIT_SECONDS 90 /* length of the synthetic walks */
+#define PROFILE_ROWS 8 /* the stages, then the time outside of them */
+#define SWEEP_WINDOWS MULTI_SCORING_WINDOWS
+#define CHECK_WALKS 5       /* synthetic walks replayed at every rate by -c, unless -g is given */
+#define CHECK_TOLERANCE 0.2 /* relative difference of the distance and kcal per step allowed by -c */
+
+typedef struct profile_t profile_t;
+
+/* Counters summed over the corpus, per mode */
+struct profile_t
+{
+    uint64_t batch[PERF_COUNTERS];
+    uint64_t stages[PROFILE_ROWS][PERF_COUNTERS];
+    uint64_t samples;
+    uint64_t stageSamples;
+};
+
+typedef struct latencies_t latencies_t;
+
+struct latencies_t
+{
+    time_accel_t *provisional;
+    time_accel_t *confirmed;
+    size_t provisionalCount;
+    size_t confirmedCount;
+    size_t capacity;
+};
+
+static const char *modeNames[MODES] = {"default", "low"};
+
+/* Rates replayed by -c, the reference first */
+static const uint16_t checkedRates[] = {REFERENCE_RATE_HZ, 40, 60, 100, 150, MAX_RATE_HZ};
+
+/* Rates at which -c also replays without idle duty cycling, the motion detection backlog refills slowest there */
+static const uint16_t gatedRates[] = {MIN_RATE_HZ, 25};
+
+/* Set to replay with the idle duty cycling off */
+static uint8_t noDutyCycle;
+
+static latencies_t latencies;
+
+static const char *profileRows[PROFILE_ROWS] = {"pre-processing", "decimation", "motion detection", "filter",
+                                                "scoring", "detection", "post-processing", "outside stages"};
+
+static int profiling;
+static perf_counters_t counters;
+static profile_t profiles[MODES];
+
+static multi_scoring_t sweepScoring;
+static shadow_branch_t sweepBranches[SWEEP_WINDOWS];
+
+static void onStep(const step_notice_t *notice)
+{
+    if (latencies.provisionalCount == latencies.capacity || latencies.confirmedCount == latencies.capacity)
+    {
+        latencies.capacity = latencies.capacity ? latencies.capacity * 2 : 1024;
+        latencies.provisional = realloc(latencies.provisional, latencies.capacity * sizeof(time_accel_t));
+        latencies.confirmed = realloc(latencies.confirmed, latencies.capacity * sizeof(time_accel_t));
+    }
+    if (notice->kind == STEP_PROVISIONAL)
+        latencies.provisional[latencies.provisionalCount++] = notice->latencyMs;
+    else
+        latencies.confirmed[latencies.confirmedCount++] = notice->latencyMs;
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+    time_accel_t ta = *(const time_accel_t *)a;
+    time_accel_t tb = *(const time_accel_t *)b;
+    return (ta > tb) - (ta < tb);
+}
+
+static time_accel_t percentile(time_accel_t *values, size_t count, double p)
+{
+    if (count == 0)
+        return 0;
+    qsort(values, count, sizeof(*values), compareTimes);
+    return values[(size_t)(p * (count - 1))];
+}
+
+/* Initializes the algorithm for a replay */
+static void startReplay(uint8_t mode, uint16_t rateHz, uint8_t decimation)
+{
+    if (!initAlgoWithRate("M", 30, 180, 80, rateHz, 1))
+    {
+        fprintf(stderr, "unsupported rate %u Hz\n", rateHz);
+        exit(1);
+    }
+    if (decimation && !changeDecimation(decimation))
+    {
+        fprintf(stderr, "cannot decimate %u Hz by %u\n", rateHz, decimation);
+        exit(1);
+    }
+    if (noDutyCycle)
+        changeIdleDutyCycle(0, 1);
+    changeLatencyMode(mode);
+    setStepListener(onStep);
+#ifdef TRACE_PIPELINE
+    trace_reset();
+#endif
+}
+
+static steps_t replay(const recording_t *rec, uint8_t mode, uint16_t rateHz, uint8_t decimation, double *cpuMs)
+{
+    startReplay(mode, rateHz, decimation);
+
+    uint64_t before[PERF_COUNTERS], after[PERF_COUNTERS];
+    if (profiling)
+        perf_counters_read(&counters, before);
+    clock_t start = clock();
+    for (size_t i = 0; i < rec->count; i++)
+        processSample(rec->time[i], rec->x[i], rec->y[i], rec->z[i]);
+    *cpuMs = (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+    if (profiling)
+    {
+        perf_counters_read(&counters, after);
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            profiles[mode].batch[c] += after[c] - before[c];
+        profiles[mode].samples += rec->count;
+    }
+
+    return getSteps();
+}
+
+#ifdef TRACE_PIPELINE
+/* Stages being run, the innermost last, so that each one is only charged for its own work */
+static uint8_t stageStack[PROFILE_ROWS];
+static int stageDepth;
+static uint64_t lastRead[PERF_COUNTERS];
+static uint64_t readCost[PERF_COUNTERS];
+static uint64_t (*stageCounts)[PERF_COUNTERS];
+
+static void onStageEvent(uint8_t kind, uint8_t what)
+{
+    if (kind == TRACE_DECIDE)
+        return;
+
+    uint64_t now[PERF_COUNTERS];
+    perf_counters_read(&counters, now);
+    uint8_t row = stageDepth ? stageStack[stageDepth - 1] : PROFILE_ROWS - 1;
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        stageCounts[row][c] += now[c] - lastRead[c] > readCost[c] ? now[c] - lastRead[c] - readCost[c] : 0;
+
+    if (kind == TRACE_BEGIN && stageDepth < PROFILE_ROWS)
+        stageStack[stageDepth++] = what;
+    else if (kind == TRACE_END && stageDepth > 0)
+        stageDepth--;
+    /* leave the read itself out of the next stage as far as possible */
+    perf_counters_read(&counters, lastRead);
+}
+
+static int compareCounts(const void *a, const void *b)
+{
+    uint64_t ca = *(const uint64_t *)a;
+    uint64_t cb = *(const uint64_t *)b;
+    return (ca > cb) - (ca < cb);
+}
+
+/* What a read adds to the counts between two reads, the median so that it is taken out of every stage */
+static void calibrateReads(void)
+{
+    static uint64_t costs[PERF_COUNTERS][1001];
+    uint64_t a[PERF_COUNTERS], b[PERF_COUNTERS];
+    for (int i = 0; i < 1001; i++)
+    {
+        perf_counters_read(&counters, a);
+        perf_counters_read(&counters, b);
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            costs[c][i] = b[c] - a[c];
+    }
+    for (int c = 0; c < PERF_COUNTERS; c++)
+    {
+        qsort(costs[c], 1001, sizeof(uint64_t), compareCounts);
+        readCost[c] = costs[c][500];
+    }
+}
+
+/* Replays again reading the counters at every stage boundary, apart from the timed replay as the reads cost a syscall each */
+static void profileStages(const recording_t *rec, uint8_t mode, uint16_t rateHz, uint8_t decimation)
+{
+    initAlgoWithRate("M", 30, 180, 80, rateHz, 1);
+    if (decimation)
+        changeDecimation(decimation);
+    changeLatencyMode(mode);
+    setStepListener(NULL);
+
+    calibrateReads();
+    stageCounts = profiles[mode].stages;
+    stageDepth = 0;
+    trace_set_observer(onStageEvent);
+    perf_counters_read(&counters, lastRead);
+    for (size_t i = 0; i < rec->count; i++)
+        processSample(rec->time[i], rec->x[i], rec->y[i], rec->z[i]);
+    trace_set_observer(NULL);
+    profiles[mode].stageSamples += rec->count;
+}
+#endif
+
+static void printProfile(uint8_t mode)
+{
+    const profile_t *profile = &profiles[mode];
+    if (profile->samples == 0)
+        return;
+
+    printf("\n%s mode, per sample", modeNames[mode]);
+    printf("\n%-18s", "");
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (perf_counters_available(&counters, c))
+            printf(" %14s", perf_counters_name(c));
+    printf("\n%-18s", "processSample");
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (perf_counters_available(&counters, c))
+            printf(" %14.1f", (double)profile->batch[c] / profile->samples);
+    printf("\n");
+    for (int r = 0; r < PROFILE_ROWS && profile->stageSamples; r++)
+    {
+        printf("%-18s", profileRows[r]);
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            if (perf_counters_available(&counters, c))
+                printf(" %14.1f", (double)profile->stages[r][c] / profile->stageSamples);
+        printf("\n");
+    }
+}
+
+#ifdef TRACE_PIPELINE
+/* Writes the trace of the last replay as dir/<recording>-<mode>.json */
+static void writeTrace(const char *dir, const char *path, uint8_t mode)
+{
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    char name[512];
+    snprintf(name, sizeof(name), "%s/%.*s-%s.json", dir, (int)strcspn(base, "."), base, modeNames[mode]);
+
+    FILE *file = fopen(name, "w");
+    if (!file)
+    {
+        perror(name);
+        return;
+    }
+    uint32_t events = trace_write_chrome(file);
+    fclose(file);
+    fprintf(stderr, "%s: %u events\n", name, events);
+}
+#endif
+
+/* Replays once with a shadow branch per window size, adds the steps and the error of each to the totals */
+static void sweepWindows(const recording_t *rec, uint8_t mode, uint16_t rateHz, uint8_t decimation,
+                         int from, int to, long counted, long *steps, long *errors, double *cpuMs)
+{
+    startReplay(mode, rateHz, decimation);
+    setStepListener(NULL);
+    initShadowScoring(&sweepScoring);
+    for (int w = from; w <= to; w++)
+    {
+        shadow_params_t params = {(ring_buffer_size_t)w, OPT_DETECTION_THRESHOLD, OPT_DETECTION_THRESHOLD_FRAC, OPT_TIME_THRESHOLD};
+        addShadowBranch(&sweepBranches[w - from], &params);
+    }
+
+    clock_t start = clock();
+    for (size_t i = 0; i < rec->count; i++)
+        processSample(rec->time[i], rec->x[i], rec->y[i], rec->z[i]);
+    *cpuMs += (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+
+    for (int w = from; w <= to; w++)
+    {
+        shadow_stats_t stats;
+        getShadowStats(&sweepBranches[w - from], &stats);
+        removeShadowBranch(&sweepBranches[w - from]);
+        steps[w - from] += stats.steps;
+        if (counted >= 0)
+            errors[w - from] += labs((long)stats.steps - counted);
+    }
+}
+
+/* One synthetic walk per stream, returns the steps taken */
+static long generateWalk(recording_t *rec, uint16_t rateHz, uint32_t stream)
+{
+    gait_config_t config;
+    gait_default_config(&config);
+    config.rateHz = rateHz;
+
+    gait_gen_t gen;
+    gait_truth_t truth = {NULL, 0, 0};
+    gait_gen_init(&gen, &config, stream);
+    rec->count = (size_t)GAIT_SECONDS * rateHz;
+    rec->time = malloc(rec->count * sizeof(*rec->time));
+    rec->x = malloc(rec->count * sizeof(*rec->x));
+    rec->y = malloc(rec->count * sizeof(*rec->y));
+    rec->z = malloc(rec->count * sizeof(*rec->z));
+    gait_gen_fill(&gen, rec->time, rec->x, rec->y, rec->z, rec->count, &truth);
+    return (long)truth.count;
+}
+
+/* CPU ms to process a still sensor for the given hours, with or without duty cycling */
+static double idleCpuMs(uint16_t rateHz, long hours, uint8_t dutyCycle)
+{
+    initAlgoWithRate("M", 30, 180, 80, rateHz, 1);
+    if (!dutyCycle)
+        changeIdleDutyCycle(0, 1);
+
+    /* a few LSB of noise around 1 g, deterministic so that both runs see the same input */
+    uint32_t seed = 1;
+    long samples = hours * 3600L * rateHz;
+    clock_t start = clock();
+    for (long i = 0; i < samples; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        accel_t noise = (accel_t)((seed >> 16) % 7) - 3;
+        processSample((time_accel_t)(i * 1000 / rateHz), 300 + noise, 500 - noise, 800 + noise);
+    }
+    return (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+}
+
+/* The -w report: steps and error of every window size summed over the files, per mode */
+static int sweep(int argc, char **argv, int walks, uint16_t rateHz, uint8_t decimation, long expected, int from, int to)
+{
+    long steps[MODES][SWEEP_WINDOWS] = {{0}};
+    long errors[MODES][SWEEP_WINDOWS] = {{0}};
+    double cpuMs[MODES] = {0};
+    long samples = 0;
+    int scored = 0;
+
+    for (int f = optind; f < argc + walks; f++)
+    {
+        recording_t rec;
+        long counted = expected;
+        if (f < argc)
+        {
+            if (!loadRecording(argv[f], &rec))
+                continue;
+        }
+        else
+            counted = generateWalk(&rec, rateHz, (uint32_t)(f - argc));
+        scored |= counted >= 0;
+
+        for (uint8_t mode = 0; mode < MODES; mode++)
+            sweepWindows(&rec, mode, rateHz, decimation, from, to, counted, steps[mode], errors[mode], &cpuMs[mode]);
+        samples += (long)rec.count;
+        freeRecording(&rec);
+    }
+
+    printf("%-8s", "window");
+    for (uint8_t mode = 0; mode < MODES; mode++)
+        printf(" %8s %8s", modeNames[mode], "error");
+    printf("\n");
+    for (int w = from; w <= to; w++)
+    {
+        printf("%-8d", w);
+        for (uint8_t mode = 0; mode < MODES; mode++)
+        {
+            char error[24] = "-";
+            if (scored)
+                snprintf(error, sizeof(error), "%ld", errors[mode][w - from]);
+            printf(" %8ld %8s", steps[mode][w - from], error);
+        }
+        printf("%s\n", w == OPT_WINDOWSIZE ? "  (default)" : "");
+    }
+    for (uint8_t mode = 0; mode < MODES; mode++)
+        printf("%s mode: %d windows over %ld samples in %.1f ms cpu\n", modeNames[mode], to - from + 1, samples, cpuMs[mode]);
+    return 0;
+}
+
+/* The -c report: distance and kcal per step of the same walks at every rate, against the reference rate */
+static int checkRates(int walks)
+{
+    double reference[2] = {0, 0};
+    int failed = 0;
+
+    printf("%-8s %6s %7s %8s %10s\n", "rate", "steps", "error", "m/step", "kcal/step");
+    for (size_t r = 0; r < sizeof(checkedRates) / sizeof(checkedRates[0]); r++)
+    {
+        long steps = 0;
+        long error = 0;
+        double distance = 0;
+        double calories = 0;
+        for (int w = 0; w < walks; w++)
+        {
+            recording_t rec;
+            double cpuMs;
+            long counted = generateWalk(&rec, checkedRates[r], (uint32_t)w);
+            steps_t walked = replay(&rec, 0, checkedRates[r], 0, &cpuMs);
+            steps += walked;
+            error += labs((long)walked - counted);
+            distance += getDistance();
+            calories += getCalories();
+            freeRecording(&rec);
+        }
+
+        double perStep[2] = {steps ? distance / steps : 0, steps ? calories / steps : 0};
+        if (r == 0)
+            memcpy(reference, perStep, sizeof(reference));
+        int off = 0;
+        for (int i = 0; i < 2; i++)
+            off |= fabs(perStep[i] - reference[i]) > CHECK_TOLERANCE * reference[i];
+        failed |= off;
+        printf("%-8u %6ld %7ld %8.3f %10.4f%s\n", checkedRates[r], steps, error, perStep[0], perStep[1],
+               off ? "  out of tolerance" : "");
+    }
+
+    /* the duty cycling may only skip still samples, never the steps */
+    printf("\n%-8s %6s %12s\n", "rate", "steps", "without idle");
+    for (size_t r = 0; r < sizeof(gatedRates) / sizeof(gatedRates[0]); r++)
+    {
+        long steps[2] = {0, 0};
+        for (int w = 0; w < walks; w++)
+        {
+            recording_t rec;
+            double cpuMs;
+            generateWalk(&rec, gatedRates[r], (uint32_t)w);
+            for (noDutyCycle = 0; noDutyCycle < 2; noDutyCycle++)
+                steps[noDutyCycle] += replay(&rec, 0, gatedRates[r], 0, &cpuMs);
+            freeRecording(&rec);
+        }
+        noDutyCycle = 0;
+
+        int off = steps[0] != steps[1];
+        failed |= off;
+        printf("%-8u %6ld %12ld%s\n", gatedRates[r], steps[0], steps[1], off ? "  steps lost when idle" : "");
+    }
+    return failed;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r sample_rate_hz] [-d decimation] [-e counted_steps] [-t trace_dir] [-p] [-g synthetic_walks] walk.csv...\n"
+            "       %s [-r sample_rate_hz] [-d decimation] [-e counted_steps] [-g synthetic_walks] -w from-to walk.csv...\n"
+            "       %s [-r sample_rate_hz] -i idle_hours\n"
+            "       %s [-g synthetic_walks] -c\n"
+            "  files are time(ms), X, Y, Z; -e gives the steps counted by hand in every file\n"
+            "  -g also replays that many synthetic walks, scored against their generated steps\n"
+            "  -d decimates the samples before the motion detection, 0 for the default of the rate\n"
+            "  -i reports the CPU time per idle hour with and without duty cycling\n"
+            "  -t writes a Chrome trace of every replay in trace_dir (build with -DTRACE_STAGES=ON)\n"
+            "  -p reports the perf counters per sample, per stage too with -DTRACE_STAGES=ON\n"
+            "  -w compares the scoring windows from-to (samples at %u Hz, at most %u sizes) in one replay per mode\n"
+            "  -c replays %d synthetic walks at several rates, fails if the distance or kcal per step\n"
+            "     differ by more than %.0f%% from those at %u Hz, or if the idle duty cycling changes\n"
+            "     the steps at %u and %u Hz\n",
+            name, name, name, name, REFERENCE_RATE_HZ, SWEEP_WINDOWS, CHECK_WALKS, CHECK_TOLERANCE * 100,
+            REFERENCE_RATE_HZ, gatedRates[0], gatedRates[1]);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t rateHz = SAMPLE_RATE_HZ;
+    long expected = -1;
+    long idleHours = 0;
+    int walks = 0;
+    uint8_t decimation = 0;
+    int sweepFrom = 0, sweepTo = -1;
+    int check = 0;
+#ifdef TRACE_PIPELINE
+    const char *traceDir = NULL;
+#endif
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:d:e:i:t:pg:w:ch")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            rateHz = (uint16_t)atoi(optarg);
+            break;
+        case 'd':
+            decimation = (uint8_t)atoi(optarg);
+            break;
+        case 'e':
+            expected = atol(optarg);
+            break;
+        case 'i':
+            idleHours = atol(optarg);
+            break;
+        case 't':
+#ifdef TRACE_PIPELINE
+            traceDir = optarg;
+            break;
+#else
+            fprintf(stderr, "built without TRACE_STAGES, no trace to write\n");
+            exit(1);
+#endif
+        case 'p':
+            profiling = 1;
+            break;
+        case 'g':
+            walks = atoi(optarg);
+            break;
+        case 'w':
+            if (sscanf(optarg, "%d-%d", &sweepFrom, &sweepTo) != 2 || sweepFrom < 3 || sweepTo < sweepFrom ||
+                sweepTo - sweepFrom >= SWEEP_WINDOWS)
+                usage(argv[0]);
+            break;
+        case 'c':
+            check = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (idleHours > 0)
+    {
+        double always = idleCpuMs(rateHz, idleHours, 0);
+        double dutyCycled = idleCpuMs(rateHz, idleHours, 1);
+        printf("CPU per idle hour at %u Hz: %.1f ms without duty cycling, %.1f ms with it\n",
+               rateHz, always / idleHours, dutyCycled / idleHours);
+        return 0;
+    }
+    if (check)
+        return checkRates(walks > 0 ? walks : CHECK_WALKS);
+    if (optind >= argc && walks <= 0)
+        usage(argv[0]);
+    if (sweepTo >= 0)
+        return sweep(argc, argv, walks, rateHz, decimation, expected, sweepFrom, sweepTo);
+    if (profiling)
+    {
+        if (perf_counters_open(&counters) == 0)
+        {
+            fprintf(stderr, "perf counters unavailable (%s), profiling disabled\n", strerror(counters.error));
+            profiling = 0;
+        }
+        else if (counters.error)
+            fprintf(stderr, "hardware counters unavailable (%s), only reporting the CPU time\n", strerror(counters.error));
+    }
+
+    long totalSteps[MODES] = {0};
+    long totalError[MODES] = {0};
+    double totalCpuMs[MODES] = {0};
+    int scored = 0;
+    latencies_t all[MODES];
+    memset(all, 0, sizeof(all));
+
+    printf("%-24s %-8s %6s %7s %8s %8s %8s %12s %8s\n", "file", "mode", "steps", "error", "p50 ms", "p95 ms", "max ms", "confirm p50", "cpu ms");
+    for (int f = optind; f < argc + walks; f++)
+    {
+        recording_t rec;
+        char synthetic[24];
+        const char *name = synthetic;
+        long counted = expected;
+        if (f < argc)
+        {
+            if (!loadRecording(argv[f], &rec))
+                continue;
+            name = argv[f];
+        }
+        else
+        {
+            counted = generateWalk(&rec, rateHz, (uint32_t)(f - argc));
+            snprintf(synthetic, sizeof(synthetic), "synthetic-%d", f - argc);
+        }
+
+        for (uint8_t mode = 0; mode < MODES; mode++)
+        {
+            latencies.provisionalCount = 0;
+            latencies.confirmedCount = 0;
+            double cpuMs;
+            steps_t steps = replay(&rec, mode, rateHz, decimation, &cpuMs);
+            totalSteps[mode] += steps;
+            totalCpuMs[mode] += cpuMs;
+#ifdef TRACE_PIPELINE
+            if (traceDir)
+                writeTrace(traceDir, name, mode);
+            if (profiling)
+                profileStages(&rec, mode, rateHz, decimation);
+#endif
+
+            char error[24] = "-";
+            if (counted >= 0)
+            {
+                long diff = (long)steps - counted;
+                scored = 1;
+                totalError[mode] += diff < 0 ? -diff : diff;
+                snprintf(error, sizeof(error), "%+ld", diff);
+            }
+
+            /* keep every latency for the corpus percentiles */
+            latencies_t *acc = &all[mode];
+            acc->provisional = realloc(acc->provisional, (acc->provisionalCount + latencies.provisionalCount) * sizeof(time_accel_t) + 1);
+            acc->confirmed = realloc(acc->confirmed, (acc->confirmedCount + latencies.confirmedCount) * sizeof(time_accel_t) + 1);
+            memcpy(acc->provisional + acc->provisionalCount, latencies.provisional, latencies.provisionalCount * sizeof(time_accel_t));
+            memcpy(acc->confirmed + acc->confirmedCount, latencies.confirmed, latencies.confirmedCount * sizeof(time_accel_t));
+            acc->provisionalCount += latencies.provisionalCount;
+            acc->confirmedCount += latencies.confirmedCount;
+
+            printf("%-24s %-8s %6u %7s %8d %8d %8d %12d %8.1f\n", name, modeNames[mode], steps, error,
+                   percentile(latencies.provisional, latencies.provisionalCount, 0.5),
+                   percentile(latencies.provisional, latencies.provisionalCount, 0.95),
+                   percentile(latencies.provisional, latencies.provisionalCount, 1.0),
+                   percentile(latencies.confirmed, latencies.confirmedCount, 0.5), cpuMs);
+        }
+        freeRecording(&rec);
+    }
+
+    for (uint8_t mode = 0; mode < MODES; mode++)
+    {
+        char error[24] = "-";
+        if (scored)
+            snprintf(error, sizeof(error), "%ld", totalError[mode]);
+        printf("%-24s %-8s %6ld %7s %8d %8d %8d %12d %8.1f\n", "all", modeNames[mode], totalSteps[mode], error,
+               percentile(all[mode].provisional, all[mode].provisionalCount, 0.5),
+               percentile(all[mode].provisional, all[mode].provisionalCount, 0.95),
+               percentile(all[mode].provisional, all[mode].provisionalCount, 1.0),
+               percentile(all[mode].confirmed, all[mode].confirmedCount, 0.5), totalCpuMs[mode]);
+    }
+
+    if (profiling)
+    {
+        for (uint8_t mode = 0; mode < MODES; mode++)
+            printProfile(mode);
+#ifndef TRACE_PIPELINE
+        printf("build with -DTRACE_STAGES=ON for the counters of each stage\n");
+#endif
+        perf_counters_close(&counters);
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+/**
+ * @file
+ * Worst-case execution time and jitter of processSample().
+ * Adversarial inputs built to fire the whole chain (peaks on every window, steps
+ * at the highest rate, gaps, waking up from idle, interpolation bursts) and any
+ * recorded walks are replayed, and the time of every call is kept. Each input is
+ * replayed several times and the fastest time of every call is kept, so that
+ * preemption and interrupts of the host do not show up as worst cases.
+ * Every call is attributed the most expensive path it took, read from the
+ * context around the call. With -b the run fails when a call exceeds the budget.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "StepCountingAlgo.h"
+#include "recording.h"
+
+/* Paths of a call, from the most to the least expensive */
+#define PATH_GAP 0           /* a dropout restarted the windows */
+#define PATH_STEP 1          /* a step was accepted */
+#define PATH_CONFIRM 2       /* a step was confirmed */
+#define PATH_PEAK 3          /* the detection found a peak */
+#define PATH_WAKE 4          /* the motion detection woke up */
+#define PATH_SLEEP 5         /* the motion detection went idle */
+#define PATH_INTERPOLATION 6 /* several samples were interpolated */
+#define PATH_SCORED 7        /* a sample reached the detection */
+#define PATH_GATED 8         /* stopped before the detection */
+#define PATH_IDLE 9          /* only the idle range check ran */
+#define PATHS 10
+
+#define ADVERSARIAL_INPUTS 6
+
+typedef struct probe_t probe_t;
+
+/* What the context tells about the path of a call */
+struct probe_t
+{
+    uint32_t gaps;
+    steps_t steps;
+    time_accel_t scored;
+    time_accel_t lastPeak;
+    uint8_t idle;
+};
+
+typedef struct input_t input_t;
+
+struct input_t
+{
+    char name[64];
+    recording_t rec;
+    uint64_t *ns;   /* fastest time of every call */
+    uint8_t *path;  /* path of every call */
+};
+
+static const char *pathNames[PATHS] = {"gap", "step", "confirm", "peak", "wake", "sleep",
+                                       "interpolation", "scored", "gated", "idle"};
+static const char *adversarialNames[ADVERSARIAL_INPUTS] = {"walk", "stomp", "noise", "toggle", "gaps", "jitter"};
+
+static uint8_t confirmed;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void onStep(const step_notice_t *notice)
+{
+    if (notice->kind == STEP_CONFIRMED)
+        confirmed = 1;
+}
+
+static void probe(probe_t *p)
+{
+    p->gaps = getGaps();
+    p->steps = getSteps();
+    p->scored = algoContext->detection.count;
+    p->lastPeak = algoContext->detection.lastDataPoint.time;
+    p->idle = algoContext->motionDetect.idle;
+}
+
+static uint8_t classify(const probe_t *before, const probe_t *after, time_accel_t skippedMs, uint16_t rateHz)
+{
+    if (after->gaps != before->gaps)
+        return PATH_GAP;
+    if (after->steps != before->steps)
+        return PATH_STEP;
+    if (confirmed)
+        return PATH_CONFIRM;
+    if (after->lastPeak != before->lastPeak)
+        return PATH_PEAK;
+    if (before->idle && !after->idle)
+        return PATH_WAKE;
+    if (!before->idle && after->idle)
+        return PATH_SLEEP;
+#ifndef SKIP_INTERPOLATION
+    if (skippedMs > 1000 / rateHz)
+        return PATH_INTERPOLATION;
+#else
+    (void)skippedMs;
+    (void)rateHz;
+#endif
+    if (after->scored != before->scored)
+        return PATH_SCORED;
+    return after->idle ? PATH_IDLE : PATH_GATED;
+}
+
+static void addSample(recording_t *rec, size_t *capacity, time_accel_t time, double x, double y, double z)
+{
+    if (rec->count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 4096;
+        rec->time = realloc(rec->time, *capacity * sizeof(*rec->time));
+        rec->x = realloc(rec->x, *capacity * sizeof(*rec->x));
+        rec->y = realloc(rec->y, *capacity * sizeof(*rec->y));
+        rec->z = realloc(rec->z, *capacity * sizeof(*rec->z));
+    }
+    rec->time[rec->count] = time;
+    rec->x[rec->count] = (accel_t)fmax(-32767, fmin(32767, x));
+    rec->y[rec->count] = (accel_t)fmax(-32767, fmin(32767, y));
+    rec->z[rec->count] = (accel_t)fmax(-32767, fmin(32767, z));
+    rec->count++;
+}
+
+/* Deterministic adversarial inputs, about 1000 units per g as in the recorded walks */
+static void generate(recording_t *rec, int kind, uint16_t rateHz, long seconds)
+{
+    size_t capacity = 0;
+    uint32_t seed = 1;
+    double period = 1000.0 / rateHz;
+    double t = 0;
+
+    memset(rec, 0, sizeof(*rec));
+    for (long i = 0; t < seconds * 1000.0; i++)
+    {
+        double a = 1000;
+        seed = seed * 1103515245u + 12345u;
+        switch (kind)
+        {
+        case 0: /* walk: regular steps */
+            a += 600 * sin(2 * M_PI * 1.8 * t / 1000);
+            break;
+        case 1: /* stomp: saturated square wave just slower than the time threshold, steps at the highest rate */
+            a = fmod(t, 2.0 * OPT_TIME_THRESHOLD) < OPT_TIME_THRESHOLD ? 32767 : 0;
+            break;
+        case 2: /* noise: full scale random samples, peaks everywhere */
+            addSample(rec, &capacity, (time_accel_t)t, (int16_t)(seed >> 8), (int16_t)(seed >> 12), (int16_t)(seed >> 16));
+            t += period;
+            continue;
+        case 3: /* toggle: still just long enough to go idle, then a few steps */
+            if (fmod(t, IDLE_CONFIRM_MS + 1500.0) >= IDLE_CONFIRM_MS + 200)
+                a += 600 * sin(2 * M_PI * 1.8 * t / 1000);
+            else
+                a += (double)((seed >> 16) % 7) - 3;
+            break;
+        case 4: /* gaps: walking with a dropout every 10 s */
+            a += 600 * sin(2 * M_PI * 1.8 * t / 1000);
+            if (i > 0 && fmod(t, 10000.0) < period)
+                t += GAP_THRESHOLD + 500;
+            break;
+        case 5: /* jitter: walking with 0 to 4 samples missing each time */
+            a += 600 * sin(2 * M_PI * 1.8 * t / 1000);
+            t += period * ((seed >> 16) % 5);
+            break;
+        }
+        addSample(rec, &capacity, (time_accel_t)t, a * 0.3, a * 0.5, a * 0.8);
+        t += period;
+    }
+}
+
+/* Replays an input runs times, keeping the fastest time of every call */
+static void measure(input_t *input, uint16_t rateHz, int runs)
+{
+    const recording_t *rec = &input->rec;
+    input->ns = malloc(rec->count * sizeof(*input->ns));
+    input->path = malloc(rec->count * sizeof(*input->path));
+
+    for (int run = 0; run < runs; run++)
+    {
+        initAlgoWithRate("M", 30, 180, 80, rateHz, 1);
+        setStepListener(onStep);
+        for (size_t i = 0; i < rec->count; i++)
+        {
+            probe_t before;
+            probe_t after;
+            probe(&before);
+            confirmed = 0;
+
+            uint64_t start = nowNs();
+            processSample(rec->time[i], rec->x[i], rec->y[i], rec->z[i]);
+            uint64_t ns = nowNs() - start;
+
+            /* the path of a call is the same on every run */
+            if (run == 0)
+            {
+                probe(&after);
+                time_accel_t skipped = i > 0 ? rec->time[i] - rec->time[i - 1] : 0;
+                input->path[i] = classify(&before, &after, skipped, rateHz);
+                input->ns[i] = ns;
+            }
+            else if (ns < input->ns[i])
+                input->ns[i] = ns;
+        }
+    }
+}
+
+static int compareNs(const void *a, const void *b)
+{
+    uint64_t na = *(const uint64_t *)a;
+    uint64_t nb = *(const uint64_t *)b;
+    return (na > nb) - (na < nb);
+}
+
+/* Sorts the values */
+static uint64_t percentile(uint64_t *values, size_t count, double p)
+{
+    if (count == 0)
+        return 0;
+    qsort(values, count, sizeof(*values), compareNs);
+    return values[(size_t)(p * (count - 1))];
+}
+
+static void printRow(const char *name, uint64_t *values, size_t count, const char *slowest)
+{
+    printf("%-24s %8zu %8llu %8llu %9llu %8llu  %s\n", name, count,
+           (unsigned long long)percentile(values, count, 0.5),
+           (unsigned long long)percentile(values, count, 0.99),
+           (unsigned long long)percentile(values, count, 0.999),
+           (unsigned long long)percentile(values, count, 1.0), slowest);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r sample_rate_hz] [-s seconds] [-n runs] [-b budget_ns] [walk.csv...]\n"
+            "  replays the adversarial inputs (-s seconds each) and the recorded walks\n"
+            "  -n keeps the fastest of n runs for every call\n"
+            "  -b fails if a call takes longer than budget_ns\n",
+            name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t rateHz = SAMPLE_RATE_HZ;
+    long seconds = 60;
+    int runs = 5;
+    uint64_t budgetNs = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:n:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            rateHz = (uint16_t)atoi(optarg);
+            break;
+        case 's':
+            seconds = atol(optarg);
+            break;
+        case 'n':
+            runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'b':
+            budgetNs = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!initAlgoWithRate("M", 30, 180, 80, rateHz, 1))
+    {
+        fprintf(stderr, "unsupported rate %u Hz\n", rateHz);
+        return 1;
+    }
+#ifdef DUMP_FILE
+    fprintf(stderr, "the stages are dumped on csv files, every call does file I/O (build with -DDUMP_STAGES=OFF)\n");
+#endif
+
+    int inputCount = ADVERSARIAL_INPUTS + (argc - optind);
+    input_t *inputs = calloc(inputCount, sizeof(*inputs));
+    int loaded = 0;
+    for (int k = 0; k < ADVERSARIAL_INPUTS; k++)
+    {
+        snprintf(inputs[loaded].name, sizeof(inputs[loaded].name), "%s", adversarialNames[k]);
+        generate(&inputs[loaded].rec, k, rateHz, seconds);
+        loaded++;
+    }
+    for (int f = optind; f < argc; f++)
+    {
+        if (!loadRecording(argv[f], &inputs[loaded].rec))
+            continue;
+        snprintf(inputs[loaded].name, sizeof(inputs[loaded].name), "%s", argv[f]);
+        loaded++;
+    }
+
+    size_t total = 0;
+    for (int k = 0; k < loaded; k++)
+    {
+        measure(&inputs[k], rateHz, runs);
+        total += inputs[k].rec.count;
+    }
+
+    /* the worst call, before the times are sorted */
+    int worstInput = 0;
+    size_t worstCall = 0;
+    for (int k = 0; k < loaded; k++)
+        for (size_t i = 0; i < inputs[k].rec.count; i++)
+            if (inputs[k].ns[i] > inputs[worstInput].ns[worstCall])
+            {
+                worstInput = k;
+                worstCall = i;
+            }
+    uint64_t worstNs = inputs[worstInput].ns[worstCall];
+    uint8_t worstPath = inputs[worstInput].path[worstCall];
+
+    uint64_t *all = malloc(total * sizeof(*all));
+    uint64_t *byPath[PATHS];
+    size_t pathCount[PATHS] = {0};
+    for (int p = 0; p < PATHS; p++)
+        byPath[p] = malloc(total * sizeof(*all));
+
+    printf("%-24s %8s %8s %8s %9s %8s  %s\n", "input", "calls", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "slowest path");
+    size_t n = 0;
+    for (int k = 0; k < loaded; k++)
+    {
+        input_t *input = &inputs[k];
+        size_t slowest = 0;
+        for (size_t i = 0; i < input->rec.count; i++)
+        {
+            if (input->ns[i] > input->ns[slowest])
+                slowest = i;
+            all[n++] = input->ns[i];
+            byPath[input->path[i]][pathCount[input->path[i]]++] = input->ns[i];
+        }
+        printRow(input->name, input->ns, input->rec.count, pathNames[input->path[slowest]]);
+    }
+    printRow("all", all, total, pathNames[worstPath]);
+
+    printf("\n%-24s %8s %8s %8s %9s %8s\n", "path", "calls", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    for (int p = 0; p < PATHS; p++)
+        if (pathCount[p] > 0)
+            printRow(pathNames[p], byPath[p], pathCount[p], "");
+
+    int failed = 0;
+    if (budgetNs > 0)
+    {
+        failed = worstNs > budgetNs;
+        printf("\n%s: max %llu ns on %s call %zu (%s), budget %llu ns\n", failed ? "FAIL" : "OK",
+               (unsigned long long)worstNs, inputs[worstInput].name, worstCall, pathNames[worstPath],
+               (unsigned long long)budgetNs);
+    }
+
+    for (int k = 0; k < loaded; k++)
+    {
+        freeRecording(&inputs[k].rec);
+        free(inputs[k].ns);
+        free(inputs[k].path);
+    }
+    for (int p = 0; p < PATHS; p++)
+        free(byPath[p]);
+    free(all);
+    free(inputs);
+    return failed;
+}
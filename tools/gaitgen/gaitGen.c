@@ -0,0 +1,300 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "gaitGen.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define NEVER UINT64_MAX
+
+void gait_default_config(gait_config_t *config)
+{
+  memset(config, 0, sizeof(*config));
+  config->seed = 1;
+  config->rateHz = SAMPLE_RATE_HZ;
+  config->cadence = 108;
+  config->variability = 5;
+  config->intensity = 600;
+  config->noise = 20;
+  config->unitsPerG = 1000;
+  config->pitch = 30;
+  config->roll = 20;
+}
+
+/* Seeds the noise of a span of 65536 samples from its index */
+static uint32_t hash(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+/* Counter based noise of a sample within a span, so that no state is carried from a sample
+ * to the next; 16 bits wide so that the hot loop keeps 16 bit lanes */
+static inline int16_t noiseOf(uint16_t x)
+{
+  x = (uint16_t)(x * 0x9e35u);
+  x ^= x >> 7;
+  x = (uint16_t)(x * 0x2d4bu);
+  x ^= x >> 8;
+  return (int16_t)x;
+}
+
+/* Uniform in [-1, 1), Q15 */
+static int32_t centered(gait_gen_t *gen)
+{
+  gen->random ^= gen->random << 13;
+  gen->random ^= gen->random >> 7;
+  gen->random ^= gen->random << 17;
+  return (int32_t)(gen->random >> 48) - 32768;
+}
+
+/* Between half and one and a half times the mean, in samples */
+static uint64_t randomTicks(gait_gen_t *gen, uint32_t meanMs)
+{
+  int64_t mean = (int64_t)meanMs * gen->config.rateHz / 1000;
+  int64_t ticks = mean + mean * centered(gen) / 65536;
+  return ticks > 0 ? (uint64_t)ticks : 1;
+}
+
+static int32_t vary(gait_gen_t *gen, int32_t value)
+{
+  return value + (int32_t)((int64_t)value * gen->config.variability * centered(gen) / (100 * 32768));
+}
+
+static void startStep(gait_gen_t *gen)
+{
+  int32_t amplitude = vary(gen, gen->config.intensity);
+  if (amplitude > 32767)
+    amplitude = 32767;
+  gen->increment = (uint32_t)vary(gen, (int32_t)gen->baseIncrement);
+  gen->swaySign = (int8_t)-gen->swaySign;
+  for (int a = 0; a < 3; a++)
+  {
+    gen->vertical[a] = (int16_t)(amplitude * gen->up[a] >> 15);
+    gen->lateral[a] = (int16_t)(gen->swaySign * (amplitude / 4) * gen->side[a] >> 15);
+  }
+}
+
+static void stopWalking(gait_gen_t *gen)
+{
+  gen->increment = 0;
+  for (int a = 0; a < 3; a++)
+  {
+    gen->vertical[a] = 0;
+    gen->lateral[a] = 0;
+  }
+}
+
+static void toggleBout(gait_gen_t *gen)
+{
+  gen->walking = !gen->walking;
+  if (gen->walking)
+  {
+    gen->phase = 1u << 31; /* the first heel strike half a step later */
+    startStep(gen);
+    gen->boutEnd = gen->tick + randomTicks(gen, gen->config.walkMs);
+  }
+  else
+  {
+    stopWalking(gen);
+    gen->boutEnd = gen->tick + randomTicks(gen, gen->config.idleMs);
+  }
+}
+
+static void toggleDropout(gait_gen_t *gen)
+{
+  gen->dropping = !gen->dropping;
+  if (gen->dropping)
+    gen->dropEnd = gen->tick + (uint64_t)gen->config.dropoutMs * gen->config.rateHz / 1000;
+  else
+    gen->dropStart = gen->tick + randomTicks(gen, gen->config.dropoutEveryMs);
+}
+
+void gait_gen_init(gait_gen_t *gen, const gait_config_t *config, uint32_t stream)
+{
+  memset(gen, 0, sizeof(*gen));
+  gen->config = *config;
+
+  double pitch = config->pitch * M_PI / 180;
+  double roll = config->roll * M_PI / 180;
+  double up[3] = {-sin(pitch), cos(pitch) * sin(roll), cos(pitch) * cos(roll)};
+  double side[3] = {0, cos(roll), -sin(roll)};
+  for (int a = 0; a < 3; a++)
+  {
+    gen->gravity[a] = (int32_t)lrint(config->unitsPerG * up[a]);
+    gen->up[a] = (int32_t)lrint(32767 * up[a]);
+    gen->side[a] = (int32_t)lrint(32767 * side[a]);
+  }
+
+  /* splitmix64 of the seed and the stream, never 0 for the xorshift */
+  uint64_t z = ((uint64_t)config->seed << 32 | stream) + 0x9e3779b97f4a7c15u;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+  z ^= z >> 31;
+  gen->random = z ? z : 1;
+  gen->noiseSeed = (uint32_t)(z >> 32);
+
+  gen->periodQ16 = (uint32_t)((65536000u + config->rateHz / 2) / config->rateHz);
+  gen->baseIncrement = (uint32_t)(((uint64_t)config->cadence << 32) / (60u * config->rateHz));
+  gen->swaySign = 1;
+
+  /* toggled into a walk */
+  gen->walking = 0;
+  toggleBout(gen);
+  if (config->walkMs == 0)
+    gen->boutEnd = NEVER;
+  gen->dropStart = config->dropoutEveryMs ? randomTicks(gen, config->dropoutEveryMs) : NEVER;
+  gen->dropEnd = NEVER;
+}
+
+static inline accel_t saturate(int32_t value)
+{
+  return (accel_t)(value < -32767 ? -32767 : value > 32767 ? 32767 : value);
+}
+
+/* a * b >> 16, one high half multiply of 16 bit lanes once vectorized */
+static inline int32_t mulHigh(int16_t a, int16_t b)
+{
+  return (int32_t)a * b >> 16;
+}
+
+/* sin(pi * u / 32768) in Q15 from a parabola, within 6% */
+static inline int16_t parabolicSine(uint16_t u)
+{
+  int16_t v = (int16_t)u;
+  int16_t rest = (int16_t)(32767 - (v < 0 ? -(int32_t)v : v));
+  return (int16_t)(mulHigh(v, rest) * 8);
+}
+
+/* Vertical acceleration over a step, Q15, the heel strike at phase 0 */
+static inline int16_t stepWave(uint16_t phase)
+{
+  int16_t first = parabolicSine((uint16_t)(phase + 16384));
+  int16_t second = parabolicSine((uint16_t)(2 * phase + 16384));
+  int16_t third = parabolicSine((uint16_t)(3 * phase + 16384));
+  return (int16_t)(2 * (mulHigh(first, 19661) + mulHigh(second, 9830) + mulHigh(third, 3277)));
+}
+
+/* Samples without any event in between, the hot loop. Only 16 bit arithmetic without
+ * tables, so that it vectorizes even on plain SSE2 */
+static void emit(gait_gen_t *gen, time_accel_t *time, accel_t *x, accel_t *y, accel_t *z, size_t count)
+{
+  const int32_t gx = gen->gravity[0], gy = gen->gravity[1], gz = gen->gravity[2];
+  const int16_t vx = gen->vertical[0], vy = gen->vertical[1], vz = gen->vertical[2];
+  const int16_t lx = gen->lateral[0], ly = gen->lateral[1], lz = gen->lateral[2];
+  const int16_t noise = (int16_t)(2 * gen->config.noise);
+  const uint32_t increment = gen->increment;
+  const uint32_t period = gen->periodQ16;
+
+  for (size_t start = 0, n; start < count; start += n)
+  {
+    uint16_t tick = (uint16_t)gen->tick;
+    uint16_t seed = (uint16_t)hash((uint32_t)(gen->tick >> 16) ^ gen->noiseSeed);
+    n = count - start;
+    if (n > 65536u - tick)
+      n = 65536u - tick; /* the seed changes with the span */
+    time_accel_t ms = (time_accel_t)(gen->timeQ16 >> 16);
+    uint32_t fraction = (uint32_t)(gen->timeQ16 & 0xFFFF);
+    /* the 16 bit phase drifts by less than a unit per sample, the exact one is kept between runs */
+    uint16_t phase = (uint16_t)(gen->phase >> 16);
+    uint16_t step = (uint16_t)(increment >> 16);
+    time_accel_t *restrict t = time + start;
+    accel_t *restrict cx = x + start, *restrict cy = y + start, *restrict cz = z + start;
+
+    for (uint32_t i = 0; i < (uint32_t)n; i++)
+      t[i] = ms + (time_accel_t)((fraction + i * period) >> 16);
+    for (uint32_t i = 0; i < (uint32_t)n; i++)
+    {
+      uint16_t p = (uint16_t)(phase + i * step);
+      int16_t w = stepWave(p);
+      int16_t s = parabolicSine(p >> 1);
+      uint16_t k = (uint16_t)(tick + i) ^ seed;
+      cx[i] = saturate(gx + 2 * (mulHigh(w, vx) + mulHigh(s, lx) + mulHigh(noiseOf(k), noise)));
+      cy[i] = saturate(gy + 2 * (mulHigh(w, vy) + mulHigh(s, ly) + mulHigh(noiseOf(k ^ 0x5555), noise)));
+      cz[i] = saturate(gz + 2 * (mulHigh(w, vz) + mulHigh(s, lz) + mulHigh(noiseOf(k ^ 0xaaaa), noise)));
+    }
+
+    gen->phase += (uint32_t)n * increment;
+    gen->tick += n;
+    gen->timeQ16 += (uint64_t)n * period;
+  }
+}
+
+size_t gait_gen_fill(gait_gen_t *gen, time_accel_t *time, accel_t *x, accel_t *y, accel_t *z, size_t count,
+                     gait_truth_t *truth)
+{
+  size_t written = 0;
+
+  while (written < count)
+  {
+    uint64_t untilStep = gen->increment ? ((1ull << 32) - gen->phase + gen->increment - 1) / gen->increment : NEVER;
+    uint64_t run = untilStep;
+    if (gen->boutEnd - gen->tick < run)
+      run = gen->boutEnd - gen->tick;
+    if (gen->dropping)
+    {
+      if (gen->dropEnd - gen->tick < run)
+        run = gen->dropEnd - gen->tick;
+      gen->phase += (uint32_t)(run * gen->increment);
+      gen->tick += run;
+      gen->timeQ16 += run * gen->periodQ16;
+    }
+    else
+    {
+      if (gen->dropStart - gen->tick < run)
+        run = gen->dropStart - gen->tick;
+      if (count - written < run)
+        run = count - written;
+      emit(gen, time + written, x + written, y + written, z + written, (size_t)run);
+      written += (size_t)run;
+    }
+
+    if (run == untilStep)
+    {
+      /* the heel strike was between the last two samples */
+      if (truth)
+      {
+        uint64_t at = gen->timeQ16 - (uint64_t)gen->phase * gen->periodQ16 / gen->increment;
+        if (truth->count < truth->capacity)
+          truth->times[truth->count] = (time_accel_t)(at >> 16);
+        truth->count++;
+      }
+      startStep(gen);
+    }
+    if (gen->tick == gen->boutEnd)
+      toggleBout(gen);
+    if (gen->tick == (gen->dropping ? gen->dropEnd : gen->dropStart))
+      toggleDropout(gen);
+  }
+  return written;
+}
@@ -0,0 +1,129 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Deterministic synthetic walks, for load and accuracy tests without recorded data.
+ * Each step is one period of a heel strike waveform along gravity plus a lateral sway
+ * at half the cadence, in a device tilted by a pitch and a roll, with uniform noise on
+ * every axis. Walks alternate with still periods and samples can be lost in dropouts;
+ * the time of every step is returned as ground truth.
+ * The same seed, stream and configuration always give the same samples, whatever the
+ * size of the blocks they are asked in. Samples are computed with 16 bit integers only,
+ * the waveforms from parabolas instead of tables, so that filling blocks vectorizes and
+ * costs a few ns per sample.
+ */
+
+#ifndef GAIT_GEN_H
+#define GAIT_GEN_H
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+typedef struct gait_config_t gait_config_t;
+
+struct gait_config_t
+{
+  uint32_t seed;
+  uint16_t rateHz;         /* sensor rate */
+  uint16_t cadence;        /* steps per minute */
+  uint8_t variability;     /* % of random change of cadence and intensity from a step to the next */
+  uint16_t intensity;      /* peak of the vertical acceleration of a step, in accel_t units */
+  uint16_t noise;          /* amplitude of the uniform noise on every axis, in accel_t units, below 16384 */
+  uint16_t unitsPerG;      /* accel_t units of gravity */
+  int16_t pitch;           /* orientation of the device, in degrees */
+  int16_t roll;
+  uint32_t walkMs;         /* mean length of a walk, 0 to walk all the time */
+  uint32_t idleMs;         /* mean length of the still periods between walks */
+  uint32_t dropoutEveryMs; /* mean time between dropouts, 0 for none */
+  uint32_t dropoutMs;      /* time lost in each dropout */
+};
+
+typedef struct gait_truth_t gait_truth_t;
+
+/* Ground truth, the step times beyond the capacity are counted but not kept */
+struct gait_truth_t
+{
+  time_accel_t *times;
+  size_t capacity;
+  uint64_t count;
+};
+
+typedef struct gait_gen_t gait_gen_t;
+
+struct gait_gen_t
+{
+  gait_config_t config;
+  uint64_t tick;                /* samples so far, dropped ones included */
+  uint64_t timeQ16;             /* time of the next sample, ms in Q16 */
+  uint32_t periodQ16;
+  uint32_t phase;               /* position in the current step */
+  uint32_t increment;           /* of the phase per sample, 0 when still */
+  uint32_t baseIncrement;
+  uint32_t noiseSeed;
+  uint64_t random;              /* state of the random changes, apart from the noise */
+  int32_t gravity[3];
+  int32_t up[3];                /* unit vectors in Q15 */
+  int32_t side[3];
+  int16_t vertical[3];          /* amplitudes of the current step, in accel_t units */
+  int16_t lateral[3];
+  int8_t swaySign;
+  uint8_t walking;
+  uint8_t dropping;
+  uint64_t boutEnd;             /* ticks at which the walk or the still period ends */
+  uint64_t dropStart;
+  uint64_t dropEnd;
+};
+
+/**
+ * Fills a configuration with an average walk: 108 steps per minute at the default
+ * rate, 1000 units per g, a tilted device, no still periods and no dropouts.
+ * @param config the configuration
+ */
+void gait_default_config(gait_config_t *config);
+
+/**
+ * Starts a generator.
+ * @param gen the generator
+ * @param config the configuration, copied
+ * @param stream picks one of many independent walks of the same configuration,
+ * e.g. one per simulated device
+ */
+void gait_gen_init(gait_gen_t *gen, const gait_config_t *config, uint32_t stream);
+
+/**
+ * Generates the next samples. Samples lost in dropouts are skipped, their time is not.
+ * @param gen the generator
+ * @param time where the times are written, in ms
+ * @param x where the X values are written
+ * @param y where the Y values are written
+ * @param z where the Z values are written
+ * @param count the number of samples to write
+ * @param truth where the time of the steps taken is added; NULL if not needed
+ * @return count
+ */
+size_t gait_gen_fill(gait_gen_t *gen, time_accel_t *time, accel_t *x, accel_t *y, accel_t *z, size_t count,
+                     gait_truth_t *truth);
+
+#endif
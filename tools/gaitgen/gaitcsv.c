@@ -0,0 +1,240 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Writes a synthetic walk (gaitGen.h) as a CSV of time(ms), X, Y, Z like the
+ * recorded walks, and the time of its steps as ground truth.
+ * With -b it measures how many samples per second can be generated instead,
+ * with one independent walk per thread, e.g. one per simulated device.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gaitGen.h"
+
+#define BLOCK 4096 /* samples, small enough to stay in the L2 cache */
+
+typedef struct worker_t worker_t;
+
+struct worker_t
+{
+    pthread_t thread;
+    const gait_config_t *config;
+    uint32_t stream;
+    uint64_t samples;
+    uint64_t steps;
+    int64_t checksum; /* so that the samples are not optimized away */
+};
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *work(void *arg)
+{
+    worker_t *worker = arg;
+    static _Thread_local time_accel_t time[BLOCK];
+    static _Thread_local accel_t x[BLOCK], y[BLOCK], z[BLOCK];
+    gait_gen_t gen;
+    gait_truth_t truth = {NULL, 0, 0};
+
+    gait_gen_init(&gen, worker->config, worker->stream);
+    for (uint64_t done = 0; done < worker->samples; done += BLOCK)
+    {
+        gait_gen_fill(&gen, time, x, y, z, BLOCK, &truth);
+        worker->checksum += time[BLOCK - 1] + x[0] + y[BLOCK / 2] + z[BLOCK - 1];
+    }
+    worker->steps = truth.count;
+    return NULL;
+}
+
+static void benchmark(const gait_config_t *config, uint64_t samples, int threads)
+{
+    worker_t *workers = calloc((size_t)threads, sizeof(worker_t));
+    int64_t start = nowNs();
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].config = config;
+        workers[i].stream = (uint32_t)i;
+        workers[i].samples = samples / (uint64_t)threads;
+        pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+    }
+    uint64_t steps = 0;
+    int64_t checksum = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        steps += workers[i].steps;
+        checksum += workers[i].checksum;
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    uint64_t generated = samples / (uint64_t)threads / BLOCK * BLOCK * (uint64_t)threads;
+    printf("%llu samples (%llu steps) in %.3f s on %d threads: %.1f Msamples/s, %.2f ns per sample per thread [%llx]\n",
+           (unsigned long long)generated, (unsigned long long)steps, seconds, threads, generated / seconds / 1e6,
+           seconds * 1e9 * threads / generated, (unsigned long long)checksum);
+    free(workers);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [options] [-d seconds] [-t truth.csv] > walk.csv\n"
+            "       %s [options] -b samples [-j threads]\n"
+            "  -s seed          seed of the walk (1)\n"
+            "  -r rate_hz       sensor rate (%u)\n"
+            "  -c cadence       steps per minute (108)\n"
+            "  -v variability   %% of change of cadence and intensity between steps (5)\n"
+            "  -a intensity     peak vertical acceleration of a step, in units (600)\n"
+            "  -n noise         uniform noise on every axis, in units (20)\n"
+            "  -g units_per_g   units of gravity (1000)\n"
+            "  -p pitch, -o roll  orientation of the device, in degrees (30, 20)\n"
+            "  -w walk_ms, -i idle_ms  mean length of the walks and of the still periods, 0 to always walk (0, 0)\n"
+            "  -e every_ms, -l lost_ms  mean time between dropouts and time lost in each, 0 for none (0, 0)\n"
+            "  -d writes that many seconds of samples, -t the times of the steps in truth.csv\n"
+            "  -b measures the samples generated per second on -j threads (1)\n",
+            name, name, SAMPLE_RATE_HZ);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    gait_config_t config;
+    gait_default_config(&config);
+    long seconds = 60;
+    const char *truthPath = NULL;
+    unsigned long long benchSamples = 0;
+    int threads = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:c:v:a:n:g:p:o:w:i:e:l:d:t:b:j:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            config.seed = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            config.rateHz = (uint16_t)atoi(optarg);
+            break;
+        case 'c':
+            config.cadence = (uint16_t)atoi(optarg);
+            break;
+        case 'v':
+            config.variability = (uint8_t)atoi(optarg);
+            break;
+        case 'a':
+            config.intensity = (uint16_t)atoi(optarg);
+            break;
+        case 'n':
+            config.noise = (uint16_t)atoi(optarg);
+            break;
+        case 'g':
+            config.unitsPerG = (uint16_t)atoi(optarg);
+            break;
+        case 'p':
+            config.pitch = (int16_t)atoi(optarg);
+            break;
+        case 'o':
+            config.roll = (int16_t)atoi(optarg);
+            break;
+        case 'w':
+            config.walkMs = (uint32_t)atol(optarg);
+            break;
+        case 'i':
+            config.idleMs = (uint32_t)atol(optarg);
+            break;
+        case 'e':
+            config.dropoutEveryMs = (uint32_t)atol(optarg);
+            break;
+        case 'l':
+            config.dropoutMs = (uint32_t)atol(optarg);
+            break;
+        case 'd':
+            seconds = atol(optarg);
+            break;
+        case 't':
+            truthPath = optarg;
+            break;
+        case 'b':
+            benchSamples = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config.rateHz == 0 || config.cadence == 0 || config.cadence >= 30u * config.rateHz || threads < 1)
+        usage(argv[0]);
+
+    if (benchSamples)
+    {
+        benchmark(&config, benchSamples, threads);
+        return 0;
+    }
+
+    gait_gen_t gen;
+    gait_truth_t truth;
+    gait_gen_init(&gen, &config, 0);
+    truth.capacity = (size_t)(seconds * config.cadence / 60 * 2 + 16);
+    truth.times = malloc(truth.capacity * sizeof(time_accel_t));
+    truth.count = 0;
+
+    time_accel_t time[BLOCK];
+    accel_t x[BLOCK], y[BLOCK], z[BLOCK];
+    time_accel_t endMs = (time_accel_t)(seconds * 1000);
+    int done = 0;
+    while (!done)
+    {
+        gait_gen_fill(&gen, time, x, y, z, BLOCK, &truth);
+        for (int i = 0; i < BLOCK && !(done = time[i] >= endMs); i++)
+            printf("%d, %d, %d, %d\n", time[i], x[i], y[i], z[i]);
+    }
+
+    if (truthPath)
+    {
+        FILE *file = fopen(truthPath, "w");
+        if (!file)
+        {
+            perror(truthPath);
+            return 1;
+        }
+        for (uint64_t i = 0; i < truth.count && i < truth.capacity && truth.times[i] < endMs; i++)
+            fprintf(file, "%d\n", truth.times[i]);
+        fclose(file);
+    }
+    free(truth.times);
+    return 0;
+}
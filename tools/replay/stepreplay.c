@@ -0,0 +1,407 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Replays CSVs of time(ms), X, Y, Z through the algorithm and prints one JSON line
+ * per file with the steps, distance, calories and samples processed per second,
+ * then one line for the whole run.
+ * Files are memory mapped and parsed in place, each sample goes straight to
+ * processSample(); pipes and other inputs that cannot be mapped are read whole first. Archives of steparchive (sampleCodec.h) are recognized by
+ * their header and decoded a block at a time into processSample(). The algorithm keeps its state in globals, so files are spread
+ * over worker processes rather than threads; every worker takes the next file
+ * from a shared counter and sends its results back to the parent on a pipe.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "StepCountingAlgo.h"
+#include "sampleCodec.h"
+
+#define TAIL_SIZE 256 /* room for the last line when it has no newline */
+
+typedef struct user_t user_t;
+
+struct user_t
+{
+    char *gender;
+    uint8_t age;
+    uint8_t height;
+    uint8_t weight;
+    uint16_t rateHz;
+};
+
+typedef struct result_t result_t;
+
+/* Sent by the workers, small enough for the pipe to keep every write whole */
+struct result_t
+{
+    uint32_t file; /* index in the arguments */
+    int32_t error; /* errno, 0 on success */
+    uint64_t samples;
+    uint64_t ns;
+    uint32_t steps;
+    float distance;
+    calorie_t calories;
+};
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Parses one integer, blanks and sign included; a field without digits clears ok */
+static inline const char *parseField(const char *p, long *value, int *ok)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    int negative = *p == '-';
+    p += negative;
+    const char *digits = p;
+    long v = 0;
+    while ((unsigned)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+    *ok &= p != digits;
+    *value = negative ? -v : v;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    return p;
+}
+
+/* Processes the lines between start and end, which must end with a newline. Returns the samples */
+static uint64_t replayLines(const char *p, const char *end)
+{
+    uint64_t samples = 0;
+    while (p < end)
+    {
+        long t, x, y, z;
+        int ok = 1;
+        p = parseField(p, &t, &ok);
+        ok &= *p == ',';
+        p = parseField(p + ok, &x, &ok);
+        ok &= *p == ',';
+        p = parseField(p + ok, &y, &ok);
+        ok &= *p == ',';
+        p = parseField(p + ok, &z, &ok);
+        if (ok)
+        {
+            processSample((time_accel_t)t, (accel_t)x, (accel_t)y, (accel_t)z);
+            samples++;
+        }
+        /* header, blank line or more columns */
+        if (*p != '\n')
+            p = memchr(p, '\n', (size_t)(end - p));
+        p++;
+    }
+    return samples;
+}
+
+/* Processes a CSV. Returns the samples */
+static uint64_t replayText(const char *data, size_t size)
+{
+    /* the mapping is only read up to the last newline, the rest is copied with one added */
+    const char *last = size ? memrchr(data, '\n', size) : NULL;
+    size_t whole = last ? (size_t)(last - data) + 1 : 0;
+    uint64_t samples = replayLines(data, data + whole);
+    if (whole < size)
+    {
+        char tail[TAIL_SIZE + 1];
+        size_t length = size - whole < TAIL_SIZE ? size - whole : TAIL_SIZE;
+        memcpy(tail, data + whole, length);
+        tail[length] = '\n';
+        samples += replayLines(tail, tail + length + 1);
+    }
+    return samples;
+}
+
+/* Processes the blocks of an archive as they are decoded. Returns the samples, error is set if it is corrupt */
+static uint64_t replayArchive(sample_decoder_t *decoder, int32_t *error)
+{
+    sample_block_t block;
+    uint64_t samples = 0;
+
+    while (sample_decoder_next(decoder, &block))
+    {
+        for (uint16_t i = 0; i < block.count; i++)
+            processSample(block.time[i], block.x[i], block.y[i], block.z[i]);
+        samples += block.count;
+    }
+    if (decoder->error)
+        *error = EILSEQ;
+    return samples;
+}
+
+/* Reads the whole of an input that cannot be mapped, e.g. a pipe. Returns NULL with errno set on failure */
+static char *readAll(int fd, size_t *size)
+{
+    size_t capacity = 1 << 16;
+    char *data = malloc(capacity);
+    *size = 0;
+    while (data)
+    {
+        if (*size == capacity)
+        {
+            char *grown = realloc(data, capacity * 2);
+            if (!grown)
+                break;
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + *size, capacity - *size);
+        if (n == 0)
+            return data;
+        if (n > 0)
+            *size += (size_t)n;
+        else if (errno != EINTR)
+            break;
+    }
+    int error = data ? errno : ENOMEM;
+    free(data);
+    errno = error;
+    return NULL;
+}
+
+static void replayFile(const char *path, const user_t *user, result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        result->error = errno;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    const char *data = NULL;
+    size_t size = (size_t)st.st_size;
+    int mapped = S_ISREG(st.st_mode);
+    if (!mapped)
+    {
+        data = readAll(fd, &size);
+        if (!data)
+        {
+            result->error = errno;
+            close(fd);
+            return;
+        }
+    }
+    else if (size > 0)
+    {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            result->error = errno;
+            close(fd);
+            return;
+        }
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    int64_t start = nowNs();
+    initAlgoWithRate(user->gender, user->age, user->height, user->weight, user->rateHz, 1);
+
+    sample_decoder_t decoder;
+    if (size >= SAMPLE_CODEC_HEADER_BYTES && sample_decoder_init(&decoder, (const uint8_t *)data, size))
+        result->samples = replayArchive(&decoder, &result->error);
+    else
+        result->samples = replayText(data, size);
+
+    result->ns = (uint64_t)(nowNs() - start);
+    result->steps = getSteps();
+    result->distance = getDistance();
+    result->calories = getCalories();
+    if (!mapped)
+        free((void *)data);
+    else if (size > 0)
+        munmap((void *)data, size);
+}
+
+static void worker(char **files, uint32_t count, _Atomic uint32_t *next, const user_t *user, int out)
+{
+    uint32_t i;
+    while ((i = atomic_fetch_add(next, 1)) < count)
+    {
+        result_t result;
+        replayFile(files[i], user, &result);
+        result.file = i;
+        if (write(out, &result, sizeof(result)) != sizeof(result))
+            _exit(1);
+    }
+    _exit(0);
+}
+
+/* File names as JSON strings */
+static void printString(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-j workers] [-r sample_rate_hz] [-G gender] [-a age] [-H height] [-W weight] walk.csv|walk.sca...\n"
+            "  files are time(ms), X, Y, Z, lines that are not samples are skipped, or archives of steparchive\n"
+            "  -j number of worker processes, the number of cores by default\n"
+            "  prints a JSON line per file, then one for all of them\n",
+            name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    user_t user = {"M", 30, 180, 80, SAMPLE_RATE_HZ};
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:r:G:a:H:W:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            workers = atol(optarg);
+            break;
+        case 'r':
+            user.rateHz = (uint16_t)atoi(optarg);
+            break;
+        case 'G':
+            user.gender = optarg;
+            break;
+        case 'a':
+            user.age = (uint8_t)atoi(optarg);
+            break;
+        case 'H':
+            user.height = (uint8_t)atoi(optarg);
+            break;
+        case 'W':
+            user.weight = (uint8_t)atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || workers < 1)
+        usage(argv[0]);
+#ifdef DUMP_FILE
+    fprintf(stderr, "warning: built with DUMP_FILE, every worker writes the stage csv files and samples/s includes that I/O (configure with -DDUMP_STAGES=OFF)\n");
+#endif
+    if (!initAlgoWithRate(user.gender, user.age, user.height, user.weight, user.rateHz, 1))
+    {
+        fprintf(stderr, "unsupported rate %u Hz\n", user.rateHz);
+        return 1;
+    }
+
+    char **files = argv + optind;
+    uint32_t count = (uint32_t)(argc - optind);
+    if ((uint32_t)workers > count)
+        workers = count;
+
+    _Atomic uint32_t *next = mmap(NULL, sizeof(*next), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    int results[2];
+    if (next == MAP_FAILED || pipe(results) < 0)
+    {
+        perror("stepreplay");
+        return 1;
+    }
+    atomic_init(next, 0);
+
+    int64_t start = nowNs();
+    fflush(stdout);
+    for (long w = 0; w < workers; w++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+        {
+            close(results[0]);
+            worker(files, count, next, &user, results[1]);
+        }
+    }
+    close(results[1]);
+
+    uint64_t samples = 0, steps = 0;
+    double distance = 0, calories = 0;
+    uint32_t failed = 0, received = 0;
+    result_t result;
+    while (read(results[0], &result, sizeof(result)) == sizeof(result))
+    {
+        received++;
+        printf("{\"file\":");
+        printString(files[result.file]);
+        if (result.error)
+        {
+            printf(",\"error\":");
+            printString(strerror(result.error));
+            printf("}\n");
+            failed++;
+            continue;
+        }
+        printf(",\"samples\":%llu,\"steps\":%u,\"distance\":%.3f,\"calories\":%.3f,\"samples_per_sec\":%.0f}\n",
+               (unsigned long long)result.samples, result.steps, result.distance, result.calories,
+               result.ns ? result.samples * 1e9 / result.ns : 0);
+        samples += result.samples;
+        steps += result.steps;
+        distance += result.distance;
+        calories += result.calories;
+    }
+    while (wait(NULL) > 0)
+        ;
+
+    double seconds = (nowNs() - start) / 1e9;
+    printf("{\"files\":%u,\"failed\":%u,\"workers\":%ld,\"samples\":%llu,\"steps\":%llu,\"distance\":%.3f,"
+           "\"calories\":%.3f,\"seconds\":%.3f,\"samples_per_sec\":%.0f}\n",
+           received - failed, failed, workers, (unsigned long long)samples, (unsigned long long)steps, distance,
+           calories, seconds, seconds > 0 ? samples / seconds : 0);
+    return received == count && failed == 0 ? 0 : 1;
+}
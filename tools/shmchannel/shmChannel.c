@@ -0,0 +1,180 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shmChannel.h"
+
+static long futex(_Atomic uint32_t *word, int op, uint32_t value, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+static int mapChannel(shm_channel_t *channel, int fd, size_t size)
+{
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  channel->ring = map;
+  channel->mapSize = size;
+  channel->fd = fd;
+  return 0;
+}
+
+int shm_channel_create(shm_channel_t *channel, uint32_t capacity)
+{
+  uint32_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+
+  size_t mapSize = sizeof(shm_ring_t) + (size_t)size * sizeof(shm_sample_t);
+  int fd = memfd_create("step-samples", MFD_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (ftruncate(fd, mapSize) < 0 || mapChannel(channel, fd, mapSize) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  shm_ring_t *ring = channel->ring;
+  ring->capacity = size;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->wakeups, 0);
+  atomic_init(&ring->sleeps, 0);
+  atomic_init(&ring->sleeping, 0);
+  ring->magic = SHM_CHANNEL_MAGIC;
+  return 0;
+}
+
+int shm_channel_attach(shm_channel_t *channel, int fd)
+{
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_ring_t))
+    return -1;
+  if (mapChannel(channel, fd, st.st_size) < 0)
+    return -1;
+  if (channel->ring->magic != SHM_CHANNEL_MAGIC ||
+      sizeof(shm_ring_t) + (size_t)channel->ring->capacity * sizeof(shm_sample_t) > channel->mapSize)
+  {
+    munmap(channel->ring, channel->mapSize);
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+void shm_channel_close(shm_channel_t *channel)
+{
+  munmap(channel->ring, channel->mapSize);
+  close(channel->fd);
+  channel->ring = NULL;
+}
+
+uint32_t shm_channel_reserve(shm_channel_t *channel, shm_sample_t **samples, uint32_t count)
+{
+  shm_ring_t *ring = channel->ring;
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint32_t index = head & (ring->capacity - 1);
+  uint32_t free = ring->capacity - (head - tail);
+  uint32_t contiguous = ring->capacity - index;
+
+  if (count > free)
+    count = free;
+  if (count > contiguous)
+    count = contiguous;
+  *samples = &ring->samples[index];
+  return count;
+}
+
+void shm_channel_commit(shm_channel_t *channel, uint32_t count)
+{
+  shm_ring_t *ring = channel->ring;
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  /* seq_cst store then load, pairs with the consumer setting sleeping then reading head */
+  atomic_store(&ring->head, head + count);
+  if (atomic_load(&ring->sleeping) && atomic_exchange(&ring->sleeping, 0))
+  {
+    futex(&ring->sleeping, FUTEX_WAKE, 1, NULL);
+    atomic_fetch_add_explicit(&ring->wakeups, 1, memory_order_relaxed);
+  }
+}
+
+uint32_t shm_channel_peek(shm_channel_t *channel, const shm_sample_t **samples)
+{
+  shm_ring_t *ring = channel->ring;
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t index = tail & (ring->capacity - 1);
+  uint32_t available = head - tail;
+  uint32_t contiguous = ring->capacity - index;
+
+  *samples = &ring->samples[index];
+  return available < contiguous ? available : contiguous;
+}
+
+void shm_channel_release(shm_channel_t *channel, uint32_t count)
+{
+  shm_ring_t *ring = channel->ring;
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+}
+
+uint8_t shm_channel_wait(shm_channel_t *channel, int timeoutMs)
+{
+  shm_ring_t *ring = channel->ring;
+  struct timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+
+  for (;;)
+  {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (atomic_load_explicit(&ring->head, memory_order_acquire) != tail)
+      return 1;
+
+    atomic_store(&ring->sleeping, 1);
+    if (atomic_load(&ring->head) != tail)
+    {
+      atomic_store(&ring->sleeping, 0);
+      return 1;
+    }
+
+    atomic_fetch_add_explicit(&ring->sleeps, 1, memory_order_relaxed);
+    long r = futex(&ring->sleeping, FUTEX_WAIT, 1, timeoutMs < 0 ? NULL : &timeout);
+    if (r < 0 && errno == ETIMEDOUT)
+    {
+      atomic_store(&ring->sleeping, 0);
+      return atomic_load(&ring->head) != tail;
+    }
+  }
+}
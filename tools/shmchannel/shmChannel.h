@@ -0,0 +1,140 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Single producer, single consumer channel of accelerometer samples in shared memory.
+ * The sensor-hub process reserves space, writes samples in place and commits them
+ * in batches; the algorithm process reads them straight out of the shared pages and
+ * releases them once processed. A consumer with nothing to read sleeps on a futex
+ * and is only woken by a commit when it is actually sleeping.
+ */
+
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+#include <stdatomic.h>
+#include <stddef.h>
+#include "config.h"
+
+#define SHM_CHANNEL_MAGIC 0x53434831u /* "SCH1" */
+
+typedef struct shm_sample_t shm_sample_t;
+
+struct shm_sample_t
+{
+  time_accel_t time;
+  accel_t x;
+  accel_t y;
+  accel_t z;
+};
+
+/**
+ * Layout of the shared mapping, the samples follow the header.
+ * Producer and consumer indices live on separate cache lines.
+ */
+typedef struct shm_ring_t shm_ring_t;
+
+struct shm_ring_t
+{
+  uint32_t magic;
+  uint32_t capacity; /* number of samples, power of two */
+  _Alignas(64) _Atomic uint32_t head;   /* written by the producer */
+  _Atomic uint64_t wakeups;             /* futex wakes issued by the producer */
+  _Alignas(64) _Atomic uint32_t tail;   /* written by the consumer */
+  _Atomic uint64_t sleeps;              /* times the consumer went to sleep */
+  _Alignas(64) _Atomic uint32_t sleeping; /* futex word, 1 while the consumer waits */
+  _Alignas(64) shm_sample_t samples[];
+};
+
+typedef struct shm_channel_t shm_channel_t;
+
+struct shm_channel_t
+{
+  shm_ring_t *ring;
+  size_t mapSize;
+  int fd;
+};
+
+/**
+ * Creates a channel backed by an anonymous memfd.
+ * The fd can be inherited by a forked process or passed over a Unix socket.
+ * @param channel the channel to initialize
+ * @param capacity number of samples, rounded up to a power of two
+ * @return 0 on success; -1 otherwise, with errno set
+ */
+int shm_channel_create(shm_channel_t *channel, uint32_t capacity);
+
+/**
+ * Maps a channel created by another process.
+ * @param channel the channel to initialize
+ * @param fd the memfd of the channel
+ * @return 0 on success; -1 otherwise
+ */
+int shm_channel_attach(shm_channel_t *channel, int fd);
+
+/**
+ * Unmaps the channel and closes its fd.
+ */
+void shm_channel_close(shm_channel_t *channel);
+
+/**
+ * Returns a contiguous span of free slots for the producer to fill in place.
+ * @param channel the channel
+ * @param samples where the start of the span is returned
+ * @param count the number of samples wanted
+ * @return the number of slots available, at most count; 0 if the channel is full
+ */
+uint32_t shm_channel_reserve(shm_channel_t *channel, shm_sample_t **samples, uint32_t count);
+
+/**
+ * Publishes samples written in reserved slots and wakes the consumer if it sleeps.
+ * @param channel the channel
+ * @param count the number of samples written
+ */
+void shm_channel_commit(shm_channel_t *channel, uint32_t count);
+
+/**
+ * Returns a contiguous span of samples to read in place, without removing them.
+ * @param channel the channel
+ * @param samples where the start of the span is returned
+ * @return the number of samples in the span; 0 if the channel is empty
+ */
+uint32_t shm_channel_peek(shm_channel_t *channel, const shm_sample_t **samples);
+
+/**
+ * Gives back slots to the producer once the samples have been processed.
+ * @param channel the channel
+ * @param count the number of samples processed
+ */
+void shm_channel_release(shm_channel_t *channel, uint32_t count);
+
+/**
+ * Sleeps until the channel is not empty.
+ * @param channel the channel
+ * @param timeoutMs maximum wait, -1 for no limit
+ * @return 1 if samples are available; 0 on timeout
+ */
+uint8_t shm_channel_wait(shm_channel_t *channel, int timeoutMs);
+
+#endif
@@ -0,0 +1,263 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Measures the sample channel between a producer process (the sensor hub) and
+ * a consumer process running the algorithm, either over the shared-memory
+ * channel or over a pipe for comparison.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "StepCountingAlgo.h"
+#include "shmChannel.h"
+
+#define WAVE_LENGTH 1000
+#define SAMPLE_PERIOD_MS 20
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void fillSample(shm_sample_t *sample, uint64_t i)
+{
+    static int16_t wave[WAVE_LENGTH];
+    static int ready = 0;
+    if (!ready)
+    {
+        for (int k = 0; k < WAVE_LENGTH; k++)
+            wave[k] = (int16_t)(1000 + (k < WAVE_LENGTH / 2 ? 600 * sin(2 * M_PI * 1.8 * k * SAMPLE_PERIOD_MS / 1000) : 0));
+        ready = 1;
+    }
+    int16_t a = wave[i % WAVE_LENGTH];
+    sample->time = (time_accel_t)(i * SAMPLE_PERIOD_MS);
+    sample->x = a * 3 / 10;
+    sample->y = a * 5 / 10;
+    sample->z = a * 8 / 10;
+}
+
+/* Paces the producer to rate samples/s, 0 means as fast as possible */
+static void pace(uint64_t produced, int64_t start, double rate)
+{
+    if (rate <= 0)
+        return;
+    int64_t due = start + (int64_t)(produced / rate * 1e9);
+    int64_t now = nowNs();
+    if (due > now)
+    {
+        struct timespec ts = {(due - now) / 1000000000LL, (due - now) % 1000000000LL};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void produceShm(shm_channel_t *channel, uint64_t total, uint32_t batch, double rate)
+{
+    int64_t start = nowNs();
+    uint64_t produced = 0;
+    while (produced < total)
+    {
+        shm_sample_t *samples;
+        uint32_t want = total - produced < batch ? total - produced : batch;
+        uint32_t n = shm_channel_reserve(channel, &samples, want);
+        if (n == 0)
+        {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++)
+            fillSample(&samples[i], produced + i);
+        shm_channel_commit(channel, n);
+        produced += n;
+        pace(produced, start, rate);
+    }
+}
+
+static uint64_t consumeShm(shm_channel_t *channel, uint64_t total, int process)
+{
+    uint64_t consumed = 0;
+    while (consumed < total)
+    {
+        const shm_sample_t *samples;
+        uint32_t n = shm_channel_peek(channel, &samples);
+        if (n == 0)
+        {
+            shm_channel_wait(channel, -1);
+            continue;
+        }
+        if (process)
+        {
+            for (uint32_t i = 0; i < n; i++)
+                processSample(samples[i].time, samples[i].x, samples[i].y, samples[i].z);
+        }
+        shm_channel_release(channel, n);
+        consumed += n;
+    }
+    return consumed;
+}
+
+static void producePipe(int fd, uint64_t total, uint32_t batch, double rate)
+{
+    shm_sample_t *samples = malloc(batch * sizeof(shm_sample_t));
+    int64_t start = nowNs();
+    uint64_t produced = 0;
+    while (produced < total)
+    {
+        uint32_t n = total - produced < batch ? total - produced : batch;
+        for (uint32_t i = 0; i < n; i++)
+            fillSample(&samples[i], produced + i);
+        if (write(fd, samples, n * sizeof(shm_sample_t)) != (ssize_t)(n * sizeof(shm_sample_t)))
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        produced += n;
+        pace(produced, start, rate);
+    }
+    free(samples);
+}
+
+static uint64_t consumePipe(int fd, uint64_t total, int process, uint64_t *reads)
+{
+    static shm_sample_t samples[4096];
+    uint64_t consumed = 0;
+    size_t partial = 0;
+    while (consumed < total)
+    {
+        ssize_t n = read(fd, (uint8_t *)samples + partial, sizeof(samples) - partial);
+        if (n <= 0)
+            break;
+        (*reads)++;
+        partial += n;
+        uint32_t count = partial / sizeof(shm_sample_t);
+        if (process)
+        {
+            for (uint32_t i = 0; i < count; i++)
+                processSample(samples[i].time, samples[i].x, samples[i].y, samples[i].z);
+        }
+        consumed += count;
+        partial -= count * sizeof(shm_sample_t);
+        memmove(samples, (uint8_t *)samples + count * sizeof(shm_sample_t), partial);
+    }
+    return consumed;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t total = 20000000;
+    uint32_t batch = 25;
+    uint32_t capacity = 65536;
+    double rate = 0;
+    int usePipe = 0;
+    int process = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "N:b:c:r:Pnh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'N': total = strtoull(optarg, NULL, 10); break;
+        case 'b': batch = strtoul(optarg, NULL, 10); break;
+        case 'c': capacity = strtoul(optarg, NULL, 10); break;
+        case 'r': rate = atof(optarg); break;
+        case 'P': usePipe = 1; break;
+        case 'n': process = 0; break;
+        default:
+            fprintf(stderr, "usage: %s [-N samples] [-b batch] [-c capacity] [-r samples_per_sec] [-P use a pipe] [-n do not run the algorithm]\n", argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (batch == 0)
+        batch = 1;
+
+    shm_channel_t channel;
+    int pipeFds[2];
+    if (usePipe ? pipe(pipeFds) < 0 : shm_channel_create(&channel, capacity) < 0)
+    {
+        perror("channel");
+        return EXIT_FAILURE;
+    }
+
+    initAlgo("M", 35, 175, 75);
+    int64_t start = nowNs();
+    pid_t producer = fork();
+    if (producer == 0)
+    {
+        if (usePipe)
+        {
+            close(pipeFds[0]);
+            producePipe(pipeFds[1], total, batch, rate);
+        }
+        else
+        {
+            produceShm(&channel, total, batch, rate);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    uint64_t reads = 0;
+    uint64_t consumed;
+    if (usePipe)
+    {
+        close(pipeFds[1]);
+        consumed = consumePipe(pipeFds[0], total, process, &reads);
+    }
+    else
+    {
+        consumed = consumeShm(&channel, total, process);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    waitpid(producer, NULL, 0);
+
+    printf("channel          %s\n", usePipe ? "pipe" : "shm");
+    printf("batch            %u samples\n", batch);
+    printf("samples          %llu in %.3f s (%.0f samples/s)\n", (unsigned long long)consumed, seconds, consumed / seconds);
+    if (usePipe)
+    {
+        printf("reads            %llu (%.0f /s)\n", (unsigned long long)reads, reads / seconds);
+    }
+    else
+    {
+        uint64_t wakeups = atomic_load(&channel.ring->wakeups);
+        uint64_t sleeps = atomic_load(&channel.ring->sleeps);
+        printf("wakeups          %llu (%.0f /s)\n", (unsigned long long)wakeups, wakeups / seconds);
+        printf("consumer sleeps  %llu (%.0f /s)\n", (unsigned long long)sleeps, sleeps / seconds);
+        shm_channel_close(&channel);
+    }
+    if (process)
+        printf("steps            %u\n", getSteps());
+    return EXIT_SUCCESS;
+}
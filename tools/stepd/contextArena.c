@@ -0,0 +1,212 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "contextArena.h"
+
+/* The header takes the first page, the directory the next ones, then come the slots */
+static size_t directoryOffset(size_t page)
+{
+  return (sizeof(context_arena_header_t) + page - 1) / page * page;
+}
+
+static size_t slotsOffset(uint32_t capacity, size_t page)
+{
+  return directoryOffset(page) + ((size_t)capacity * sizeof(context_arena_entry_t) + page - 1) / page * page;
+}
+
+static size_t arenaSize(uint32_t capacity, uint32_t slotSize, size_t page)
+{
+  return slotsOffset(capacity, page) + (size_t)capacity * slotSize;
+}
+
+static int mapArena(context_arena_t *arena, int fd, uint32_t capacity, uint32_t slotSize, size_t page)
+{
+  size_t size = arenaSize(capacity, slotSize, page);
+  uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  arena->header = (context_arena_header_t *)map;
+  arena->entries = (context_arena_entry_t *)(map + directoryOffset(page));
+  arena->slots = map + slotsOffset(capacity, page);
+  arena->mapSize = size;
+  arena->fd = fd;
+  return 0;
+}
+
+static int matches(const context_arena_header_t *header, uint32_t slotSize, uint64_t layout, size_t fileSize,
+                   size_t page)
+{
+  return header->magic == CONTEXT_ARENA_MAGIC && header->version == CONTEXT_ARENA_VERSION &&
+         header->layout == layout && header->slotSize == slotSize && header->capacity > 0 &&
+         header->used <= header->capacity && header->freeHead <= header->capacity &&
+         fileSize >= arenaSize(header->capacity, slotSize, page);
+}
+
+/* Closes a file after a failure, keeping the errno of the failure */
+static int closeFailed(int fd)
+{
+  int error = errno;
+  close(fd);
+  errno = error;
+  return -1;
+}
+
+static int openLocked(const char *path, int flags)
+{
+  int fd = open(path, flags | O_RDWR | O_CLOEXEC, 0644);
+  if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) < 0)
+    return closeFailed(fd);
+  return fd;
+}
+
+int context_arena_open(context_arena_t *arena, const char *path, uint32_t slotSize, uint32_t capacity,
+                       uint64_t layout)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  int result = CONTEXT_ARENA_CREATED;
+  struct stat st;
+  context_arena_header_t header;
+
+  if (capacity == 0 || slotSize == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  slotSize = (uint32_t)((slotSize + page - 1) / page * page);
+
+  int fd = openLocked(path, O_CREAT);
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) < 0)
+    return closeFailed(fd);
+
+  if (st.st_size > 0)
+  {
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        matches(&header, slotSize, layout, (size_t)st.st_size, page))
+    {
+      if (mapArena(arena, fd, header.capacity, slotSize, page) < 0)
+        return closeFailed(fd);
+      arena->wasClean = (uint8_t)arena->header->clean;
+      arena->header->clean = 0;
+      return CONTEXT_ARENA_ATTACHED;
+    }
+
+    /* written by another build or damaged, kept aside rather than overwritten */
+    char old[PATH_MAX];
+    if (snprintf(old, sizeof(old), "%s.old", path) >= (int)sizeof(old))
+    {
+      errno = ENAMETOOLONG;
+      return closeFailed(fd);
+    }
+    if (rename(path, old) < 0)
+      return closeFailed(fd);
+    close(fd);
+    fd = openLocked(path, O_CREAT | O_EXCL);
+    if (fd < 0)
+      return -1;
+    result = CONTEXT_ARENA_REPLACED;
+  }
+
+  /* the slots are holes until they are written */
+  if (ftruncate(fd, arenaSize(capacity, slotSize, page)) < 0 || mapArena(arena, fd, capacity, slotSize, page) < 0)
+    return closeFailed(fd);
+  for (uint32_t i = 0; i < capacity; i++)
+    arena->entries[i].nextFree = i + 1;
+  arena->header->version = CONTEXT_ARENA_VERSION;
+  arena->header->layout = layout;
+  arena->header->slotSize = slotSize;
+  arena->header->capacity = capacity;
+  arena->header->used = 0;
+  arena->header->freeHead = 0;
+  arena->header->clean = 0;
+  arena->wasClean = 1;
+  /* last, an arena interrupted while being created is not valid */
+  arena->header->magic = CONTEXT_ARENA_MAGIC;
+  return result;
+}
+
+void context_arena_close(context_arena_t *arena)
+{
+  arena->header->clean = 1;
+  msync(arena->header, arena->mapSize, MS_SYNC);
+  munmap(arena->header, arena->mapSize);
+  close(arena->fd);
+  arena->header = NULL;
+}
+
+void *context_arena_alloc(context_arena_t *arena, uint32_t key)
+{
+  context_arena_header_t *header = arena->header;
+  uint32_t index = header->freeHead;
+  if (index >= header->capacity)
+    return NULL;
+
+  context_arena_entry_t *entry = &arena->entries[index];
+  void *slot = context_arena_slot(arena, index);
+  header->freeHead = entry->nextFree;
+  header->used++;
+  memset(slot, 0, header->slotSize);
+  entry->key = key;
+  entry->state = CONTEXT_ARENA_USED;
+  return slot;
+}
+
+void context_arena_free(context_arena_t *arena, void *slot)
+{
+  context_arena_header_t *header = arena->header;
+  uint32_t index = context_arena_index(arena, slot);
+  context_arena_entry_t *entry = &arena->entries[index];
+
+  entry->state = CONTEXT_ARENA_FREE;
+  entry->nextFree = header->freeHead;
+  header->freeHead = index;
+  header->used--;
+}
+
+void *context_arena_slot(context_arena_t *arena, uint32_t index)
+{
+  return arena->slots + (size_t)index * arena->header->slotSize;
+}
+
+uint32_t context_arena_index(context_arena_t *arena, const void *slot)
+{
+  return (uint32_t)(((const uint8_t *)slot - arena->slots) / arena->header->slotSize);
+}
+
+void context_arena_set_busy(context_arena_t *arena, const void *slot, uint8_t busy)
+{
+  arena->entries[context_arena_index(arena, slot)].state = busy ? CONTEXT_ARENA_BUSY : CONTEXT_ARENA_USED;
+}
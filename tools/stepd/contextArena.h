@@ -0,0 +1,144 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Arena of fixed-size slots in a memory-mapped file, for keeping the pipeline state of
+ * each device across restarts. A directory maps each slot to the key of its owner and a
+ * free list links the slots not in use. The slots are page aligned and the file is sparse,
+ * only the slots ever used take space. Nothing in the file is a pointer, the owner of a
+ * slot fixes up its own pointers once it is mapped again.
+ */
+
+#ifndef CONTEXT_ARENA_H
+#define CONTEXT_ARENA_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTEXT_ARENA_MAGIC 0x41435453u /* "STCA" */
+#define CONTEXT_ARENA_VERSION 1
+
+/* State of a slot in the directory */
+#define CONTEXT_ARENA_FREE 0
+#define CONTEXT_ARENA_USED 1
+#define CONTEXT_ARENA_BUSY 2 /* being updated, a slot left busy was not written completely */
+
+/* Result of context_arena_open() */
+#define CONTEXT_ARENA_CREATED 0
+#define CONTEXT_ARENA_ATTACHED 1
+#define CONTEXT_ARENA_REPLACED 2 /* the file did not match, it was moved to <path>.old */
+
+typedef struct context_arena_header_t context_arena_header_t;
+
+struct context_arena_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t layout;   /* fingerprint of what the slots hold, given by the owner */
+  uint32_t slotSize; /* bytes, a multiple of the page size */
+  uint32_t capacity; /* number of slots */
+  uint32_t used;     /* slots not free */
+  uint32_t freeHead; /* first free slot, capacity if none */
+  uint32_t clean;    /* 1 if the arena was closed by context_arena_close() */
+};
+
+typedef struct context_arena_entry_t context_arena_entry_t;
+
+struct context_arena_entry_t
+{
+  uint32_t key;
+  uint32_t state;
+  uint32_t nextFree; /* next slot in the free list, free slots only */
+};
+
+typedef struct context_arena_t context_arena_t;
+
+struct context_arena_t
+{
+  context_arena_header_t *header;
+  context_arena_entry_t *entries; /* directory, one entry per slot */
+  uint8_t *slots;
+  size_t mapSize;
+  int fd;
+  uint8_t wasClean; /* the previous process closed the arena, set when attached */
+};
+
+/**
+ * Maps the arena in a file, creating the file if needed. A file written with another
+ * version, layout or slot size is moved to <path>.old and a new arena is created.
+ * The file is locked, a second process opening it fails with EWOULDBLOCK.
+ * @param arena the arena to initialize
+ * @param path the file
+ * @param slotSize the bytes needed per slot, rounded up to the page size
+ * @param capacity the number of slots of a new arena, an existing one keeps its own
+ * @param layout fingerprint of the slot contents, e.g. the size of the structures and the build options
+ * @return CONTEXT_ARENA_CREATED, CONTEXT_ARENA_ATTACHED or CONTEXT_ARENA_REPLACED; -1 otherwise, with errno set
+ */
+int context_arena_open(context_arena_t *arena, const char *path, uint32_t slotSize, uint32_t capacity,
+                       uint64_t layout);
+
+/**
+ * Marks the arena clean, writes it back to the file and unmaps it.
+ * @param arena the arena
+ */
+void context_arena_close(context_arena_t *arena);
+
+/**
+ * Takes a free slot, zeroed.
+ * @param arena the arena
+ * @param key the owner of the slot, kept in the directory
+ * @return the slot; NULL if the arena is full
+ */
+void *context_arena_alloc(context_arena_t *arena, uint32_t key);
+
+/**
+ * Gives back a slot.
+ * @param arena the arena
+ * @param slot a slot returned by context_arena_alloc() or context_arena_slot()
+ */
+void context_arena_free(context_arena_t *arena, void *slot);
+
+/**
+ * @param arena the arena
+ * @param index the slot number, below the capacity
+ * @return the slot, whatever its state
+ */
+void *context_arena_slot(context_arena_t *arena, uint32_t index);
+
+/**
+ * @param arena the arena
+ * @param slot a slot of the arena
+ * @return the slot number
+ */
+uint32_t context_arena_index(context_arena_t *arena, const void *slot);
+
+/**
+ * Marks a slot busy while it is updated, or used again once it is consistent.
+ * @param arena the arena
+ * @param slot a slot in use
+ * @param busy 1 before the update; 0 after it
+ */
+void context_arena_set_busy(context_arena_t *arena, const void *slot, uint8_t busy);
+
+#endif
@@ -0,0 +1,144 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef STEPD_PROTOCOL_H
+#define STEPD_PROTOCOL_H
+#include <stdint.h>
+
+/**
+ * @file
+ * Binary framing spoken by stepd over Unix-domain stream sockets and UDP.
+ * Every frame starts with a header followed by a payload depending on the type,
+ * all fields are in host byte order since the service is local.
+ * On UDP every datagram carries exactly one frame, on stream sockets frames
+ * are sent back to back.
+ */
+
+#define STEPD_VERSION 3
+
+/* Maximum number of samples in one frame, keeps a frame within one datagram */
+#define STEPD_MAX_BATCH 128
+
+/* Frame types */
+#define STEPD_SAMPLES 1     /* client -> stepd, count samples */
+#define STEPD_QUERY 2       /* client -> stepd, answered with STEPD_METRICS */
+#define STEPD_METRICS 3     /* stepd -> client */
+#define STEPD_PROFILE 4     /* client -> stepd, (re)initializes the device, answered only with STEPD_REJECTED */
+#define STEPD_STATS 5       /* client -> stepd, answered with STEPD_STATS_REPLY */
+#define STEPD_STATS_REPLY 6 /* stepd -> client */
+#define STEPD_MODES 7       /* client -> stepd, answered with STEPD_MODES_REPLY */
+#define STEPD_MODES_REPLY 8 /* stepd -> client */
+#define STEPD_REJECTED 9    /* stepd -> client, the rate of a STEPD_PROFILE is not supported */
+
+/* Overload modes, each one also does what the previous ones do */
+#define STEPD_MODE_NORMAL 0    /* the full pipeline */
+#define STEPD_MODE_LEAN 1      /* tracing paused, metrics published only with steps */
+#define STEPD_MODE_DECIMATED 2 /* fast sensors decimated by 2, down to a minimum rate */
+#define STEPD_MODE_SHEDDING 3  /* frames beyond the samples allowed per round dropped */
+#define STEPD_MODE_COUNT 4
+
+typedef struct __attribute__((packed))
+{
+    uint8_t type;
+    uint8_t version;
+    uint16_t count;    /* number of samples, 0 for other frame types */
+    uint32_t deviceId;
+    uint32_t seq;      /* echoed back in replies */
+} stepd_header_t;
+
+typedef struct __attribute__((packed))
+{
+    int32_t time;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} stepd_sample_t;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t sampleRateHz;
+    uint16_t timeScalingFactor;
+    char gender;       /* 'F' or 'M' */
+    uint8_t age;
+    uint8_t height;
+    uint8_t weight;
+} stepd_profile_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t steps;
+    float distance;
+    float calories;
+} stepd_metrics_t;
+
+typedef struct __attribute__((packed))
+{
+    uint64_t samples;
+    uint64_t frames;
+    uint32_t devices;
+    uint32_t dropped;  /* malformed frames, frames of rejected devices and replies that could not be sent */
+    uint64_t shed;     /* samples dropped while shedding */
+    uint32_t modeChanges;
+    uint8_t mode;      /* current overload mode */
+    uint32_t rejected; /* profiles with an unsupported rate */
+} stepd_stats_t;
+
+typedef struct __attribute__((packed))
+{
+    uint64_t samples[STEPD_MODE_COUNT]; /* samples of the device processed in each mode */
+    uint64_t shed;
+    uint8_t mode;      /* mode of the last samples of the device */
+} stepd_modes_t;
+
+/**
+ * Returns the payload size of a frame given its header.
+ * @return the size in bytes; -1 if the header is not valid
+ */
+static inline int32_t stepd_payload_size(const stepd_header_t *header)
+{
+    if (header->version != STEPD_VERSION)
+        return -1;
+
+    switch (header->type)
+    {
+    case STEPD_SAMPLES:
+        return header->count <= STEPD_MAX_BATCH ? (int32_t)(header->count * sizeof(stepd_sample_t)) : -1;
+    case STEPD_QUERY:
+    case STEPD_STATS:
+    case STEPD_MODES:
+    case STEPD_REJECTED:
+        return 0;
+    case STEPD_METRICS:
+        return sizeof(stepd_metrics_t);
+    case STEPD_PROFILE:
+        return sizeof(stepd_profile_t);
+    case STEPD_STATS_REPLY:
+        return sizeof(stepd_stats_t);
+    case STEPD_MODES_REPLY:
+        return sizeof(stepd_modes_t);
+    default:
+        return -1;
+    }
+}
+
+#endif
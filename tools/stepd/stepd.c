@@ -0,0 +1,979 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * stepd, a local service running one step counting pipeline per device.
+ * Gateways push sample frames over a Unix-domain stream socket or UDP (see protocol.h).
+ * All the frames read in one epoll round are grouped by device, then each device
+ * is selected once and its samples are run through processSample in one go.
+ * Queries are answered after the round, so they reflect every sample received before them.
+ *
+ * An overload controller watches the samples queued in each round and the time the round
+ * takes. Above the limits it steps through the STEPD_MODE_* modes of protocol.h, one per
+ * OVERLOAD_HOLD_MS, and goes back one mode per OVERLOAD_RECOVER_MS below half the limits.
+ * Devices switch mode with their next batch and count their samples per mode, samples shed
+ * are counted too, so that degraded results can be told apart.
+ *
+ * With an arena file (-A) the devices live in its slots (see contextArena.h), so that a
+ * restarted stepd maps them back and resumes every stream where it stopped, windows and
+ * detection statistics included, instead of warming up again. Their contexts are relocated
+ * on first use. A device is marked busy in the arena while it is updated; one found busy
+ * after a restart keeps its profile but starts over.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "StepCountingAlgo.h"
+#include "tracer.h"
+#include "protocol.h"
+#include "contextArena.h"
+
+#define MAX_EVENTS 64
+#define RX_BUFFER_SIZE 65536
+#define UDP_BATCH 64           /* datagrams read per recvmmsg call */
+#define READS_PER_ROUND 16     /* reads per endpoint before the round is processed, bounds the latency */
+#define MAX_PENDING 8192       /* samples buffered per device before it is processed anyway */
+#define INITIAL_DEVICE_SLOTS 1024
+#define DEFAULT_ARENA_CAPACITY 65536 /* devices, the file is sparse */
+
+/* Overload controller */
+#define DEFAULT_MAX_DEPTH 65536    /* samples queued in one round */
+#define DEFAULT_MAX_LAG_MS 20      /* duration of one round */
+#define DEFAULT_MIN_RATE_HZ 100    /* slower sensors are not decimated, counting suffers below this */
+#define OVERLOAD_HOLD_MS 500       /* time a mode is given to take effect before the next one */
+#define OVERLOAD_RECOVER_MS 2000   /* time below half the limits before going back one mode */
+#define OVERLOAD_POLL_MS 100       /* rounds also run without traffic while degraded, to recover */
+
+/* Profile used for devices that send samples before a STEPD_PROFILE frame */
+#define DEFAULT_GENDER "M"
+#define DEFAULT_AGE 35
+#define DEFAULT_HEIGHT 175
+#define DEFAULT_WEIGHT 75
+
+enum endpoint_kind
+{
+    ENDPOINT_LISTEN,
+    ENDPOINT_STREAM,
+    ENDPOINT_UDP,
+    ENDPOINT_SIGNAL
+};
+
+typedef struct endpoint_t endpoint_t;
+
+struct endpoint_t
+{
+    enum endpoint_kind kind;
+    int fd;
+    uint32_t used;      /* bytes in rx, stream endpoints only */
+    uint8_t rx[];
+};
+
+/* Kept in the arena with -A, only pending does not survive a restart */
+typedef struct device_t device_t;
+
+struct device_t
+{
+    uint32_t id;
+    uint8_t dirty;
+    uint32_t pendingCount;
+    uint32_t pendingCapacity;
+    stepd_sample_t *pending;
+    uint32_t gapAt;     /* pending sample after shed frames, plus one, 0 if none */
+    uint8_t shedGap;    /* frames were shed since the last sample queued */
+    uint8_t mode;       /* overload mode of its last samples */
+    uint8_t baseFactor; /* decimation for its rate outside the decimated mode */
+    uint64_t modeSamples[STEPD_MODE_COUNT];
+    uint64_t shed;
+    char gender;        /* 'F' or 'M', the context only keeps a pointer to it */
+    uint8_t rejected;   /* its last profile had an unsupported rate, its samples are dropped */
+    uint8_t inArena;    /* lives in a slot of the arena */
+    uint8_t restored;   /* mapped from the arena, the context is relocated on first use */
+    step_context_t ctx;
+};
+
+typedef struct reply_t reply_t;
+
+struct reply_t
+{
+    stepd_header_t request;
+    int fd;
+    struct sockaddr_in addr; /* UDP only */
+    socklen_t addrLen;
+};
+
+typedef union
+{
+    stepd_metrics_t metrics;
+    stepd_stats_t stats;
+    stepd_modes_t modes;
+} reply_payload_t;
+
+typedef struct overload_t overload_t;
+
+struct overload_t
+{
+    uint8_t mode;
+    uint32_t maxDepth;
+    int64_t maxLagNs;
+    uint16_t minRateHz;
+    uint64_t depth;      /* samples received in this round */
+    uint64_t accepted;   /* samples of this round not shed */
+    int64_t changedNs;   /* time of the last mode change */
+    int64_t calmSinceNs; /* start of the rounds below half the limits, 0 if the last one was not */
+};
+
+/* Devices, open addressing on the device id */
+static device_t **slots;
+static uint32_t slotCount;
+static uint32_t deviceCount;
+
+/* Devices with pending samples in this round */
+static device_t **dirty;
+static uint32_t dirtyCount;
+static uint32_t dirtyCapacity;
+
+/* Queries to answer at the end of this round */
+static reply_t *replies;
+static uint32_t replyCount;
+static uint32_t replyCapacity;
+
+static stepd_stats_t stats;
+static overload_t overload = {STEPD_MODE_NORMAL, DEFAULT_MAX_DEPTH, DEFAULT_MAX_LAG_MS * 1000000LL,
+                              DEFAULT_MIN_RATE_HZ, 0, 0, 0, 0};
+static int udpFd = -1;
+static context_arena_t arena;
+static uint8_t arenaFull;
+static volatile int running = 1;
+
+static void *xrealloc(void *ptr, size_t size)
+{
+    void *p = realloc(ptr, size);
+    if (p == NULL)
+    {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint32_t hashId(uint32_t id)
+{
+    return id * 2654435761u;
+}
+
+static void insertSlot(device_t **table, uint32_t count, device_t *device)
+{
+    uint32_t i = hashId(device->id) & (count - 1);
+    while (table[i] != NULL)
+        i = (i + 1) & (count - 1);
+    table[i] = device;
+}
+
+static device_t *findDevice(uint32_t id)
+{
+    uint32_t i = hashId(id) & (slotCount - 1);
+    while (slots[i] != NULL)
+    {
+        if (slots[i]->id == id)
+            return slots[i];
+        i = (i + 1) & (slotCount - 1);
+    }
+    return NULL;
+}
+
+/* Returns 0 if the rate is not supported, the device then drops its samples until another profile */
+static uint8_t initDevice(device_t *device, const char *gender, uint8_t age, uint8_t height, uint8_t weight,
+                          uint16_t sampleRateHz, uint16_t timeScalingFactor)
+{
+    if (device->inArena)
+        context_arena_set_busy(&arena, device, 1);
+    /* the context is left as it was, it is never fed samples of another rate */
+    device->rejected = !initContext(&device->ctx, (char *)gender, age, height, weight, sampleRateHz, timeScalingFactor);
+    if (device->rejected)
+    {
+        fprintf(stderr, "device %u: unsupported rate %u Hz, its samples are dropped\n", device->id, sampleRateHz);
+    }
+    else
+    {
+        device->baseFactor = device->ctx.decimation.factor;
+        device->mode = STEPD_MODE_NORMAL;
+        device->gender = gender[0];
+        device->shedGap = 0;
+        device->restored = 0;
+    }
+    if (device->inArena)
+        context_arena_set_busy(&arena, device, 0);
+    return !device->rejected;
+}
+
+static void addDevice(device_t *device)
+{
+    if ((deviceCount + 1) * 2 > slotCount)
+    {
+        uint32_t newCount = slotCount * 2;
+        device_t **table = calloc(newCount, sizeof(device_t *));
+        if (table == NULL)
+        {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < slotCount; i++)
+        {
+            if (slots[i] != NULL)
+                insertSlot(table, newCount, slots[i]);
+        }
+        free(slots);
+        slots = table;
+        slotCount = newCount;
+    }
+
+    insertSlot(slots, slotCount, device);
+    deviceCount++;
+    stats.devices = deviceCount;
+}
+
+static device_t *getDevice(uint32_t id)
+{
+    device_t *device = findDevice(id);
+    if (device != NULL)
+        return device;
+
+    if (arena.header != NULL)
+    {
+        device = context_arena_alloc(&arena, id);
+        if (device != NULL)
+            device->inArena = 1;
+        else if (!arenaFull)
+        {
+            fprintf(stderr, "stepd: arena full, device %u and the next ones are not kept across restarts\n", id);
+            arenaFull = 1;
+        }
+    }
+    if (device == NULL)
+        device = calloc(1, sizeof(device_t));
+    if (device == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    device->id = id;
+    initDevice(device, DEFAULT_GENDER, DEFAULT_AGE, DEFAULT_HEIGHT, DEFAULT_WEIGHT, SAMPLE_RATE_HZ, TIME_SCALING_FACTOR);
+    addDevice(device);
+    return device;
+}
+
+/*
+Changes with anything that moves the fields of a device or changes what they hold, an arena of
+another build is not reused: the estimators put other magnitudes in the means, thresholds and
+buffers, and the interpolation keeps other samples in the pre-processing. A build option that
+does either has to be added here.
+*/
+static uint64_t arenaLayout(void)
+{
+    uint64_t layout = sizeof(device_t);
+    layout = layout * 1000003u + sizeof(step_context_t);
+    layout = layout * 1000003u + RING_BUFFER_SIZE;
+    layout = layout * 1000003u + MAX_WINDOW_SIZE;
+    layout = layout * 1000003u + sizeof(accel_t) * 16 + sizeof(time_accel_t);
+#ifdef SKIP_FILTER
+    layout = layout * 1000003u + 1;
+#endif
+#ifdef TRACE_PIPELINE
+    layout = layout * 1000003u + 2;
+#endif
+#ifdef APPROX_MAGNITUDE
+    layout = layout * 1000003u + 3;
+#endif
+#ifdef SQUARED_MAGNITUDE
+    layout = layout * 1000003u + 4;
+#endif
+#ifndef SKIP_INTERPOLATION /* the default, so arenas of default builds stay valid */
+    layout = layout * 1000003u + 5;
+#endif
+    return layout;
+}
+
+/* Adds the devices left in the arena by the previous process, returns how many had to start over */
+static uint32_t restoreDevices(void)
+{
+    uint32_t reset = 0;
+
+    for (uint32_t i = 0; i < arena.header->capacity; i++)
+    {
+        uint32_t state = arena.entries[i].state;
+        if (state == CONTEXT_ARENA_FREE)
+            continue;
+
+        device_t *device = context_arena_slot(&arena, i);
+        device->id = arena.entries[i].key;
+        device->dirty = 0;
+        device->pending = NULL;
+        device->pendingCount = 0;
+        device->pendingCapacity = 0;
+        device->gapAt = 0;
+        device->inArena = 1;
+        if (state == CONTEXT_ARENA_BUSY)
+        {
+            /* stopped in the middle of an update, only the profile can be trusted */
+            step_context_t *ctx = &device->ctx;
+            initDevice(device, device->gender == 'F' ? "F" : "M", ctx->age, ctx->height, ctx->weight,
+                       ctx->sensorRateHz, ctx->preProcess.timeScalingFactor);
+            reset++;
+        }
+        else
+        {
+            device->restored = 1;
+        }
+        addDevice(device);
+    }
+    return reset;
+}
+
+/* Selects a device mapped from the arena, its pointers are still those of the previous process */
+static void resumeDevice(device_t *device)
+{
+    device->restored = 0;
+    if (!relocateContext(&device->ctx, device->gender == 'F' ? "F" : "M"))
+        initDevice(device, DEFAULT_GENDER, DEFAULT_AGE, DEFAULT_HEIGHT, DEFAULT_WEIGHT, SAMPLE_RATE_HZ, TIME_SCALING_FACTOR);
+}
+
+/* Switches the selected device to the current overload mode */
+static void applyMode(device_t *device)
+{
+    uint8_t factor = device->baseFactor;
+    uint16_t rateHz = device->ctx.sensorRateHz;
+
+    if (overload.mode >= STEPD_MODE_DECIMATED && factor * 2 <= MAX_DECIMATION_FACTOR &&
+        rateHz / (factor * 2) >= overload.minRateHz)
+        factor *= 2;
+    if (device->ctx.decimation.factor != factor)
+        changeDecimation(factor);
+    device->mode = overload.mode;
+}
+
+static void processPending(device_t *device)
+{
+    if (device->restored)
+        resumeDevice(device);
+    else
+        selectContext(&device->ctx);
+    if (device->inArena)
+        context_arena_set_busy(&arena, device, 1);
+    if (device->mode != overload.mode)
+        applyMode(device);
+    time_accel_t gapThreshold = device->ctx.preProcess.gapThreshold;
+    for (uint32_t i = 0; i < device->pendingCount; i++)
+    {
+        stepd_sample_t *s = &device->pending[i];
+        /* however short the frames shed before it, the pipeline restarts rather than interpolating over them */
+        if (i + 1 == device->gapAt)
+            changeGapThreshold(0);
+        processSample(s->time, s->x, s->y, s->z);
+        if (i + 1 == device->gapAt)
+            changeGapThreshold(gapThreshold);
+    }
+    device->gapAt = 0;
+    /* degraded, the metrics are published with the steps only */
+    if (device->mode == STEPD_MODE_NORMAL)
+        publishMetrics();
+    stats.samples += device->pendingCount;
+    device->modeSamples[device->mode] += device->pendingCount;
+    device->pendingCount = 0;
+    if (device->inArena)
+        context_arena_set_busy(&arena, device, 0);
+}
+
+static void flushDevices(void)
+{
+    for (uint32_t i = 0; i < dirtyCount; i++)
+    {
+        processPending(dirty[i]);
+        dirty[i]->dirty = 0;
+    }
+    dirtyCount = 0;
+}
+
+static void queueSamples(uint32_t id, const stepd_sample_t *samples, uint16_t count)
+{
+    device_t *device = getDevice(id);
+
+    if (device->rejected)
+    {
+        stats.dropped++;
+        return;
+    }
+    overload.depth += count;
+    if (overload.mode == STEPD_MODE_SHEDDING && overload.accepted + count > overload.maxDepth)
+    {
+        /* rather than everything lagging further, the pipeline of the device restarts at its next sample */
+        device->shedGap = 1;
+        device->shed += count;
+        stats.shed += count;
+        return;
+    }
+    overload.accepted += count;
+
+    /* one gap per batch, a second one processes the samples before it */
+    if (device->pendingCount + count > MAX_PENDING || (device->shedGap && device->gapAt))
+        processPending(device);
+    if (device->shedGap)
+    {
+        device->gapAt = device->pendingCount + 1;
+        device->shedGap = 0;
+    }
+
+    if (device->pendingCount + count > device->pendingCapacity)
+    {
+        uint32_t capacity = device->pendingCapacity ? device->pendingCapacity : STEPD_MAX_BATCH;
+        while (capacity < device->pendingCount + count)
+            capacity *= 2;
+        device->pending = xrealloc(device->pending, capacity * sizeof(stepd_sample_t));
+        device->pendingCapacity = capacity;
+    }
+    memcpy(&device->pending[device->pendingCount], samples, count * sizeof(stepd_sample_t));
+    device->pendingCount += count;
+
+    if (!device->dirty)
+    {
+        if (dirtyCount == dirtyCapacity)
+        {
+            dirtyCapacity = dirtyCapacity ? dirtyCapacity * 2 : 256;
+            dirty = xrealloc(dirty, dirtyCapacity * sizeof(device_t *));
+        }
+        dirty[dirtyCount++] = device;
+        device->dirty = 1;
+    }
+}
+
+/* Returns 0 if the profile was rejected */
+static uint8_t applyProfile(uint32_t id, const stepd_profile_t *profile)
+{
+    device_t *device = getDevice(id);
+
+    /* samples already queued belong to the previous profile */
+    if (device->pendingCount > 0)
+        processPending(device);
+
+    return initDevice(device, profile->gender == 'F' ? "F" : "M", profile->age, profile->height, profile->weight,
+                      profile->sampleRateHz, profile->timeScalingFactor);
+}
+
+static void queueReply(const stepd_header_t *request, int fd, const struct sockaddr_in *addr, socklen_t addrLen)
+{
+    if (replyCount == replyCapacity)
+    {
+        replyCapacity = replyCapacity ? replyCapacity * 2 : 256;
+        replies = xrealloc(replies, replyCapacity * sizeof(reply_t));
+    }
+    reply_t *reply = &replies[replyCount++];
+    reply->request = *request;
+    reply->fd = fd;
+    reply->addrLen = addrLen;
+    if (addr != NULL)
+        reply->addr = *addr;
+}
+
+static void sendReplies(void)
+{
+    for (uint32_t i = 0; i < replyCount; i++)
+    {
+        reply_t *reply = &replies[i];
+        uint8_t frame[sizeof(stepd_header_t) + sizeof(reply_payload_t)];
+        stepd_header_t *header = (stepd_header_t *)frame;
+        size_t size = sizeof(stepd_header_t);
+
+        header->version = STEPD_VERSION;
+        header->count = 0;
+        header->deviceId = reply->request.deviceId;
+        header->seq = reply->request.seq;
+
+        if (reply->request.type == STEPD_STATS)
+        {
+            header->type = STEPD_STATS_REPLY;
+            memcpy(frame + size, &stats, sizeof(stepd_stats_t));
+            size += sizeof(stepd_stats_t);
+        }
+        else if (reply->request.type == STEPD_MODES)
+        {
+            stepd_modes_t modes = {0};
+            device_t *device = findDevice(reply->request.deviceId);
+            if (device != NULL)
+            {
+                memcpy(modes.samples, device->modeSamples, sizeof(modes.samples));
+                modes.shed = device->shed;
+                modes.mode = device->mode;
+            }
+            header->type = STEPD_MODES_REPLY;
+            memcpy(frame + size, &modes, sizeof(stepd_modes_t));
+            size += sizeof(stepd_modes_t);
+        }
+        else if (reply->request.type == STEPD_PROFILE)
+        {
+            header->type = STEPD_REJECTED;
+        }
+        else
+        {
+            stepd_metrics_t metrics = {0};
+            device_t *device = findDevice(reply->request.deviceId);
+            if (device != NULL)
+            {
+                step_metrics_t published;
+                getMetrics(&device->ctx, &published);
+                metrics.steps = published.steps;
+                metrics.distance = published.distance;
+                metrics.calories = published.calories;
+            }
+            header->type = STEPD_METRICS;
+            memcpy(frame + size, &metrics, sizeof(stepd_metrics_t));
+            size += sizeof(stepd_metrics_t);
+        }
+
+        ssize_t sent;
+        if (reply->addrLen > 0)
+            sent = sendto(reply->fd, frame, size, MSG_DONTWAIT, (struct sockaddr *)&reply->addr, reply->addrLen);
+        else
+            sent = send(reply->fd, frame, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent != (ssize_t)size)
+            stats.dropped++;
+    }
+    replyCount = 0;
+}
+
+/* Handles one complete frame, payload has already been checked against the header */
+static void handleFrame(const stepd_header_t *header, const uint8_t *payload,
+                        int fd, const struct sockaddr_in *addr, socklen_t addrLen)
+{
+    stats.frames++;
+    switch (header->type)
+    {
+    case STEPD_SAMPLES:
+        queueSamples(header->deviceId, (const stepd_sample_t *)payload, header->count);
+        break;
+    case STEPD_PROFILE:
+        if (!applyProfile(header->deviceId, (const stepd_profile_t *)payload))
+        {
+            stats.rejected++;
+            queueReply(header, fd, addr, addrLen);
+        }
+        break;
+    case STEPD_QUERY:
+    case STEPD_STATS:
+    case STEPD_MODES:
+        queueReply(header, fd, addr, addrLen);
+        break;
+    default:
+        stats.dropped++;
+        break;
+    }
+}
+
+static void readUdp(int fd)
+{
+    uint32_t reads = 0;
+    static uint8_t buffers[UDP_BATCH][sizeof(stepd_header_t) + STEPD_MAX_BATCH * sizeof(stepd_sample_t)];
+    static struct sockaddr_in addrs[UDP_BATCH];
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iovecs[UDP_BATCH];
+
+    for (;;)
+    {
+        for (int i = 0; i < UDP_BATCH; i++)
+        {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = sizeof(buffers[i]);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+
+        int n = recvmmsg(fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0)
+            return;
+
+        for (int i = 0; i < n; i++)
+        {
+            const stepd_header_t *header = (const stepd_header_t *)buffers[i];
+            int32_t payloadSize = msgs[i].msg_len >= sizeof(stepd_header_t) ? stepd_payload_size(header) : -1;
+            if (payloadSize < 0 || msgs[i].msg_len != sizeof(stepd_header_t) + (uint32_t)payloadSize)
+            {
+                stats.dropped++;
+                continue;
+            }
+            handleFrame(header, buffers[i] + sizeof(stepd_header_t), fd, &addrs[i], msgs[i].msg_hdr.msg_namelen);
+        }
+
+        if (n < UDP_BATCH || ++reads == READS_PER_ROUND)
+            return;
+    }
+}
+
+static void closeStream(int epollFd, endpoint_t *endpoint)
+{
+    /* the fd may still be the target of a queued reply */
+    flushDevices();
+    sendReplies();
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, endpoint->fd, NULL);
+    close(endpoint->fd);
+    free(endpoint);
+}
+
+/* @return 0 if the stream was closed */
+static int readStream(int epollFd, endpoint_t *endpoint)
+{
+    for (uint32_t reads = 0; reads < READS_PER_ROUND; reads++)
+    {
+        ssize_t n = recv(endpoint->fd, endpoint->rx + endpoint->used, RX_BUFFER_SIZE - endpoint->used, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (n <= 0)
+        {
+            closeStream(epollFd, endpoint);
+            return 0;
+        }
+        endpoint->used += n;
+
+        uint32_t offset = 0;
+        while (endpoint->used - offset >= sizeof(stepd_header_t))
+        {
+            const stepd_header_t *header = (const stepd_header_t *)(endpoint->rx + offset);
+            int32_t payloadSize = stepd_payload_size(header);
+            if (payloadSize < 0)
+            {
+                /* framing is lost, nothing after this can be trusted */
+                stats.dropped++;
+                closeStream(epollFd, endpoint);
+                return 0;
+            }
+            if (endpoint->used - offset < sizeof(stepd_header_t) + payloadSize)
+                break;
+            handleFrame(header, endpoint->rx + offset + sizeof(stepd_header_t), endpoint->fd, NULL, 0);
+            offset += sizeof(stepd_header_t) + payloadSize;
+        }
+        memmove(endpoint->rx, endpoint->rx + offset, endpoint->used - offset);
+        endpoint->used -= offset;
+    }
+    return 1;
+}
+
+static endpoint_t *newEndpoint(int epollFd, enum endpoint_kind kind, int fd, size_t rxSize)
+{
+    endpoint_t *endpoint = calloc(1, sizeof(endpoint_t) + rxSize);
+    if (endpoint == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    endpoint->kind = kind;
+    endpoint->fd = fd;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = endpoint;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+    return endpoint;
+}
+
+static void acceptStreams(int epollFd, int listenFd)
+{
+    for (;;)
+    {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        int size = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        newEndpoint(epollFd, ENDPOINT_STREAM, fd, RX_BUFFER_SIZE);
+    }
+}
+
+static int openUnix(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static int openUdp(const char *host, uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (fd < 0 || inet_pton(AF_INET, host, &addr.sin_addr) != 1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror(host);
+        exit(EXIT_FAILURE);
+    }
+    int size = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return fd;
+}
+
+static const char *modeNames[STEPD_MODE_COUNT] = {"normal", "lean", "decimated", "shedding"};
+
+static void setMode(uint8_t mode, uint64_t depth, int64_t lagNs, int64_t now)
+{
+    fprintf(stderr, "stepd: %s mode (%llu samples received, round of %.1f ms)\n", modeNames[mode],
+            (unsigned long long)depth, lagNs / 1e6);
+    overload.mode = mode;
+    overload.changedNs = now;
+    stats.mode = mode;
+    stats.modeChanges++;
+#ifdef TRACE_PIPELINE
+    trace_pause(mode >= STEPD_MODE_LEAN);
+#endif
+}
+
+/* Called after every round with the time the round started */
+static void updateOverload(int64_t startNs)
+{
+    int64_t now = nowNs();
+    int64_t lagNs = now - startNs;
+    uint64_t depth = overload.depth;
+    uint8_t mode = overload.mode;
+
+    overload.depth = 0;
+    overload.accepted = 0;
+    if (depth > overload.maxDepth || lagNs > overload.maxLagNs)
+    {
+        overload.calmSinceNs = 0;
+        if (mode < STEPD_MODE_SHEDDING && now - overload.changedNs >= OVERLOAD_HOLD_MS * 1000000LL)
+            mode++;
+    }
+    else if (depth > overload.maxDepth / 2 || lagNs > overload.maxLagNs / 2)
+    {
+        overload.calmSinceNs = 0;
+    }
+    else if (overload.calmSinceNs == 0)
+    {
+        overload.calmSinceNs = now;
+    }
+    else if (mode > STEPD_MODE_NORMAL && now - overload.calmSinceNs >= OVERLOAD_RECOVER_MS * 1000000LL)
+    {
+        overload.calmSinceNs = now;
+        mode--;
+    }
+
+    if (mode != overload.mode)
+        setMode(mode, depth, lagNs, now);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-s unix_socket_path] [-p udp_port] [-b udp_bind_address]\n"
+            "          [-D max_samples_per_round] [-L max_round_ms] [-m min_decimated_rate_hz]\n"
+            "          [-A arena_path] [-n arena_devices]\n"
+            "  at least one of -s and -p is required, UDP binds to 127.0.0.1 by default\n"
+            "  the overload limits default to %u samples and %u ms, -L 0 turns the controller off\n"
+            "  -A keeps the devices in a file to resume them after a restart, %u devices by default\n",
+            name, DEFAULT_MAX_DEPTH, DEFAULT_MAX_LAG_MS, DEFAULT_ARENA_CAPACITY);
+}
+
+int main(int argc, char **argv)
+{
+    const char *unixPath = NULL;
+    const char *host = "127.0.0.1";
+    const char *arenaPath = NULL;
+    uint32_t arenaCapacity = DEFAULT_ARENA_CAPACITY;
+    int port = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:b:D:L:m:A:n:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            unixPath = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'b':
+            host = optarg;
+            break;
+        case 'D':
+            overload.maxDepth = strtoul(optarg, NULL, 10);
+            break;
+        case 'L':
+            overload.maxLagNs = (int64_t)(atof(optarg) * 1e6);
+            break;
+        case 'm':
+            overload.minRateHz = (uint16_t)atoi(optarg);
+            break;
+        case 'A':
+            arenaPath = optarg;
+            break;
+        case 'n':
+            arenaCapacity = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (unixPath == NULL && port == 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifdef DUMP_FILE
+    fprintf(stderr, "warning: built with DUMP_FILE, every stage is written to csv (configure with -DDUMP_STAGES=OFF)\n");
+#endif
+
+    slotCount = INITIAL_DEVICE_SLOTS;
+    slots = calloc(slotCount, sizeof(device_t *));
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0 || slots == NULL)
+    {
+        perror("stepd");
+        return EXIT_FAILURE;
+    }
+
+    if (arenaPath != NULL)
+    {
+        int64_t start = nowNs();
+        int opened = context_arena_open(&arena, arenaPath, sizeof(device_t), arenaCapacity, arenaLayout());
+        if (opened < 0)
+        {
+            perror(arenaPath);
+            return EXIT_FAILURE;
+        }
+        if (opened == CONTEXT_ARENA_REPLACED)
+            fprintf(stderr, "stepd: %s is not an arena of this build, moved to %s.old\n", arenaPath, arenaPath);
+        if (opened == CONTEXT_ARENA_ATTACHED)
+        {
+            uint32_t reset = restoreDevices();
+            fprintf(stderr, "stepd: %u devices resumed from %s in %.2f ms, %u started over%s\n", deviceCount, arenaPath,
+                    (nowNs() - start) / 1e6, reset, arena.wasClean ? "" : " (not closed cleanly)");
+        }
+    }
+
+    int listenFd = -1;
+    if (unixPath != NULL)
+    {
+        listenFd = openUnix(unixPath);
+        newEndpoint(epollFd, ENDPOINT_LISTEN, listenFd, 0);
+    }
+    if (port != 0)
+    {
+        udpFd = openUdp(host, port);
+        newEndpoint(epollFd, ENDPOINT_UDP, udpFd, 0);
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    newEndpoint(epollFd, ENDPOINT_SIGNAL, sigFd, 0);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (running)
+    {
+        int n = epoll_wait(epollFd, events, MAX_EVENTS, overload.mode != STEPD_MODE_NORMAL ? OVERLOAD_POLL_MS : -1);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        int64_t roundStart = nowNs();
+
+        for (int i = 0; i < n; i++)
+        {
+            endpoint_t *endpoint = events[i].data.ptr;
+            switch (endpoint->kind)
+            {
+            case ENDPOINT_LISTEN:
+                acceptStreams(epollFd, endpoint->fd);
+                break;
+            case ENDPOINT_STREAM:
+                readStream(epollFd, endpoint);
+                break;
+            case ENDPOINT_UDP:
+                readUdp(endpoint->fd);
+                break;
+            case ENDPOINT_SIGNAL:
+                running = 0;
+                break;
+            }
+        }
+
+        flushDevices();
+        sendReplies();
+        if (overload.maxLagNs > 0)
+            updateOverload(roundStart);
+    }
+
+    fprintf(stderr, "stepd: %llu samples, %llu frames, %u devices, %u dropped, %llu shed, %u mode changes, %u rejected profiles\n",
+            (unsigned long long)stats.samples, (unsigned long long)stats.frames, stats.devices, stats.dropped,
+            (unsigned long long)stats.shed, stats.modeChanges, stats.rejected);
+    if (unixPath != NULL)
+        unlink(unixPath);
+    if (arena.header != NULL)
+        context_arena_close(&arena);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,385 @@
+/* 
+The MIT License (MIT)
+
+Copyright (c) 2020 Anna Brondin and Marcus Nordström and Dario Salvi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file
+ * Load generator for stepd.
+ * Simulates many devices walking, pushes their samples in batches as fast as
+ * possible (or at a fixed rate) and interleaves queries to measure the time from
+ * query to answer, which includes processing everything that was sent before it.
+ * At the end the samples actually processed by stepd are read back, which gives
+ * the sustained throughput even when UDP drops datagrams.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "protocol.h"
+
+#define WAVE_LENGTH 1000       /* 20 s of signal at 50 Hz */
+#define SAMPLE_PERIOD_MS 20
+#define STATS_SEQ 0xFFFFFFFFu
+#define STATS_TIMEOUT_NS 5000000000LL
+#define STATS_RETRY_NS 100000000LL /* UDP requests can be dropped under load */
+
+static int16_t wave[WAVE_LENGTH];
+
+static int fd;
+static int isStream;
+static uint8_t rx[65536];
+static uint32_t rxUsed;
+
+static int64_t *querySent;     /* send time of each query, indexed by seq */
+static int64_t *latencies;
+static uint32_t queryCount;
+static uint32_t answerCount;
+static uint32_t queryCapacity;
+
+static stepd_stats_t lastStats;
+static int64_t lastStatsTime;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* 10 s walking at 1.8 steps/s followed by 10 s standing, 1 g = 1000 */
+static void initWave(void)
+{
+    srand(1);
+    for (int i = 0; i < WAVE_LENGTH; i++)
+    {
+        double t = (double)i * SAMPLE_PERIOD_MS / 1000;
+        double walk = i < WAVE_LENGTH / 2 ? 600 * sin(2 * M_PI * 1.8 * t) : 0;
+        wave[i] = (int16_t)(1000 + walk + (rand() % 40 - 20));
+    }
+}
+
+static void sendFrame(const void *frame, size_t size)
+{
+    const uint8_t *p = frame;
+    while (size > 0)
+    {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* UDP: the datagram is lost, stepd will show it in its sample count */
+            if (!isStream && (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED))
+                return;
+            perror("send");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        size -= n;
+    }
+}
+
+static void handleReply(const stepd_header_t *header, const uint8_t *payload, int64_t now)
+{
+    if (header->type == STEPD_STATS_REPLY)
+    {
+        memcpy(&lastStats, payload, sizeof(stepd_stats_t));
+        lastStatsTime = now;
+    }
+    else if (header->type == STEPD_METRICS && header->seq < queryCount)
+    {
+        latencies[answerCount++] = now - querySent[header->seq];
+    }
+}
+
+static void drainReplies(void)
+{
+    for (;;)
+    {
+        ssize_t n = recv(fd, rx + rxUsed, sizeof(rx) - rxUsed, MSG_DONTWAIT);
+        if (n <= 0)
+            return;
+        int64_t now = nowNs();
+        if (!isStream)
+        {
+            int32_t size = stepd_payload_size((stepd_header_t *)rx);
+            if (n >= (ssize_t)sizeof(stepd_header_t) && size >= 0 && n == (ssize_t)sizeof(stepd_header_t) + size)
+                handleReply((stepd_header_t *)rx, rx + sizeof(stepd_header_t), now);
+            continue;
+        }
+
+        rxUsed += n;
+        uint32_t offset = 0;
+        while (rxUsed - offset >= sizeof(stepd_header_t))
+        {
+            stepd_header_t *header = (stepd_header_t *)(rx + offset);
+            int32_t size = stepd_payload_size(header);
+            if (size < 0)
+            {
+                fprintf(stderr, "malformed reply\n");
+                exit(EXIT_FAILURE);
+            }
+            if (rxUsed - offset < sizeof(stepd_header_t) + size)
+                break;
+            handleReply(header, rx + offset + sizeof(stepd_header_t), now);
+            offset += sizeof(stepd_header_t) + size;
+        }
+        memmove(rx, rx + offset, rxUsed - offset);
+        rxUsed -= offset;
+    }
+}
+
+static void sendControl(uint8_t type, uint32_t deviceId, uint32_t seq)
+{
+    stepd_header_t header = {type, STEPD_VERSION, 0, deviceId, seq};
+    sendFrame(&header, sizeof(header));
+}
+
+static void sendQuery(uint32_t deviceId)
+{
+    if (queryCount == queryCapacity)
+    {
+        queryCapacity = queryCapacity ? queryCapacity * 2 : 1024;
+        querySent = realloc(querySent, queryCapacity * sizeof(int64_t));
+        latencies = realloc(latencies, queryCapacity * sizeof(int64_t));
+        if (querySent == NULL || latencies == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    querySent[queryCount] = nowNs();
+    sendControl(STEPD_QUERY, deviceId, queryCount);
+    queryCount++;
+}
+
+/* @return 1 if a stats reply arrived in time */
+static int fetchStats(void)
+{
+    int64_t start = nowNs();
+    int64_t sent = 0;
+    lastStatsTime = 0;
+    while (lastStatsTime == 0 && nowNs() - start < STATS_TIMEOUT_NS)
+    {
+        if (nowNs() - sent > (isStream ? STATS_TIMEOUT_NS : STATS_RETRY_NS))
+        {
+            sendControl(STEPD_STATS, 0, STATS_SEQ);
+            sent = nowNs();
+        }
+        drainReplies();
+        if (lastStatsTime == 0)
+            usleep(100);
+    }
+    return lastStatsTime != 0;
+}
+
+static int compareInt64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentileUs(double p)
+{
+    if (answerCount == 0)
+        return 0;
+    uint32_t i = (uint32_t)(p * (answerCount - 1) + 0.5);
+    return latencies[i] / 1000.0;
+}
+
+static void connectTo(const char *unixPath, const char *host, int port)
+{
+    int size = 8 << 20;
+    if (unixPath != NULL)
+    {
+        struct sockaddr_un addr = {0};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, unixPath, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        isStream = 1;
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror(unixPath);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0 || inet_pton(AF_INET, host, &addr.sin_addr) != 1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror(host);
+            exit(EXIT_FAILURE);
+        }
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s (-s unix_socket_path | -p udp_port [-a host]) [-d devices] [-b batch] [-t seconds] [-r samples_per_sec] [-q frames_per_query]\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *unixPath = NULL;
+    const char *host = "127.0.0.1";
+    int port = 0;
+    uint32_t devices = 1000;
+    uint32_t batch = 25;
+    double seconds = 10;
+    double rate = 0;
+    uint32_t framesPerQuery = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:a:d:b:t:r:q:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': unixPath = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'a': host = optarg; break;
+        case 'd': devices = strtoul(optarg, NULL, 10); break;
+        case 'b': batch = strtoul(optarg, NULL, 10); break;
+        case 't': seconds = atof(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'q': framesPerQuery = strtoul(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if ((unixPath == NULL && port == 0) || devices == 0 || batch == 0 || batch > STEPD_MAX_BATCH || framesPerQuery == 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    initWave();
+    connectTo(unixPath, host, port);
+
+    uint32_t *position = calloc(devices, sizeof(uint32_t));
+    uint8_t *frame = malloc(sizeof(stepd_header_t) + STEPD_MAX_BATCH * sizeof(stepd_sample_t));
+    if (position == NULL || frame == NULL)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    /* spread the devices over the signal so they do not step in lock-step */
+    for (uint32_t d = 0; d < devices; d++)
+        position[d] = (d * 7919) % WAVE_LENGTH;
+
+    if (!fetchStats())
+    {
+        fprintf(stderr, "stepd is not answering\n");
+        return EXIT_FAILURE;
+    }
+    stepd_stats_t startStats = lastStats;
+
+    stepd_header_t *header = (stepd_header_t *)frame;
+    stepd_sample_t *samples = (stepd_sample_t *)(frame + sizeof(stepd_header_t));
+    size_t frameSize = sizeof(stepd_header_t) + batch * sizeof(stepd_sample_t);
+    uint64_t sentSamples = 0;
+    uint64_t frames = 0;
+    int64_t start = nowNs();
+    int64_t end = start + (int64_t)(seconds * 1e9);
+    int64_t now = start;
+
+    while (now < end)
+    {
+        for (uint32_t d = 0; d < devices && now < end; d++)
+        {
+            header->type = STEPD_SAMPLES;
+            header->version = STEPD_VERSION;
+            header->count = batch;
+            header->deviceId = d;
+            header->seq = 0;
+            for (uint32_t i = 0; i < batch; i++)
+            {
+                uint32_t p = position[d] + i;
+                int16_t a = wave[p % WAVE_LENGTH];
+                samples[i].time = (int32_t)p * SAMPLE_PERIOD_MS;
+                samples[i].x = a * 3 / 10;
+                samples[i].y = a * 5 / 10;
+                samples[i].z = a * 8 / 10;
+            }
+            position[d] += batch;
+            sendFrame(frame, frameSize);
+            sentSamples += batch;
+
+            if (++frames % framesPerQuery == 0)
+                sendQuery(d);
+            if ((frames & 15) == 0)
+            {
+                drainReplies();
+                now = nowNs();
+                while (rate > 0 && sentSamples > (now - start) * rate / 1e9)
+                {
+                    drainReplies();
+                    usleep(50);
+                    now = nowNs();
+                }
+            }
+        }
+        now = nowNs();
+    }
+    double sendSeconds = (nowNs() - start) / 1e9;
+
+    if (!fetchStats())
+    {
+        fprintf(stderr, "stepd did not answer the final stats request\n");
+        return EXIT_FAILURE;
+    }
+    double totalSeconds = (lastStatsTime - start) / 1e9;
+    uint64_t processed = lastStats.samples - startStats.samples;
+
+    qsort(latencies, answerCount, sizeof(int64_t), compareInt64);
+    printf("transport        %s\n", isStream ? "unix" : "udp");
+    printf("devices          %u\n", devices);
+    printf("batch            %u samples\n", batch);
+    printf("sent             %llu samples in %.2f s (%.0f samples/s)\n", (unsigned long long)sentSamples, sendSeconds, sentSamples / sendSeconds);
+    printf("processed        %llu samples in %.2f s (%.0f samples/s)\n", (unsigned long long)processed, totalSeconds, processed / totalSeconds);
+    printf("queries          %u sent, %u answered\n", queryCount, answerCount);
+    printf("latency us       p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentileUs(0.5), percentileUs(0.99), percentileUs(0.999), answerCount ? latencies[answerCount - 1] / 1000.0 : 0);
+    printf("overload         %u mode changes, %llu samples shed, mode %u at the end\n",
+           lastStats.modeChanges - startStats.modeChanges, (unsigned long long)(lastStats.shed - startStats.shed), lastStats.mode);
+    return EXIT_SUCCESS;
+}